@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+
+#include <SDL2/SDL.h>
+
+#include "audio.h"
+#include "chip8.h"
+#include "cpu.h"
+#include "scheduler.h"
+#include "helpers/logging.h"
+
+// XO-CHIP plays its pattern at 4000 * 2^((pitch - 64) / 48) bits per second
+static double pattern_rate(uint8_t pitch)
+{
+    return 4000.0 * pow(2.0, (pitch - 64) / 48.0);
+}
+
+static bool same_sound(const audio_event_t *a, const audio_event_t *b)
+{
+    if (a->on != b->on)
+        return false;
+    if (!a->on)
+        return true;                            // silence is silence, whatever the pattern
+    return a->usePattern == b->usePattern && a->pitch == b->pitch &&
+        memcmp(a->pattern, b->pattern, sizeof(a->pattern)) == 0;
+}
+
+// Push the beeper state at an emulated time, if it changed
+static void push_state(audio_t *audio, const chip8_t *chip8, uint64_t sample)
+{
+    audio_event_t event = { .sample = sample, .on = chip8->reg.ST > 0 };
+    if (chip8->mode == MODE_XOCHIP)
+    {
+        memcpy(event.pattern, chip8->audioPattern, sizeof(event.pattern));
+        event.pitch = chip8->pitch;
+        for (size_t i=0; i<sizeof(event.pattern); i++)
+            event.usePattern |= event.pattern[i] != 0;
+    }
+    if (same_sound(&event, &audio->last))
+        return;
+
+    // The callback only moves tail forward, so a stale tail just means less room
+    const unsigned head = atomic_load_explicit(&audio->head, memory_order_relaxed);
+    const unsigned tail = atomic_load_explicit(&audio->tail, memory_order_acquire);
+    if (head - tail == AUDIO_RING_SIZE)
+    {
+        // last is left alone, so the change is pushed again next slice
+        audio->dropped++;
+        return;
+    }
+    audio->events[head % AUDIO_RING_SIZE] = event;
+    atomic_store_explicit(&audio->head, head + 1, memory_order_release);
+    audio->last = event;
+    audio->changes++;
+}
+
+// Start playing a beeper change, called on the audio thread
+static void apply_event(audio_t *audio, const audio_event_t *event)
+{
+    const bool restart = !audio->current.on || audio->current.usePattern != event->usePattern;
+    audio->current = *event;
+    if (restart)
+        audio->phase = 0;
+
+    if (event->usePattern)
+        audio->step = pattern_rate(event->pitch) / AUDIO_SAMPLE_RATE;
+    else
+        audio->step = (double)AUDIO_TONE_HZ / AUDIO_SAMPLE_RATE;
+}
+
+// SDL audio callback, renders the emulated samples from the cursor on
+static void render_audio(void *userdata, Uint8 *stream, int len)
+{
+    audio_t *audio = (audio_t*)userdata;
+    int16_t *out = (int16_t*)stream;
+    const uint32_t count = len / sizeof(int16_t);
+
+    const uint64_t produced = atomic_load_explicit(&audio->produced, memory_order_acquire);
+    const unsigned head = atomic_load_explicit(&audio->head, memory_order_acquire);
+    unsigned tail = atomic_load_explicit(&audio->tail, memory_order_relaxed);
+
+    // The emulation ran ahead, catching up on late frames, skip to within a
+    // frame of it so the latency stays bounded
+    if (produced > audio->cursor + AUDIO_MAX_LAG)
+    {
+        audio->skippedSamples += produced - AUDIO_MAX_LAG - audio->cursor;
+        audio->cursor = produced - AUDIO_MAX_LAG;
+    }
+
+    for (uint32_t i=0; i<count; i++)
+    {
+        if (audio->cursor < produced)
+        {
+            while (tail != head && audio->events[tail % AUDIO_RING_SIZE].sample <= audio->cursor)
+                apply_event(audio, &audio->events[tail++ % AUDIO_RING_SIZE]);
+            audio->cursor++;
+            audio->held = 0;
+        }
+        else if (audio->held < AUDIO_MAX_HOLD)
+        {
+            // The next frame is late, keep the beeper going rather than click
+            audio->held++;
+            audio->heldSamples++;
+        }
+        else
+        {
+            // Paused, stepping or rewinding
+            out[i] = 0;
+            audio->silentSamples++;
+            continue;
+        }
+
+        if (!audio->current.on)
+        {
+            out[i] = 0;
+            continue;
+        }
+
+        bool high;
+        if (audio->current.usePattern)
+        {
+            const unsigned bit = (unsigned)audio->phase;
+            high = (audio->current.pattern[bit >> 3] >> (7 - (bit & 7))) & 1;
+            audio->phase += audio->step;
+            if (audio->phase >= 128)
+                audio->phase -= 128;
+        }
+        else
+        {
+            high = audio->phase < 0.5;
+            audio->phase += audio->step;
+            if (audio->phase >= 1)
+                audio->phase -= 1;
+        }
+        out[i] = high ? audio->amplitude : -audio->amplitude;
+    }
+
+    atomic_store_explicit(&audio->tail, tail, memory_order_release);
+}
+
+void open_audio(audio_t *audio, uint8_t volume)
+{
+    memset(audio, 0, sizeof(*audio));
+    atomic_init(&audio->head, 0);
+    atomic_init(&audio->tail, 0);
+    atomic_init(&audio->produced, 0);
+    audio->amplitude = INT16_MAX * volume / 100;
+    if (volume == 0)
+        return;
+
+    SDL_AudioSpec want = {
+        .freq = AUDIO_SAMPLE_RATE,
+        .format = AUDIO_S16SYS,
+        .channels = 1,
+        .samples = AUDIO_BUFFER_SAMPLES,
+        .callback = render_audio,
+        .userdata = audio,
+    };
+    SDL_AudioSpec have;
+    audio->device = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+    if (audio->device == 0)
+    {
+        Log_Warn("Could not open audio device, running silent: %s", SDL_GetError());
+        return;
+    }
+    SDL_PauseAudioDevice(audio->device, 0);
+
+    Log_Info("Opened audio device");
+    Log_Detail("%i [Hz], %i samples per buffer, %.1f [ms]", AUDIO_SAMPLE_RATE, have.samples,
+        1000.0 * have.samples / AUDIO_SAMPLE_RATE);
+}
+
+void close_audio(audio_t *audio)
+{
+    if (audio->device == 0)
+        return;
+
+    // Waits for a running callback, nothing touches the ring after this
+    SDL_CloseAudioDevice(audio->device);
+    audio->device = 0;
+
+    Log_Info("Closed audio device");
+    Log_Detail("Beeper changes:   %llu, %llu retried on a full ring",
+        (unsigned long long)audio->changes, (unsigned long long)audio->dropped);
+    Log_Detail("Held samples:     %llu", (unsigned long long)audio->heldSamples);
+    Log_Detail("Silent samples:   %llu", (unsigned long long)audio->silentSamples);
+    Log_Detail("Skipped samples:  %llu", (unsigned long long)audio->skippedSamples);
+}
+
+int run_audio_frame(audio_t *audio, chip8_t *chip8, scheduler_t *sched)
+{
+    if (audio->device == 0)
+        return run_frame(chip8, sched, 0);
+
+    const uint32_t frameCycles = next_frame_cycles(sched);
+    const uint64_t frameStart = sched->frames * AUDIO_SAMPLES_PER_FRAME;
+
+    // A change is stamped with the start of the slice it happened in
+    uint32_t done = 0;
+    for (uint32_t s=1; s<=AUDIO_SLICES; s++)
+    {
+        const uint32_t end = (uint64_t)frameCycles * s / AUDIO_SLICES;
+        if (end == done)
+            continue;
+        if (run_cycles(chip8, end - done) != 0)
+            return 1;
+        push_state(audio, chip8, frameStart + (uint64_t)done * AUDIO_SAMPLES_PER_FRAME / frameCycles);
+        done = end;
+    }
+    sched->cycles += frameCycles;
+
+    tick_timers(chip8);
+    sched->frames++;
+
+    const uint64_t frameEnd = frameStart + AUDIO_SAMPLES_PER_FRAME;
+    push_state(audio, chip8, frameEnd);
+    atomic_store_explicit(&audio->produced, frameEnd, memory_order_release);
+    return 0;
+}
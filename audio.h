@@ -0,0 +1,96 @@
+#ifndef AUDIO_H_IRISH
+#define AUDIO_H_IRISH
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <SDL2/SDL.h>
+
+#include "chip8.h"
+#include "scheduler.h"
+
+// Sound timer audio
+//
+// The emulation side runs each frame in AUDIO_SLICES slices and pushes every
+// change of the beeper (ST > 0, and XO-CHIP's pattern and pitch) into a single
+// producer, single consumer ring, stamped with its position on the emulated
+// timeline in samples. The SDL audio callback renders the beeper from the ring,
+// a square wave or the XO-CHIP pattern, following the emulated timeline: it
+// only plays samples the emulation has run, so audio stops when the emulation
+// is paused, stepped or rewound, and skips ahead when the emulation runs ahead
+// of the device. Neither side ever takes a lock.
+
+#define AUDIO_SAMPLE_RATE 48000
+#define AUDIO_SAMPLES_PER_FRAME (AUDIO_SAMPLE_RATE / FRAME_HZ)
+
+// Samples per device callback, 5.3 ms
+#define AUDIO_BUFFER_SAMPLES 256
+
+// Frames are run in slices so beeper changes land within 1/AUDIO_SLICES of a
+// frame of their instruction, about 1 ms
+#define AUDIO_SLICES 16
+
+// Beeper changes the ring holds, a power of 2
+#define AUDIO_RING_SIZE 256
+
+// Tone of the beeper outside of XO-CHIP patterns
+#define AUDIO_TONE_HZ 440
+
+// Emulated samples the callback may trail the emulation by before skipping
+// ahead, one frame plus a device buffer, about 22 ms
+#define AUDIO_MAX_LAG (AUDIO_SAMPLES_PER_FRAME + AUDIO_BUFFER_SAMPLES)
+
+// Samples the beeper is held for when the emulation is late, before going silent
+#define AUDIO_MAX_HOLD AUDIO_SAMPLES_PER_FRAME
+
+typedef struct
+{
+    uint64_t sample;                // emulated time of the change, samples since the start
+    bool on;                        // ST > 0
+    bool usePattern;                // XO-CHIP with an audio pattern loaded, F002
+    uint8_t pitch;                  // XO-CHIP playback rate, Fx3A
+    uint8_t pattern[16];            // XO-CHIP 1-bit audio pattern
+} audio_event_t;
+
+typedef struct audio
+{
+    SDL_AudioDeviceID device;       // 0 -> no audio, frames run without slicing
+    int16_t amplitude;
+
+    // Emulation side
+    audio_event_t last;             // newest state pushed
+    uint64_t changes;               // beeper changes pushed
+    uint64_t dropped;               // beeper changes the full ring had no room for, pushed again later
+
+    // Single producer, single consumer ring of beeper changes, head and tail
+    // on their own cache lines so the two threads don't share one
+    audio_event_t events[AUDIO_RING_SIZE];
+    _Alignas(CACHE_LINE) atomic_uint head;  // next event written, only the emulation writes it
+    _Alignas(CACHE_LINE) atomic_uint tail;  // next event read, only the callback writes it
+    _Alignas(CACHE_LINE) atomic_uint_fast64_t produced; // emulated samples run so far
+
+    // Callback side
+    _Alignas(CACHE_LINE) audio_event_t current; // state being played
+    uint64_t cursor;                // emulated time of the next sample played
+    double phase;                   // position in the square wave period or the pattern's 128 bits
+    double step;                    // phase advance per sample
+    uint32_t held;                  // samples held since the emulation last ran
+    uint64_t heldSamples;           // samples played ahead of the emulation
+    uint64_t silentSamples;         // samples silenced while the emulation wasn't running
+    uint64_t skippedSamples;        // emulated samples skipped to keep the latency down
+} audio_t;
+
+// Open the audio device, volume in percent. Without a device, or at volume 0,
+// the machine just runs silent.
+void open_audio(audio_t *audio, uint8_t volume);
+void close_audio(audio_t *audio);
+
+// run_frame() for the window, the frame runs in slices and every beeper change
+// goes to the audio callback
+//
+// Returns
+//      0           -> success
+//      *           -> anything else on fatal emulation error
+int run_audio_frame(audio_t *audio, chip8_t *chip8, scheduler_t *sched);
+
+#endif
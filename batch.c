@@ -0,0 +1,692 @@
+// pthreads, sysconf() and strdup() are POSIX, not part of -std=c17
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "main.h"
+#include "chip8.h"
+#include "cpu.h"
+#include "jit.h"
+#include "headless.h"
+#include "romlib.h"
+#include "helpers/logging.h"
+#include "helpers/timing.h"
+
+// Longest line of a job file
+#define BATCH_MAX_LINE 1024
+
+// Most tokens on one line of a job file
+#define BATCH_MAX_ARGS 32
+
+// Work stealing queue of job indices. The owner takes jobs from the tail, idle
+// workers steal from the head, so owner and thieves work on opposite ends and
+// a thief takes the jobs the owner would have reached last.
+typedef struct
+{
+    pthread_mutex_t lock;
+    uint32_t *jobs;
+    uint32_t head;
+    uint32_t tail;
+} job_queue_t;
+
+typedef struct batch_pool
+{
+    batch_job_t *jobs;
+    job_queue_t *queues;            // one per worker
+    rom_library_t library;          // index of config.rom_path, every job's ROM is mapped from it
+    uint32_t workers;
+    uint8_t font[16][5];            // text sprites, read once and copied into every machine
+} batch_pool_t;
+
+typedef struct
+{
+    batch_pool_t *pool;
+    uint32_t id;
+    pthread_t thread;
+    uint32_t jobsRun;
+    uint32_t jobsStolen;
+} batch_worker_t;
+
+// Options a job line may use, everything else on the command line is for the
+// batch as a whole
+static const char *jobOptions[] = { "--cpu-hz", "--seed", "--cycles", "--seconds", "--jit", "--jit-verify", "--mode", "--quirks" };
+
+// Golden result options, only job lines have them
+static const char *goldenOptions[] = { "--expect-display", "--expect-ram", "--baseline-ips" };
+
+static bool is_golden_option(const char *arg)
+{
+    for (size_t o=0; o<sizeof(goldenOptions)/sizeof(goldenOptions[0]); o++)
+        if (strcmp(arg, goldenOptions[o]) == 0)
+            return true;
+    return false;
+}
+
+// Split a job line into argv style tokens in place, "" groups a token with spaces
+//
+// Returns
+//      number of tokens, -1 on an unterminated quote or too many tokens
+static int tokenize_job(char *line, char **argv, int maxArgs)
+{
+    int argc = 0;
+    char *p = line;
+
+    while (*p != '\0')
+    {
+        while (isspace((unsigned char)*p))
+            p++;
+        if (*p == '\0')
+            break;
+        if (argc == maxArgs)
+            return -1;
+
+        if (*p == '"')
+        {
+            argv[argc++] = ++p;
+            while (*p != '\0' && *p != '"')
+                p++;
+            if (*p == '\0')
+                return -1;
+        }
+        else
+        {
+            argv[argc++] = p;
+            while (*p != '\0' && !isspace((unsigned char)*p))
+                p++;
+            if (*p == '\0')
+                break;
+        }
+        *p++ = '\0';
+    }
+    return argc;
+}
+
+// Parse one job line, the command line config are the job's defaults
+static int parse_job(batch_job_t *job, const config_t config, uint32_t lineNumber)
+{
+    char *argv[BATCH_MAX_ARGS + 1];
+    argv[0] = "batch";
+    int argc = tokenize_job(job->line, &argv[1], BATCH_MAX_ARGS);
+    if (argc < 0)
+        return Log_Err("Job line %u: unterminated quote or too many options", lineNumber);
+    argc++;
+
+    // Golden results are taken out here, parse_args() doesn't know them
+    int kept = 1;
+    for (int i=1; i<argc; i++)
+    {
+        if (!is_golden_option(argv[i]))
+        {
+            argv[kept++] = argv[i];
+            continue;
+        }
+        if (i+1 >= argc)
+            return Log_Err("Job line %u: option '%s' requires a value", lineNumber, argv[i]);
+
+        const char *option = argv[i];
+        const char *value = argv[++i];
+        char *end = NULL;
+        errno = 0;
+        if (strcmp(option, "--expect-display") == 0)
+        {
+            job->expectDisplay = strtoull(value, &end, 0);
+            job->checkDisplay = true;
+        }
+        else if (strcmp(option, "--expect-ram") == 0)
+        {
+            job->expectRam = strtoull(value, &end, 0);
+            job->checkRam = true;
+        }
+        else
+        {
+            job->baselineIps = strtod(value, &end);
+        }
+        if (errno != 0 || end == value || *end != '\0' || job->baselineIps < 0)
+            return Log_Err("Job line %u: invalid value '%s' for option '%s'", lineNumber, value, option);
+    }
+    argc = kept;
+
+    for (int i=1; i<argc; i++)
+    {
+        if (argv[i][0] != '-')
+            continue;
+
+        bool allowed = false;
+        for (size_t o=0; o<sizeof(jobOptions)/sizeof(jobOptions[0]); o++)
+            allowed |= strcmp(argv[i], jobOptions[o]) == 0;
+        if (!allowed)
+            return Log_Err("Job line %u: option '%s' can't be used by a batch job", lineNumber, argv[i]);
+    }
+
+    // config_t has a const member, so it is copied rather than assigned
+    memcpy(&job->config, &config, sizeof(config_t));
+    job->config.headless = true;
+    job->config.batch_path = NULL;
+    job->config.trace_path = NULL;
+    job->romName = NULL;
+
+    if (parse_args(argc, argv, &job->config, &job->romName) != 0)
+        return Log_Err("Job line %u: invalid job", lineNumber);
+    if (job->romName == NULL)
+        return Log_Err("Job line %u: no ROM given", lineNumber);
+
+    if (job->config.rng_seed == 0)
+        job->config.rng_seed = BATCH_DEFAULT_SEED;
+    return 0;
+}
+
+// Read every job of the job file
+//
+// Returns
+//      number of jobs read, -1 on failure
+static int load_jobs(const config_t config, batch_job_t *jobs)
+{
+    FILE *fp = fopen(config.batch_path, "r");
+    if (fp == NULL)
+    {
+        Log_Err("Unable to open job file: %s", config.batch_path);
+        Log_Err_Detail("Error: %i -> %s", errno, strerror(errno));
+        return -1;
+    }
+
+    char line[BATCH_MAX_LINE];
+    uint32_t lineNumber = 0;
+    int count = 0;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        lineNumber++;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        const char *start = line;
+        while (isspace((unsigned char)*start))
+            start++;
+        if (*start == '\0' || *start == '#')
+            continue;
+
+        if (count == BATCH_MAX_JOBS)
+        {
+            Log_Err("Job file '%s' has more than %i jobs", config.batch_path, BATCH_MAX_JOBS);
+            count = -1;
+            break;
+        }
+
+        batch_job_t *job = &jobs[count];
+        job->line = strdup(start);
+        job->source = strdup(start);
+        if (job->line == NULL || job->source == NULL)
+        {
+            Log_Err("Unable to allocate dynamic memory for job line %u", lineNumber);
+            count = -1;
+            break;
+        }
+        count++;
+
+        if (parse_job(job, config, lineNumber) != 0)
+        {
+            count = -1;
+            break;
+        }
+    }
+
+    fclose(fp);
+    return count;
+}
+
+// Build a quiet headless machine for a job, the machine must be zeroed
+static int init_job_machine(chip8_t *chip8, const batch_job_t *job, const uint8_t font[16][5])
+{
+    const config_t *config = &job->config;
+
+    if (setup_machine(chip8, config->mode, config->quirks, config->window_width, config->window_height) != 0)
+        return 1;
+
+    memcpy(chip8->textSprites, font, sizeof(chip8->textSprites));
+    memcpy(&chip8->ram[FONT_ADDRESS], chip8->textSprites, sizeof(chip8->textSprites));
+
+    chip8->romName = job->romName;
+    chip8->entrypoint = config->entrypoint;
+
+    // Mapped once for every job of the ROM, no file is opened here
+    if (job->rom != NULL)
+    {
+        if (copy_program(chip8, job->rom, job->romSize) != 0)
+            return 1;
+    }
+    else
+    {
+        size_t romPathLen = strlen(config->rom_path) + strlen(job->romName) + 1;
+        chip8->romPath = (char*) calloc(romPathLen, sizeof(char));
+        if (chip8->romPath == NULL)
+            return Log_Err("Unable to allocate dynamic memory for Chip-8 romPath");
+        snprintf(chip8->romPath, romPathLen, "%s%s", config->rom_path, job->romName);
+
+        if (load_rom(chip8->romPath, &chip8->ram[chip8->entrypoint], sizeof(uint8_t), chip8->ramSize - chip8->entrypoint) != 0)
+            return 1;
+    }
+
+    restart_machine(chip8);
+    chip8->rngState = config->rng_seed;
+    return 0;
+}
+
+static void run_job(batch_pool_t *pool, batch_job_t *job)
+{
+    job->status = 1;
+
+    // chip8_t is cache line aligned, which calloc() doesn't promise
+    chip8_t *chip8 = (chip8_t*) aligned_alloc(_Alignof(chip8_t), sizeof(chip8_t));
+    jit_t *jit = NULL;
+    if (chip8 == NULL)
+    {
+        Log_Err("Unable to allocate dynamic memory for the machine of '%s'", job->romName);
+        return;
+    }
+    memset(chip8, 0, sizeof(chip8_t));
+
+    if (init_job_machine(chip8, job, pool->font) != 0)
+        goto cleanup;
+
+    if (job->config.jit)
+    {
+        jit = (jit_t*) malloc(sizeof(jit_t));
+        if (jit == NULL || init_jit(jit, chip8, job->config.jit_verify) != 0)
+            goto cleanup;
+        chip8->jit = jit;
+    }
+
+    job->status = run_headless(chip8, job->config, NULL, &job->result);
+
+cleanup:
+    if (jit != NULL)
+    {
+        destroy_jit(jit);
+        free(jit);
+    }
+    free(chip8->display);
+    free(chip8->romPath);
+    free(chip8);
+}
+
+// Take the next job, from the worker's own queue first then from the others
+//
+// Returns
+//      index of the job, -1 when every queue is empty
+static int64_t take_job(batch_pool_t *pool, uint32_t id, bool *stolen)
+{
+    for (uint32_t k=0; k<pool->workers; k++)
+    {
+        job_queue_t *queue = &pool->queues[(id + k) % pool->workers];
+        int64_t index = -1;
+
+        pthread_mutex_lock(&queue->lock);
+        if (queue->tail > queue->head)
+            index = (k == 0) ? queue->jobs[--queue->tail] : queue->jobs[queue->head++];
+        pthread_mutex_unlock(&queue->lock);
+
+        if (index >= 0)
+        {
+            *stolen = k != 0;
+            return index;
+        }
+    }
+    return -1;
+}
+
+static void *batch_worker(void *arg)
+{
+    batch_worker_t *worker = (batch_worker_t*) arg;
+    batch_pool_t *pool = worker->pool;
+
+    // Jobs are never added once the workers run, so empty queues stay empty
+    bool stolen;
+    int64_t index;
+    while ((index = take_job(pool, worker->id, &stolen)) >= 0)
+    {
+        batch_job_t *job = &pool->jobs[index];
+        job->worker = worker->id;
+        job->stolen = stolen;
+        run_job(pool, job);
+
+        worker->jobsRun++;
+        worker->jobsStolen += stolen;
+    }
+    return NULL;
+}
+
+static double job_ips(const batch_job_t *job)
+{
+    const double seconds = NS_TO_SECONDS(job->result.elapsed_ns);
+    return seconds > 0 ? job->result.cycles / seconds : 0;
+}
+
+// Compare a finished job with its golden results, tolerance is the percentage
+// the job may run below its baseline, 0 -> throughput isn't checked
+static void check_job(batch_job_t *job, double tolerance)
+{
+    const headless_result_t *r = &job->result;
+
+    job->hashMismatch = (job->checkDisplay && r->displayHash != job->expectDisplay)
+        || (job->checkRam && r->ramHash != job->expectRam);
+    job->tooSlow = tolerance > 0 && job->baselineIps > 0
+        && job_ips(job) < job->baselineIps * (1.0 - tolerance / 100.0);
+}
+
+static const char *job_verdict(const batch_job_t *job)
+{
+    if (job->status != 0)
+        return "FAILED";
+    if (job->hashMismatch)
+        return "MISMATCH";
+    if (job->tooSlow)
+        return "SLOW";
+    return "ok";
+}
+
+static void print_batch_results(const batch_pool_t *pool, uint32_t count, const batch_worker_t *workers, uint64_t wall_ns)
+{
+    printf("\n%-4s %-32s %12s %8s %10s %12s %18s %18s %6s %s\n",
+        "job", "rom", "instructions", "frames", "seconds", "instr/sec", "display_hash", "ram_hash", "worker", "status");
+
+    uint64_t cycles = 0, job_ns = 0, combinedHash = 0xCBF29CE484222325ULL;
+    uint32_t failed = 0, stolen = 0, mismatched = 0, slow = 0;
+    for (uint32_t i=0; i<count; i++)
+    {
+        const batch_job_t *job = &pool->jobs[i];
+        const headless_result_t *r = &job->result;
+
+        printf("%-4u %-32s %12llu %8llu %10.6f %12.0f 0x%016llX 0x%016llX %6u %s\n", i, job->romName,
+            (unsigned long long)r->cycles, (unsigned long long)r->frames, NS_TO_SECONDS(r->elapsed_ns),
+            job_ips(job), (unsigned long long)r->displayHash, (unsigned long long)r->ramHash, job->worker,
+            job_verdict(job));
+
+        cycles += r->cycles;
+        job_ns += r->elapsed_ns;
+        failed += job->status != 0;
+        mismatched += job->status == 0 && job->hashMismatch;
+        slow += job->status == 0 && job->tooSlow;
+        stolen += job->stolen;
+
+        // Order independent of scheduling, jobs are combined in job file order
+        combinedHash = (combinedHash ^ r->displayHash) * 0x100000001B3ULL;
+        combinedHash = (combinedHash ^ r->ramHash) * 0x100000001B3ULL;
+    }
+
+    // Golden result failures in detail, after the table
+    for (uint32_t i=0; i<count; i++)
+    {
+        const batch_job_t *job = &pool->jobs[i];
+        const headless_result_t *r = &job->result;
+        if (job->status != 0 || (!job->hashMismatch && !job->tooSlow))
+            continue;
+
+        printf("\n");
+        if (job->hashMismatch)
+        {
+            Log_Err("Job %u '%s' does not match its golden results", i, job->romName);
+            if (job->checkDisplay && r->displayHash != job->expectDisplay)
+                Log_Err_Detail("Display hash: 0x%016llX, expected 0x%016llX",
+                    (unsigned long long)r->displayHash, (unsigned long long)job->expectDisplay);
+            if (job->checkRam && r->ramHash != job->expectRam)
+                Log_Err_Detail("RAM hash:     0x%016llX, expected 0x%016llX",
+                    (unsigned long long)r->ramHash, (unsigned long long)job->expectRam);
+        }
+
+        // A slowdown isn't a wrong result, it gets a message of its own
+        if (job->tooSlow)
+        {
+            Log_Err("Job %u '%s' ran below its throughput baseline", i, job->romName);
+            Log_Err_Detail("Instructions/sec: %.0f, %.1f%% below the baseline of %.0f",
+                job_ips(job), 100.0 * (1.0 - job_ips(job) / job->baselineIps), job->baselineIps);
+        }
+    }
+
+    const double wall = NS_TO_SECONDS(wall_ns);
+    printf("\n");
+    Log_Info("Batch finished");
+    Log_Detail("Jobs:             %u, %u failed, %u mismatched, %u too slow", count, failed, mismatched, slow);
+    Log_Detail("Workers:          %u, %u jobs stolen", pool->workers, stolen);
+    for (uint32_t w=0; w<pool->workers; w++)
+        printf("\t\t\\_ Worker %-3u       %u jobs, %u stolen\n", w, workers[w].jobsRun, workers[w].jobsStolen);
+    Log_Detail("Instructions:     %llu", (unsigned long long)cycles);
+    Log_Detail("Wall-clock:       %.6f [s]", wall);
+    if (wall > 0)
+    {
+        Log_Detail("Job time:         %.6f [s], %.2fx parallel speedup", NS_TO_SECONDS(job_ns), NS_TO_SECONDS(job_ns) / wall);
+        Log_Detail("Instructions/sec: %.0f", cycles / wall);
+    }
+    Log_Detail("Combined hash:    0x%016llX", (unsigned long long)combinedHash);
+}
+
+// Write one job line back out with the golden results of its run
+static int write_golden_job(FILE *fp, const batch_job_t *job)
+{
+    char line[BATCH_MAX_LINE];
+    char *argv[BATCH_MAX_ARGS];
+    snprintf(line, sizeof(line), "%s", job->source);
+    int argc = tokenize_job(line, argv, BATCH_MAX_ARGS);
+
+    for (int i=0; i<argc; i++)
+    {
+        // Old golden results are dropped, with their values
+        if (is_golden_option(argv[i]))
+        {
+            i++;
+            continue;
+        }
+
+        const bool quote = argv[i][0] == '\0' || strpbrk(argv[i], " \t") != NULL;
+        fprintf(fp, "%s%s%s%s", i ? " " : "", quote ? "\"" : "", argv[i], quote ? "\"" : "");
+    }
+
+    return fprintf(fp, " --expect-display 0x%016llX --expect-ram 0x%016llX --baseline-ips %.0f\n",
+        (unsigned long long)job->result.displayHash, (unsigned long long)job->result.ramHash, job_ips(job)) < 0;
+}
+
+// Write the job file to config.golden_path with the golden results of this
+// run, comments and blank lines are kept as they are
+static int write_golden(const config_t config, const batch_job_t *jobs)
+{
+    FILE *in = fopen(config.batch_path, "r");
+    if (in == NULL)
+        return Log_Err("Unable to open job file: %s", config.batch_path);
+
+    // Written next to the destination first, the job file may be the destination
+    char tmpPath[BATCH_MAX_LINE];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", config.golden_path);
+    FILE *out = fopen(tmpPath, "w");
+    if (out == NULL)
+    {
+        fclose(in);
+        Log_Err("Unable to open golden file: %s", tmpPath);
+        Log_Err_Detail("Error: %i -> %s", errno, strerror(errno));
+        return 1;
+    }
+
+    char line[BATCH_MAX_LINE];
+    int status = 0;
+    uint32_t job = 0;
+    while (status == 0 && fgets(line, sizeof(line), in) != NULL)
+    {
+        const char *start = line;
+        while (isspace((unsigned char)*start))
+            start++;
+
+        if (*start == '\0' || *start == '#')
+            status = fputs(line, out) < 0;
+        else
+            status = write_golden_job(out, &jobs[job++]);
+    }
+
+    fclose(in);
+    if (fclose(out) != 0 || status != 0 || rename(tmpPath, config.golden_path) != 0)
+    {
+        remove(tmpPath);
+        return Log_Err("Error writing golden file: %s", config.golden_path);
+    }
+
+    Log_Info("Wrote golden results of %u jobs to: '%s'", job, config.golden_path);
+    return 0;
+}
+
+int run_batch(const config_t config)
+{
+    batch_pool_t pool = {0};
+    batch_worker_t *workers = NULL;
+    int status = 1;
+
+    pool.jobs = (batch_job_t*) calloc(BATCH_MAX_JOBS, sizeof(batch_job_t));
+    if (pool.jobs == NULL)
+        return Log_Err("Unable to allocate dynamic memory for batch jobs");
+
+    int count = load_jobs(config, pool.jobs);
+    if (count <= 0)
+    {
+        if (count == 0)
+            Log_Err("Job file '%s' has no jobs", config.batch_path);
+        goto cleanup;
+    }
+
+    // Jobs find their ROM in the library by path or @HASH and share its mapping,
+    // ROMs the index doesn't know yet are read from their file by each job.
+    // Indexed ROMs run on their detected platform unless --mode or --quirks
+    // were given.
+    if (open_rom_library(&pool.library, config.rom_path, false) != 0)
+        goto cleanup;
+    for (int i=0; i<count; i++)
+    {
+        batch_job_t *job = &pool.jobs[i];
+        rom_entry_t *entry = find_rom(&pool.library, job->romName);
+        if (entry == NULL && job->romName[0] == '@')
+        {
+            Log_Err("Job %i: no ROM with hash '%s' in the ROM library, rebuild it with --rom-index", i, &job->romName[1]);
+            goto cleanup;
+        }
+        if (entry == NULL)
+            continue;
+        if (use_detected_platform(&job->config, job->romName, entry->mode, entry->quirks) != 0)
+            goto cleanup;
+        // A ROM that changed since it was indexed is read from its file
+        job->romName = entry->path;
+        if ((job->rom = map_rom(&pool.library, entry)) != NULL)
+            job->romSize = entry->size;
+    }
+
+    // Every job shares the text sprites and the opcode tables, both are read
+    // only once built here
+    char fontPath[BATCH_MAX_LINE];
+    snprintf(fontPath, sizeof(fontPath), "%s%s", config.config_path, config.text_rom_name);
+    if (load_rom(fontPath, pool.font, sizeof(uint8_t), sizeof(pool.font)) != 0)
+        goto cleanup;
+    init_dispatch();
+
+    // One worker per core unless told otherwise, never more workers than jobs
+    uint32_t threads = config.threads;
+    if (threads == 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 0 ? (uint32_t)cores : 1;
+    }
+    pool.workers = threads < (uint32_t)count ? threads : (uint32_t)count;
+
+    // Deal the jobs out round robin, stealing evens out jobs of different length
+    const uint32_t perQueue = (count + pool.workers - 1) / pool.workers;
+    pool.queues = (job_queue_t*) calloc(pool.workers, sizeof(job_queue_t));
+    workers = (batch_worker_t*) calloc(pool.workers, sizeof(batch_worker_t));
+    if (pool.queues == NULL || workers == NULL)
+    {
+        Log_Err("Unable to allocate dynamic memory for %u batch workers", pool.workers);
+        goto cleanup;
+    }
+    for (uint32_t w=0; w<pool.workers; w++)
+    {
+        pool.queues[w].jobs = (uint32_t*) calloc(perQueue, sizeof(uint32_t));
+        if (pool.queues[w].jobs == NULL)
+        {
+            Log_Err("Unable to allocate dynamic memory for batch job queues");
+            goto cleanup;
+        }
+        pthread_mutex_init(&pool.queues[w].lock, NULL);
+    }
+    for (uint32_t i=0; i<(uint32_t)count; i++)
+    {
+        job_queue_t *queue = &pool.queues[i % pool.workers];
+        queue->jobs[queue->tail++] = i;
+    }
+
+    Log_Info("Running %i jobs from '%s' on %u worker threads", count, config.batch_path, pool.workers);
+    const uint64_t start = Time_Now_NS();
+
+    uint32_t started = 0;
+    for (; started<pool.workers; started++)
+    {
+        workers[started].pool = &pool;
+        workers[started].id = started;
+        if (pthread_create(&workers[started].thread, NULL, batch_worker, &workers[started]) != 0)
+        {
+            Log_Err("Unable to start batch worker thread %u", started);
+            break;
+        }
+    }
+
+    // Workers that did start drain every queue, including the ones of workers
+    // that failed to start
+    for (uint32_t w=0; w<started; w++)
+        pthread_join(workers[w].thread, NULL);
+    const uint64_t wall_ns = Time_Now_NS() - start;
+
+    if (started > 0)
+    {
+        for (int i=0; i<count; i++)
+            check_job(&pool.jobs[i], config.tolerance);
+        print_batch_results(&pool, count, workers, wall_ns);
+
+        status = 0;
+        for (int i=0; i<count; i++)
+            status |= pool.jobs[i].status;
+
+        // Golden results of a failed run would be worthless, mismatches are
+        // expected though, that's what the new golden results are for
+        if (config.golden_path != NULL)
+        {
+            if (status != 0)
+                Log_Err("Not writing golden results, some jobs failed");
+            else
+                status = write_golden(config, pool.jobs);
+        }
+        else
+        {
+            for (int i=0; i<count; i++)
+                status |= pool.jobs[i].hashMismatch || pool.jobs[i].tooSlow;
+        }
+    }
+
+cleanup:
+    if (pool.queues != NULL)
+    {
+        for (uint32_t w=0; w<pool.workers; w++)
+        {
+            if (pool.queues[w].jobs != NULL)
+                pthread_mutex_destroy(&pool.queues[w].lock);
+            free(pool.queues[w].jobs);
+        }
+    }
+    free(pool.queues);
+    free(workers);
+    close_rom_library(&pool.library);
+    for (int i=0; i<BATCH_MAX_JOBS; i++)
+    {
+        free(pool.jobs[i].line);
+        free(pool.jobs[i].source);
+    }
+    free(pool.jobs);
+    return status;
+}
@@ -0,0 +1,70 @@
+#ifndef BATCH_H_IRISH
+#define BATCH_H_IRISH
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "main.h"
+#include "headless.h"
+
+// Batch mode runs a list of headless jobs on a pool of worker threads.
+//
+// Job file, one job per line, blank lines and lines starting with # are skipped
+//      ROM [options]
+// ROM is relative to ./roms/ and quoted with "" when it contains spaces, or
+// @HASH for a ROM of the ROM library, see romlib.h. Every ROM the library has
+// is mapped once and shared by all of its jobs. The options are the headless
+// ones of the command line: --cpu-hz, --seed, --cycles, --seconds, --jit,
+// --jit-verify, --mode and --quirks. A ROM the library has runs with the
+// instruction set and quirk profile it detected where neither the job nor the
+// command line gives --mode or --quirks. Jobs without --seed use
+// BATCH_DEFAULT_SEED so their hashes can be compared between runs.
+//
+// Jobs can also carry golden results, which turns the batch into a regression
+// check, see `make check`, `make perfcheck` and `make golden`:
+//      --expect-display HASH   display hash the run must end with
+//      --expect-ram HASH       RAM hash the run must end with
+//      --baseline-ips N        instructions/sec the job ran at when it was recorded,
+//                              with --tolerance PCT the job fails when it runs more
+//                              than PCT percent slower
+#define BATCH_DEFAULT_SEED 1
+
+// Most jobs read from one job file
+#define BATCH_MAX_JOBS 4096
+
+// One line of the job file and its results
+typedef struct
+{
+    char *line;                 // the job's line of the job file, tokenized in place
+    char *source;               // the job's line as it was read, for --write-golden
+    char *romName;              // ROM of the job, points into line or the ROM library
+    const uint8_t *rom;         // ROM mapped by the ROM library, NULL -> read from romName
+    uint32_t romSize;
+    config_t config;            // command line config with the job's options applied
+
+    int status;                 // 0 -> success, * -> anything else on failure
+    uint32_t worker;            // worker thread that ran the job
+    bool stolen;                // job was taken from another worker's queue
+    headless_result_t result;
+
+    // Golden results from the job's line
+    bool checkDisplay;          // true -> expectDisplay is checked
+    bool checkRam;              // true -> expectRam is checked
+    uint64_t expectDisplay;
+    uint64_t expectRam;
+    double baselineIps;         // 0 -> throughput is not checked
+    bool hashMismatch;          // ended with other hashes than expected
+    bool tooSlow;               // more than --tolerance below baselineIps
+} batch_job_t;
+
+// Run every job of config.batch_path on config.threads workers, 0 -> one per
+// core, and print every job's results and the aggregated results. With
+// config.golden_path the job file is written there again with every job's
+// golden results replaced by the ones of this run.
+//
+// Returns
+//      0           -> every job succeeded and matched its golden results
+//      *           -> anything else when the job file is invalid or a job failed
+int run_batch(const config_t config);
+
+#endif
@@ -0,0 +1,481 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#include "../main.h"
+#include "../chip8.h"
+#include "../cpu.h"
+#include "../helpers/logging.h"
+#include "../helpers/timing.h"
+
+// Microbenchmarks of the core hot paths
+//
+//      op_*        emulate_instruction() on a loop of one opcode class
+//      draw_*      draw_instruction() with wrap on/off and 1, 5 and 15 row sprites,
+//                  and 16x16 sprites into the SUPER-CHIP and XO-CHIP hires displays
+//      hires_*     emulate_instruction() of the SUPER-CHIP scroll opcodes in hires
+//      validate_pc validate_PC() of a valid machine, and validate_pc_by_value
+//                  the same checks on a copy of the machine passed by value
+//      update_*    update_screen() into the dummy SDL video driver
+//      load_rom    load_rom() of a ROM file
+//
+// Every benchmark takes BENCH_SAMPLES timed samples of a batch of operations,
+// ns/op is the mean over all of them and the percentiles are of the per-sample
+// ns/op. Results are printed as CSV, or as JSON with --json, for comparing
+// across commits.
+
+#define BENCH_SAMPLES 2000
+#define BENCH_ROM "./roms/test/IBM Logo.ch8"
+
+// Instructions in an op_* program, a multiple of every pattern length below,
+// followed by a jump back to the start
+#define PROGRAM_OPS 120
+
+// Draws read their sprite from here, far from the program
+#define SPRITE_ADDRESS 0xE00
+
+typedef struct
+{
+    const char *name;
+    uint64_t ops;               // operations timed, excluding warm up
+    double ns_per_op;
+    double ops_per_sec;
+    double p50_ns, p90_ns, p99_ns, max_ns;
+} bench_result_t;
+
+typedef struct
+{
+    chip8_t *chip8;
+    sdl_t sdl;
+    config_t config;
+    char *romPath;
+    uint8_t x, y;               // draw position, moved every draw to hit every alignment
+} bench_ctx_t;
+
+// Returns
+//      0           -> success
+//      *           -> anything else on failure
+typedef int (*bench_op_t)(bench_ctx_t *ctx);
+
+// Opcode at program index i of an op_* benchmark, V0 = 0 and V1 = 1 throughout
+typedef uint16_t (*program_t)(uint16_t i);
+
+static uint16_t prog_cls(uint16_t i)        { (void)i; return 0x00E0; }
+static uint16_t prog_jp(uint16_t i)         { return 0x1000 | (0x200 + (i+1)*2); }
+static uint16_t prog_ld_add(uint16_t i)     { return (i % 2) ? 0x7B03 : 0x6A12; }
+static uint16_t prog_rnd(uint16_t i)        { (void)i; return 0xC2FF; }
+static uint16_t prog_bcd(uint16_t i)        { (void)i; return 0xF233; }
+static uint16_t prog_store_load(uint16_t i) { return (i % 2) ? 0xF365 : 0xF355; }
+static uint16_t prog_draw(uint16_t i)       { (void)i; return 0xD015; }
+static uint16_t prog_scroll(uint16_t i)     { static const uint16_t pattern[] = { 0x00C4, 0x00FB, 0x00FC }; return pattern[i % 3]; }
+
+static uint16_t prog_call_ret(uint16_t i)
+{
+    // CALL over a JP to a RET, the RET comes back to the JP to the next triple
+    const uint16_t address = 0x200 + i*2;
+    switch (i % 3)
+    {
+        case 0:  return 0x2000 | (address + 4);
+        case 1:  return 0x1000 | (address + 4);
+        default: return 0x00EE;
+    }
+}
+
+static uint16_t prog_skip(uint16_t i)
+{
+    // SE taken over an LD, SE Vx, Vy not taken into an LD
+    static const uint16_t pattern[] = { 0x3000, 0x6000, 0x5010, 0x6000 };
+    return pattern[i % 4];
+}
+
+static uint16_t prog_alu(uint16_t i)
+{
+    static const uint16_t pattern[] = { 0x8230, 0x8231, 0x8232, 0x8233, 0x8234, 0x8235, 0x8236, 0x8237, 0x823E, 0x8240 };
+    return pattern[i % 10];
+}
+
+static uint16_t prog_ld_i(uint16_t i)
+{
+    // I stays near SPRITE_ADDRESS, LD I resets whatever ADD I added
+    return (i % 2) ? 0xF21E : (0xA000 | SPRITE_ADDRESS);
+}
+
+static uint16_t prog_keys(uint16_t i)
+{
+    // No key is down: SKP not taken, SKNP taken over an LD
+    static const uint16_t pattern[] = { 0xE09E, 0xE0A1, 0x6000 };
+    return pattern[i % 3];
+}
+
+static uint16_t prog_timers(uint16_t i)
+{
+    static const uint16_t pattern[] = { 0xF215, 0xF307, 0xF218 };
+    return pattern[i % 3];
+}
+
+static void reset_machine(chip8_t *chip8)
+{
+    memset(&chip8->reg, 0, sizeof(chip8->reg));
+    memset(chip8->keypad, 0, sizeof(chip8->keypad));
+    memset(chip8->display, 0, chip8->displaySize);
+    chip8->reg.V1 = 1;
+    chip8->reg.V2 = 0x5A;
+    chip8->reg.I = SPRITE_ADDRESS;
+    chip8->reg.PC = 0x200;
+    chip8->rngState = 1;
+    chip8->state = RUNNING;
+}
+
+static void load_program(chip8_t *chip8, program_t program)
+{
+    reset_machine(chip8);
+    for (uint16_t i=0; i<PROGRAM_OPS; i++)
+    {
+        const uint16_t opcode = program(i);
+        chip8->ram[0x200 + i*2] = opcode >> 8;
+        chip8->ram[0x200 + i*2 + 1] = opcode & 0xFF;
+    }
+    chip8->ram[0x200 + PROGRAM_OPS*2] = 0x12;
+    chip8->ram[0x200 + PROGRAM_OPS*2 + 1] = 0x00;
+    invalidate_decoded(chip8, 0, CODE_SIZE);
+}
+
+static int op_emulate(bench_ctx_t *ctx)
+{
+    return emulate_instruction(ctx->chip8);
+}
+
+static int op_draw(bench_ctx_t *ctx)
+{
+    // Step through x and y with strides coprime to the display size
+    ctx->x = (ctx->x + 7) % ctx->chip8->displayX;
+    ctx->y = (ctx->y + 3) % ctx->chip8->displayY;
+    ctx->chip8->reg.V0 = ctx->x;
+    ctx->chip8->reg.V1 = ctx->y;
+    return draw_instruction(ctx->chip8);
+}
+
+static int op_validate_pc(bench_ctx_t *ctx)
+{
+    return validate_PC(ctx->chip8);
+}
+
+// validate_PC() as it was when it took chip8_t by value, kept to measure
+// what copying the whole machine per instruction costs
+static int validate_PC_by_value(chip8_t chip8)
+{
+    if (chip8.reg.PC >= CODE_SIZE - 1)
+        return Log_Err("Chip-8 is trying to execute invalid RAM address: 0x%04X", chip8.reg.PC);
+
+    if (chip8.reg.PC % 2 == 1)
+        return Log_Err("Error, Chip-8 trying to execute non-even RAM address: 0x%04X", chip8.reg.PC);
+
+    return 0;
+}
+
+// Called through a volatile pointer so the compiler can't inline the copy away
+static int (*volatile validatePcByValue)(chip8_t) = validate_PC_by_value;
+
+static int op_validate_pc_by_value(bench_ctx_t *ctx)
+{
+    return validatePcByValue(*ctx->chip8);
+}
+
+static int op_update_screen(bench_ctx_t *ctx)
+{
+    ctx->chip8->displayDirty = true;
+    update_screen(ctx->sdl, ctx->config, ctx->chip8);
+    return 0;
+}
+
+static int op_load_rom(bench_ctx_t *ctx)
+{
+    return load_rom(ctx->romPath, &ctx->chip8->ram[0x200], sizeof(uint8_t), ctx->chip8->ramSize - 0x200);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    const double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Percentile p (0-100) of sorted samples, nearest rank
+static double percentile(const double *sorted, uint32_t count, double p)
+{
+    uint32_t rank = (uint32_t)((p / 100.0) * count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > count)
+        rank = count;
+    return sorted[rank - 1];
+}
+
+// Time samples batches of op, after one untimed batch to warm up caches
+//
+// Returns
+//      0           -> success
+//      *           -> anything else when op failed
+static int run_bench(const char *name, bench_op_t op, bench_ctx_t *ctx, uint32_t batch, uint32_t samples,
+    double *sampleNs, bench_result_t *result)
+{
+    for (uint32_t i=0; i<batch; i++)
+        if (op(ctx) != 0)
+            return Log_Err("Benchmark '%s' failed", name);
+
+    uint64_t total = 0;
+    for (uint32_t s=0; s<samples; s++)
+    {
+        const uint64_t start = Time_Now_NS();
+        for (uint32_t i=0; i<batch; i++)
+            if (op(ctx) != 0)
+                return Log_Err("Benchmark '%s' failed", name);
+        const uint64_t elapsed = Time_Now_NS() - start;
+
+        total += elapsed;
+        sampleNs[s] = (double)elapsed / batch;
+    }
+    qsort(sampleNs, samples, sizeof(double), compare_doubles);
+
+    const uint64_t ops = (uint64_t)batch * samples;
+    *result = (bench_result_t) {
+        .name = name,
+        .ops = ops,
+        .ns_per_op = (double)total / ops,
+        .ops_per_sec = total ? ops / NS_TO_SECONDS(total) : 0,
+        .p50_ns = percentile(sampleNs, samples, 50),
+        .p90_ns = percentile(sampleNs, samples, 90),
+        .p99_ns = percentile(sampleNs, samples, 99),
+        .max_ns = sampleNs[samples - 1]
+    };
+    return 0;
+}
+
+// Window, renderer and texture on the dummy video driver, nothing is shown
+static int init_offscreen_sdl(bench_ctx_t *ctx)
+{
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+    if (SDL_Init(SDL_INIT_VIDEO) != 0)
+        return Log_Err("Could not initialize dummy video: %s", SDL_GetError());
+
+    ctx->sdl.window = SDL_CreateWindow("bench", 0, 0, ctx->config.window_width, ctx->config.window_height, SDL_WINDOW_HIDDEN);
+    if (ctx->sdl.window == NULL)
+        return Log_Err("Could not create window: %s", SDL_GetError());
+
+    ctx->sdl.renderer = SDL_CreateRenderer(ctx->sdl.window, -1, SDL_RENDERER_SOFTWARE);
+    if (ctx->sdl.renderer == NULL)
+        return Log_Err("Could not create renderer: %s", SDL_GetError());
+
+    ctx->sdl.texture = SDL_CreateTexture(ctx->sdl.renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+        ctx->config.window_width, ctx->config.window_height);
+    if (ctx->sdl.texture == NULL)
+        return Log_Err("Could not create display texture: %s", SDL_GetError());
+
+    return 0;
+}
+
+static void cleanup_offscreen_sdl(bench_ctx_t *ctx)
+{
+    if (ctx->sdl.texture != NULL)
+        SDL_DestroyTexture(ctx->sdl.texture);
+    if (ctx->sdl.renderer != NULL)
+        SDL_DestroyRenderer(ctx->sdl.renderer);
+    if (ctx->sdl.window != NULL)
+        SDL_DestroyWindow(ctx->sdl.window);
+    SDL_Quit();
+}
+
+static void print_results(const bench_result_t *results, uint32_t count, bool json)
+{
+    if (json)
+    {
+        printf("{\n  \"samples\": %d,\n  \"benchmarks\": [\n", BENCH_SAMPLES);
+        for (uint32_t i=0; i<count; i++)
+        {
+            const bench_result_t *r = &results[i];
+            printf("    {\"name\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.3f, \"ops_per_sec\": %.0f, "
+                "\"p50_ns\": %.3f, \"p90_ns\": %.3f, \"p99_ns\": %.3f, \"max_ns\": %.3f}%s\n",
+                r->name, (unsigned long long)r->ops, r->ns_per_op, r->ops_per_sec,
+                r->p50_ns, r->p90_ns, r->p99_ns, r->max_ns, (i+1 < count) ? "," : "");
+        }
+        printf("  ]\n}\n");
+        return;
+    }
+
+    printf("benchmark,ops,ns_per_op,ops_per_sec,p50_ns,p90_ns,p99_ns,max_ns\n");
+    for (uint32_t i=0; i<count; i++)
+    {
+        const bench_result_t *r = &results[i];
+        printf("%s,%llu,%.3f,%.0f,%.3f,%.3f,%.3f,%.3f\n", r->name, (unsigned long long)r->ops, r->ns_per_op,
+            r->ops_per_sec, r->p50_ns, r->p90_ns, r->p99_ns, r->max_ns);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bool json = false;
+    char *romPath = BENCH_ROM;
+    for (int i=1; i<argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+            json = true;
+        else if (strcmp(argv[i], "--csv") == 0)
+            json = false;
+        else if (strcmp(argv[i], "--rom") == 0 && i+1 < argc)
+            romPath = argv[++i];
+        else
+        {
+            printf("Usage: %s [--csv | --json] [--rom FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    static chip8_t chip8;
+    if (setup_machine(&chip8, MODE_CHIP8, QUIRKS_MODERN, 64, 32) != 0)
+        return 1;
+    memcpy(&chip8.ram[FONT_ADDRESS], (uint8_t[]){ 0xF0, 0x90, 0x90, 0x90, 0xF0 }, 5);
+    for (int i=0; i<16; i++)
+        chip8.ram[SPRITE_ADDRESS + i] = (i % 2) ? 0xA5 : 0xFF;
+
+    // High resolution machines, XO-CHIP draws into both planes
+    static chip8_t schip, xochip;
+    if (setup_machine(&schip, MODE_SCHIP, QUIRKS_MODERN, 64, 32) != 0 || setup_machine(&xochip, MODE_XOCHIP, QUIRKS_MODERN, 64, 32) != 0)
+        return 1;
+    set_resolution(&schip, true);
+    set_resolution(&xochip, true);
+    for (int i=0; i<64; i++)
+        schip.ram[SPRITE_ADDRESS + i] = xochip.ram[SPRITE_ADDRESS + i] = (i % 3) ? 0xA5 : 0xFF;
+
+    init_dispatch();
+
+    bench_ctx_t ctx = {
+        .chip8 = &chip8,
+        .config = {
+            .window_width = chip8.displayX,
+            .window_height = chip8.displayY,
+            .fg_color.value = 0xFFFFFFFF,
+            .bg_color.value = 0x000000FF
+        },
+        .romPath = romPath
+    };
+
+    static const struct
+    {
+        const char *name;
+        program_t program;
+    } classes[] = {
+        { "op_cls",         prog_cls },
+        { "op_jp",          prog_jp },
+        { "op_call_ret",    prog_call_ret },
+        { "op_skip",        prog_skip },
+        { "op_ld_add",      prog_ld_add },
+        { "op_alu",         prog_alu },
+        { "op_ld_i",        prog_ld_i },
+        { "op_rnd",         prog_rnd },
+        { "op_draw",        prog_draw },
+        { "op_keys",        prog_keys },
+        { "op_timers",      prog_timers },
+        { "op_bcd",         prog_bcd },
+        { "op_store_load",  prog_store_load },
+    };
+    static const struct
+    {
+        const char *name;
+        bool wrap;
+        uint8_t rows;
+    } draws[] = {
+        { "draw_wrap_n1",   true,   1 },
+        { "draw_wrap_n5",   true,   5 },
+        { "draw_wrap_n15",  true,   15 },
+        { "draw_clip_n1",   false,  1 },
+        { "draw_clip_n5",   false,  5 },
+        { "draw_clip_n15",  false,  15 },
+    };
+
+    static const struct
+    {
+        const char *name;
+        chip8_t *machine;
+        uint8_t planeMask;
+        uint16_t opcode;
+    } hiresDraws[] = {
+        { "draw_hires_n15",         &schip,     0x1,    0xD01F },
+        { "draw_hires_16x16",       &schip,     0x1,    0xD010 },
+        { "draw_xo_16x16_2planes",  &xochip,    0x3,    0xD010 },
+    };
+
+    static bench_result_t results[32];
+    static double sampleNs[BENCH_SAMPLES];
+    uint32_t count = 0;
+    int status = 0;
+
+    for (size_t i=0; i<sizeof(classes)/sizeof(classes[0]) && status == 0; i++)
+    {
+        load_program(&chip8, classes[i].program);
+        status = run_bench(classes[i].name, op_emulate, &ctx, 256, BENCH_SAMPLES, sampleNs, &results[count++]);
+    }
+
+    for (size_t i=0; i<sizeof(draws)/sizeof(draws[0]) && status == 0; i++)
+    {
+        reset_machine(&chip8);
+        chip8.displayWrap = draws[i].wrap;
+        chip8.instruction.opcode = 0xD010 | draws[i].rows;
+        status = run_bench(draws[i].name, op_draw, &ctx, 256, BENCH_SAMPLES, sampleNs, &results[count++]);
+    }
+
+    for (size_t i=0; i<sizeof(hiresDraws)/sizeof(hiresDraws[0]) && status == 0; i++)
+    {
+        ctx.chip8 = hiresDraws[i].machine;
+        reset_machine(ctx.chip8);
+        ctx.chip8->displayWrap = false;
+        ctx.chip8->planeMask = hiresDraws[i].planeMask;
+        ctx.chip8->instruction.opcode = hiresDraws[i].opcode;
+        status = run_bench(hiresDraws[i].name, op_draw, &ctx, 256, BENCH_SAMPLES, sampleNs, &results[count++]);
+    }
+
+    if (status == 0)
+    {
+        ctx.chip8 = &schip;
+        load_program(&schip, prog_scroll);
+        status = run_bench("hires_scroll", op_emulate, &ctx, 256, BENCH_SAMPLES, sampleNs, &results[count++]);
+    }
+    ctx.chip8 = &chip8;
+
+    if (status == 0)
+    {
+        reset_machine(&chip8);
+        status = run_bench("validate_pc", op_validate_pc, &ctx, 256, BENCH_SAMPLES, sampleNs, &results[count++]);
+    }
+    if (status == 0)
+        status = run_bench("validate_pc_by_value", op_validate_pc_by_value, &ctx, 256, BENCH_SAMPLES, sampleNs, &results[count++]);
+
+    // Offscreen rendering is optional, not every SDL build has the dummy driver
+    if (status == 0 && init_offscreen_sdl(&ctx) == 0)
+    {
+        reset_machine(&chip8);
+        chip8.instruction.opcode = 0xD01F;
+        for (int i=0; i<32 && status == 0; i++)
+            status = op_draw(&ctx);
+        if (status == 0)
+            status = run_bench("update_screen", op_update_screen, &ctx, 16, BENCH_SAMPLES, sampleNs, &results[count++]);
+    }
+    else if (status == 0)
+    {
+        Log_Warn("Skipping update_screen benchmark");
+    }
+    cleanup_offscreen_sdl(&ctx);
+
+    if (status == 0)
+        status = run_bench("load_rom", op_load_rom, &ctx, 1, BENCH_SAMPLES, sampleNs, &results[count++]);
+
+    if (status == 0)
+        print_results(results, count, json);
+
+    free(chip8.display);
+    free(schip.display);
+    free(xochip.display);
+    return status;
+}
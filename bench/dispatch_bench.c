@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../chip8.h"
+#include "../cpu.h"
+#include "../jit.h"
+#include "../helpers/logging.h"
+#include "../helpers/timing.h"
+
+// Dispatch cost per instruction of every opcode dispatch engine
+//
+// Runs a tight loop of cheap ALU, skip and jump instructions, so that the time
+// measured is mostly fetch + dispatch and not the work done by the handlers.
+
+#define BENCH_CYCLES 20000000
+#define BENCH_RUNS 5
+
+typedef struct
+{
+    const char *name;
+    int (*run)(chip8_t *chip8, uint32_t cycles);
+    quirk_profile_t quirks;     // core the engine runs on
+} engine_t;
+
+static const uint16_t benchProgram[] = {
+    0x6000,     // 0x200: LD V0, 0x00
+    0x6101,     // 0x202: LD V1, 0x01
+    0x7001,     // 0x204: ADD V0, 0x01
+    0x8014,     // 0x206: ADD V0, V1
+    0x8212,     // 0x208: AND V2, V1
+    0x8303,     // 0x20A: XOR V3, V0
+    0xA300,     // 0x20C: LD I, 0x300
+    0xF11E,     // 0x20E: ADD I, V1
+    0x3000,     // 0x210: SE V0, 0x00
+    0x8406,     // 0x212: SHR V4
+    0x9010,     // 0x214: SNE V0, V1
+    0x6501,     // 0x216: LD V5, 0x01
+    0x1204,     // 0x218: JP 0x204
+};
+
+static void load_bench_program(chip8_t *chip8)
+{
+    memset(chip8->ram, 0, sizeof(chip8->ram));
+    for (size_t i=0; i<sizeof(benchProgram)/sizeof(benchProgram[0]); i++)
+    {
+        chip8->ram[0x200 + i*2] = benchProgram[i] >> 8;
+        chip8->ram[0x200 + i*2 + 1] = benchProgram[i] & 0xFF;
+    }
+    invalidate_decoded(chip8, 0, CODE_SIZE);
+    memset(&chip8->reg, 0, sizeof(chip8->reg));
+    chip8->reg.PC = 0x200;
+    chip8->rngState = 1;
+}
+
+int main(void)
+{
+    const engine_t engines[] = {
+        { "switch", run_cycles_switch, QUIRKS_MODERN },
+        { "table",  run_cycles_table,  QUIRKS_MODERN },
+#if defined(__GNUC__)
+        { "goto",   run_cycles_goto,   QUIRKS_MODERN },
+#endif
+#if CHIP8_JIT
+        { "jit",    run_cycles_jit,    QUIRKS_MODERN },
+#endif
+        // The build's engine on the other quirk profiles' cores, which should cost the same
+        { "interpreter-vip",    run_cycles_interpreter, QUIRKS_VIP },
+        { "interpreter-chip48", run_cycles_interpreter, QUIRKS_CHIP48 },
+        { "interpreter-schip",  run_cycles_interpreter, QUIRKS_SCHIP },
+    };
+
+    static chip8_t chip8;
+    if (setup_machine(&chip8, MODE_CHIP8, QUIRKS_MODERN, 64, 32) != 0)
+        return 1;
+
+    init_dispatch();
+
+#if CHIP8_JIT
+    // Only run_cycles_jit() uses it, the program reload flushes it between runs
+    static jit_t jit;
+    if (init_jit(&jit, &chip8, false) != 0)
+        return 1;
+    chip8.jit = &jit;
+#endif
+
+    printf("engine,instructions,best_ns,ns_per_instruction,instructions_per_sec\n");
+    for (size_t e=0; e<sizeof(engines)/sizeof(engines[0]); e++)
+    {
+        uint64_t best = UINT64_MAX;
+        for (int run=0; run<BENCH_RUNS; run++)
+        {
+            load_bench_program(&chip8);
+            chip8.quirks = engines[e].quirks;
+
+            uint64_t start = Time_Now_NS();
+            if (engines[e].run(&chip8, BENCH_CYCLES) != 0)
+                return Log_Err("Engine '%s' failed", engines[e].name);
+            uint64_t elapsed = Time_Now_NS() - start;
+
+            if (elapsed < best)
+                best = elapsed;
+        }
+
+        printf("%s,%d,%llu,%.3f,%.0f\n", engines[e].name, BENCH_CYCLES, (unsigned long long)best,
+            (double)best / BENCH_CYCLES, BENCH_CYCLES / NS_TO_SECONDS(best));
+    }
+
+#if CHIP8_JIT
+    destroy_jit(&jit);
+#endif
+    free(chip8.display);
+    return 0;
+}
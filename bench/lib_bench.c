@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "../libchip8.h"
+#include "../helpers/logging.h"
+#include "../helpers/timing.h"
+
+// Steps through libchip8, the way an embedding tool drives the core
+//
+//      run_cycles  libchip8_run_cycles() in batches of BENCH_BATCH instructions
+//      run_frame   libchip8_run_frame() at 100000Hz, with a key toggled per frame
+//      reset       libchip8_reset() of the loaded ROM
+//
+// Linked against libchip8.a and nothing else, no SDL.
+
+#define BENCH_ROM "./roms/test/test_opcode.ch8"
+#define BENCH_CYCLES 20000000
+#define BENCH_BATCH 1000
+#define BENCH_FRAMES 20000
+#define BENCH_RESETS 20000
+
+static void print_row(const char *name, uint64_t ops, uint64_t ns)
+{
+    printf("%s,%llu,%llu,%.3f,%.0f\n", name, (unsigned long long)ops, (unsigned long long)ns,
+        (double)ns / ops, ops / NS_TO_SECONDS(ns));
+}
+
+int main(void)
+{
+    static uint8_t rom[0x1000];
+    FILE *fp = fopen(BENCH_ROM, "rb");
+    if (fp == NULL)
+        return Log_Err("Unable to open '%s'", BENCH_ROM);
+    const size_t romSize = fread(rom, 1, sizeof(rom), fp);
+    fclose(fp);
+
+    const libchip8_options_t options = { .cpu_hz = 100000, .seed = 7 };
+    libchip8_t *machine = libchip8_create(&options);
+    if (machine == NULL || libchip8_load_rom(machine, rom, romSize) != 0)
+        return 1;
+
+    printf("benchmark,ops,total_ns,ns_per_op,ops_per_sec\n");
+
+    uint64_t start = Time_Now_NS();
+    for (uint32_t i=0; i<BENCH_CYCLES / BENCH_BATCH; i++)
+        if (libchip8_run_cycles(machine, BENCH_BATCH) != 0)
+            return Log_Err("libchip8_run_cycles() failed");
+    print_row("run_cycles", BENCH_CYCLES, Time_Now_NS() - start);
+
+    libchip8_reset(machine);
+    start = Time_Now_NS();
+    for (uint32_t i=0; i<BENCH_FRAMES; i++)
+    {
+        libchip8_set_key(machine, 0x5, i % 2);
+        if (libchip8_run_frame(machine) != 0)
+            return Log_Err("libchip8_run_frame() failed");
+    }
+    print_row("run_frame", BENCH_FRAMES, Time_Now_NS() - start);
+
+    start = Time_Now_NS();
+    for (uint32_t i=0; i<BENCH_RESETS; i++)
+        libchip8_reset(machine);
+    print_row("reset", BENCH_RESETS, Time_Now_NS() - start);
+
+    libchip8_destroy(machine);
+    return 0;
+}
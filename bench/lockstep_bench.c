@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../libchip8.h"
+#include "../lockstep.h"
+#include "../helpers/logging.h"
+#include "../helpers/timing.h"
+
+// Runs BENCH_LANES copies of a ROM, each with its own seed, two ways
+//
+//      scalar_*    one libchip8 machine per lane, run one after the other
+//      lockstep_*  one lockstep group of all lanes
+//
+// in frames of 1000 instructions and a timer tick, with keys pressed on a
+// different schedule per lane so lanes waiting on keys diverge. ops are lane
+// instructions. Afterwards every lane's display and RAM must hash the same both ways.
+//
+// The ROMs keep running real code for the whole run, waiting on keys and
+// timers, drawing and reading random numbers. The test ROMs that end in a jump
+// to themselves after a few hundred instructions would only time that jump.
+
+#define BENCH_LANES 256
+#define BENCH_FRAMES 200
+#define BENCH_HZ 60000                  // 1000 instructions per frame
+
+static const char *benchRoms[] = {
+    "./roms/test/keys.ch8",
+    "./roms/test/delay_timer_test.ch8",
+    "./roms/test/random_number_test.ch8",
+};
+
+// Keys down in a lane during a frame
+static uint16_t lane_keys(uint32_t lane, uint32_t frame)
+{
+    return (frame + lane) % 3 == 0 ? 1 << (lane % 16) : 0;
+}
+
+static void print_row(const char *name, const char *rom, uint64_t ops, uint64_t ns)
+{
+    printf("%s_%s,%llu,%llu,%.3f,%.0f\n", name, rom, (unsigned long long)ops, (unsigned long long)ns,
+        (double)ns / ops, ops / NS_TO_SECONDS(ns));
+}
+
+static int bench_rom(const char *path)
+{
+    static uint8_t rom[0x1000];
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return Log_Err("Unable to open '%s'", path);
+    const size_t romSize = fread(rom, 1, sizeof(rom), fp);
+    fclose(fp);
+
+    const char *name = strrchr(path, '/') + 1;
+    const uint64_t ops = (uint64_t)BENCH_LANES * BENCH_FRAMES * (BENCH_HZ / 60);
+
+    static libchip8_t *machines[BENCH_LANES];
+    for (uint32_t l=0; l<BENCH_LANES; l++)
+    {
+        const libchip8_options_t options = { .cpu_hz = BENCH_HZ, .seed = 7 + l };
+        machines[l] = libchip8_create(&options);
+        if (machines[l] == NULL || libchip8_load_rom(machines[l], rom, romSize) != 0)
+            return 1;
+    }
+
+    // Lane n is seeded with 7 + n, like machine n
+    lockstep_t group;
+    if (init_lockstep(&group, libchip8_machine(machines[0]), BENCH_LANES) != 0)
+        return 1;
+
+    uint64_t start = Time_Now_NS();
+    for (uint32_t l=0; l<BENCH_LANES; l++)
+        for (uint32_t f=0; f<BENCH_FRAMES; f++)
+        {
+            libchip8_set_keypad(machines[l], lane_keys(l, f));
+            if (libchip8_run_frame(machines[l]) != 0)
+                return Log_Err("libchip8_run_frame() failed");
+        }
+    print_row("scalar", name, ops, Time_Now_NS() - start);
+
+    start = Time_Now_NS();
+    for (uint32_t f=0; f<BENCH_FRAMES; f++)
+    {
+        for (uint32_t l=0; l<BENCH_LANES; l++)
+            set_lockstep_keys(&group, l, lane_keys(l, f));
+        if (run_lockstep(&group, BENCH_HZ / 60) != 0)
+            return Log_Err("run_lockstep() failed");
+        tick_lockstep_timers(&group);
+    }
+    print_row("lockstep", name, ops, Time_Now_NS() - start);
+
+    // Exported into a copy of machine 0 with a display of its own
+    const chip8_t *image = libchip8_machine(machines[0]);
+    chip8_t *lane = (chip8_t*) aligned_alloc(_Alignof(chip8_t), sizeof(chip8_t));
+    if (lane == NULL)
+        return Log_Err("Unable to allocate dynamic memory for a lane");
+    memcpy(lane, image, sizeof(chip8_t));
+    lane->display = (uint64_t*) calloc(1, image->displaySize);
+    if (lane->display == NULL)
+        return Log_Err("Unable to allocate dynamic memory for a lane's display");
+
+    uint32_t mismatches = 0;
+    for (uint32_t l=0; l<BENCH_LANES; l++)
+    {
+        export_lockstep_lane(&group, l, lane);
+        const chip8_t *scalar = libchip8_machine(machines[l]);
+        if (hash_display(lane) != hash_display(scalar) || hash_ram(lane) != hash_ram(scalar) ||
+            lane->reg.PC != scalar->reg.PC)
+            mismatches++;
+    }
+    if (mismatches != 0)
+        Log_Err("%s: %u of %u lanes don't match their scalar machine", name, mismatches, BENCH_LANES);
+    else
+    {
+        const double percent = 100.0 / (group.vectorLaneSteps + group.sharedLaneSteps + group.scalarLaneSteps);
+        printf("%s: all lanes match, lane instructions %.1f%% in lockstep, %.1f%% lane by lane at a shared PC, %.1f%% diverged\n",
+            name, percent * group.vectorLaneSteps, percent * group.sharedLaneSteps, percent * group.scalarLaneSteps);
+    }
+
+    free(lane->display);
+    free(lane);
+    destroy_lockstep(&group);
+    for (uint32_t l=0; l<BENCH_LANES; l++)
+        libchip8_destroy(machines[l]);
+    return mismatches != 0;
+}
+
+int main(void)
+{
+    printf("benchmark,ops,total_ns,ns_per_op,ops_per_sec\n");
+
+    int failed = 0;
+    for (size_t r=0; r<sizeof(benchRoms) / sizeof(benchRoms[0]); r++)
+        failed |= bench_rom(benchRoms[r]);
+    return failed;
+}
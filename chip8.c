@@ -1,11 +1,135 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
 #include "chip8.h"
+#include "jit.h"
 #include "helpers/logging.h"
 
+// SUPER-CHIP 8x10 text sprites, 0x0-0xF
+static const uint8_t bigFont[16][10] = {
+    { 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF },
+    { 0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF },
+    { 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF },
+    { 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF },
+    { 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03 },
+    { 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF },
+    { 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF },
+    { 0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18 },
+    { 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF },
+    { 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF },
+    { 0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3 },
+    { 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC },
+    { 0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C },
+    { 0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC },
+    { 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF },
+    { 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0 },
+};
+
+const char *mode_name(machine_mode_t mode)
+{
+    switch (mode)
+    {
+        case MODE_CHIP8:  return "chip8";
+        case MODE_SCHIP:  return "schip";
+        case MODE_XOCHIP: return "xochip";
+        default:          return "unknown";
+    }
+}
+
+const char *quirks_name(quirk_profile_t quirks)
+{
+    switch (quirks)
+    {
+        case QUIRKS_MODERN: return "modern";
+        case QUIRKS_VIP:    return "vip";
+        case QUIRKS_CHIP48: return "chip48";
+        case QUIRKS_SCHIP:  return "schip";
+        default:            return "unknown";
+    }
+}
+
+uint32_t quirk_bits(quirk_profile_t quirks)
+{
+    switch (quirks)
+    {
+        case QUIRKS_VIP:    return QUIRKS_VIP_BITS;
+        case QUIRKS_CHIP48: return QUIRKS_CHIP48_BITS;
+        case QUIRKS_SCHIP:  return QUIRKS_SCHIP_BITS;
+        default:            return QUIRKS_MODERN_BITS;
+    }
+}
+
+int setup_machine(chip8_t *chip8, machine_mode_t mode, quirk_profile_t quirks, uint16_t width, uint16_t height)
+{
+    // Rows are packed into 64-bit words, one bit per pixel
+    if (width == 0 || width % 64 != 0)
+        return Log_Err("Display width %i must be a multiple of 64", width);
+
+    chip8->mode = mode;
+    chip8->quirks = quirks;
+    chip8->displayWrap = !(quirk_bits(quirks) & QUIRK_CLIP);
+    chip8->ramSize = mode == MODE_XOCHIP ? RAM_SIZE_XOCHIP : RAM_SIZE;
+    chip8->displayPlanes = mode == MODE_XOCHIP ? 2 : 1;
+    chip8->planeMask = 0x01;
+    chip8->pitch = 64;                          // XO-CHIP's default, 4000 pattern bits per second
+    chip8->loresX = width;
+    chip8->loresY = height;
+
+    // Room for every plane at the high resolution, which doubles both sides
+    const uint32_t loresSize = height * (width / 64) * sizeof(uint64_t);
+    chip8->displayCapacity = chip8->displayPlanes * loresSize * (mode == MODE_CHIP8 ? 1 : 4);
+    chip8->display = (uint64_t*) calloc(chip8->displayCapacity, 1);
+    if (chip8->display == NULL)
+        return Log_Err("Unable to allocate dynamic memory for Chip-8 display");
+    set_resolution(chip8, false);
+
+    // Fx30 addresses the big text sprites through I, like Fx29 the small ones
+    if (mode != MODE_CHIP8)
+        memcpy(&chip8->ram[BIG_FONT_ADDRESS], bigFont, sizeof(bigFont));
+
+    return 0;
+}
+
+void set_resolution(chip8_t *chip8, bool hires)
+{
+    const uint16_t scale = hires ? 2 : 1;
+    chip8->hires = hires;
+    chip8->displayX = chip8->loresX * scale;
+    chip8->displayY = chip8->loresY * scale;
+    chip8->displayWords = chip8->displayX / 64;
+    chip8->planeWords = chip8->displayY * chip8->displayWords;
+    chip8->displaySize = chip8->displayPlanes * chip8->planeWords * sizeof(uint64_t);
+
+    memset(chip8->display, 0, chip8->displayCapacity);
+    chip8->displayDirty = true;
+}
+
+void restart_machine(chip8_t *chip8)
+{
+    chip8->state = RUNNING;
+    memset(&chip8->reg, 0, sizeof(chip8->reg));
+    chip8->reg.PC = chip8->entrypoint;
+    memset(chip8->stack, 0, sizeof(chip8->stack));
+    memset(chip8->keypad, 0, sizeof(chip8->keypad));
+    chip8->planeMask = 0x01;
+    set_resolution(chip8, false);
+}
+
+int copy_program(chip8_t *chip8, const uint8_t *program, size_t size)
+{
+    const size_t programSpace = chip8->ramSize - chip8->entrypoint;
+    if (size > programSpace)
+        return Log_Err("Program of %zu [bytes] doesn't fit in the %zu [bytes] after 0x%03X", size, programSpace, chip8->entrypoint);
+
+    memcpy(&chip8->ram[chip8->entrypoint], program, size);
+    memset(&chip8->ram[chip8->entrypoint + size], 0, programSpace - size);
+    invalidate_decoded(chip8, 0, CODE_SIZE);
+    return 0;
+}
+
 // char *romPath    -> pointer to string of the path to the ROM file
 // void *dest       -> pointer to starting address in RAM to load ROM file into
 // int sz_inp       -> data width of the elements from the input ROM file
@@ -21,7 +145,7 @@ int load_rom(char *romPath, void *dest, int sz_inp, int num_elements)
     if (fp == NULL)
     {
         Log_Err("Unable to open ROM from: %s", romPath);
-        fprintf(stderr, "\t\\_ Error: %i -> %s", errno, strerror(errno));
+        Log_Err_Detail("Error: %i -> %s", errno, strerror(errno));
         return 1;
     }
 
@@ -34,7 +158,7 @@ int load_rom(char *romPath, void *dest, int sz_inp, int num_elements)
 
     // Error if dest_size is too small to fit ROM 
     if (rom_size > dest_size)
-        return Log_Err("Destination size [%i Bytes] is smaller than input ROM size [%i Bytes]", dest_size, rom_size);
+        return Log_Err("Destination size [%li Bytes] is smaller than input ROM size [%li Bytes]", dest_size, rom_size);
 
     // Load ROM to destination
     if (fread(dest, sz_inp, num_elements, fp) == 0)
@@ -48,126 +172,6 @@ int load_rom(char *romPath, void *dest, int sz_inp, int num_elements)
 }
 
 
-int emulate_instruction(chip8_t *chip8)
-{
-    // Chip-8 Instruction Reference
-    // =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
-    // Instruction word size:   2-bytes
-    // Instructions stored as:  Big-Endian format
-    // Instructions first bytes stored at EVEN address
-    //      -> if program includes sprite data it should be padded
-    //         so that any instructions following it will be 
-    //         properly aligned in RAM
-    //
-    // Variables used in instruction comments:
-    //      - nnn || addr   -> a 12-bit value, lowest 12 bits of the instruction
-    //      - n || nibble   -> a 4-bit value, lowest 4 bits of the instruction
-    //      - x             -> a 4-bit value, lower 4 bits of the high byte of the instruction
-    //      - y             -> a 4-bit value, upper 4 bits of the low byte of the instruction
-    //      - kk || byte    -> 8-bit value, the lowest 8 bits of the instruction
-
-    // Make sure PC is set to valid address for instruction execution
-    if (validate_PC(*chip8) != 0)
-    {
-        Log_Err("Fatal error, shutting down...");
-        return 1;
-    }
-
-    // need to save current address as we replace the Log_Info() function after PCs modification
-    // during some instructions
-    uint16_t currentAddress = chip8->reg.PC;
-
-    // Enable/Disable message logging
-    #define INSTRUCTION_DEBUG
-    #ifndef INSTRUCTION_DEBUG
-    #   define Log_Info(...)
-    #else
-    #   define Log_Info(...) printf("\n"); Log_Info("Address: 0x%04X, Opcode: 0x%04X", currentAddress, chip8->instruction.opcode); printf("\t\\_ "); printf(__VA_ARGS__); printf("\n");
-    #endif
-
-    // FIXME: Make below work on big/little endian machines
-    // Load instruction from little endian host machine RAM into big endian Chip-8 RAM
-    chip8->instruction.opcode = chip8->ram[chip8->reg.PC] << 8 | chip8->ram[chip8->reg.PC + 1];
-    chip8->reg.PC += 2;
-
-    // Switch off of upper nibble of instruction
-    switch ((chip8->instruction.opcode >> 12) & 0x0F)
-    {
-        case 0x0:
-            // 0x0nnn -> SYS addr - not implemented on newer machines
-            // 0x00E0 -> CLS - clear screen
-            if (chip8->instruction.KK == 0xE0)
-            {
-                Log_Info("Clearing screen");
-                memset(chip8->display, '\0', chip8->displaySize);
-                break;
-            }
-            // 0x00EE -> RET - return from subroutine
-            if (chip8->instruction.KK == 0xEE)
-            {
-                chip8->reg.PC = chip8->stack[chip8->reg.SP];
-                Log_Info("Return to address: 0x%04X", chip8->reg.PC);
-                chip8->reg.SP--;
-                break;
-            }
-            bad_instruction(currentAddress, chip8->instruction.opcode);
-            break;
-        
-        case 0x1:
-            // 0x1nnn -> JP addr - jump to location nnn
-            chip8->reg.PC = chip8->instruction.NNN;
-            Log_Info("Jump to address: 0x%04X", chip8->reg.PC);
-            break;
-
-        case 0x2:
-            // 0x2nnn -> CALL addr - call subroutine at nnn
-            chip8->reg.SP++;
-            chip8->stack[chip8->reg.SP] = chip8->reg.PC;
-            chip8->reg.PC = chip8->instruction.NNN;
-            Log_Info("Calling function at: 0x%04X, Pushed address: 0x%04X on stack[0x%01X]", chip8->reg.PC, chip8->stack[chip8->reg.SP], chip8->reg.SP);
-            break;
-        
-        case 0x6:
-            // 0x6xkk -> LD Vx, byte
-            chip8->reg.Vx[chip8->instruction.X] = chip8->instruction.KK;
-            Log_Info("Set V%01x to value: 0x%02X", chip8->instruction.X, chip8->instruction.KK);
-            break;
-        
-        case 0x7:
-            // 0x7xkk -> ADD Vx, byte
-            chip8->reg.Vx[chip8->instruction.X] += chip8->instruction.KK;
-            Log_Info("Add 0x%02X to register V%1x, V%1x value: 0x%02X", chip8->instruction.KK, chip8->instruction.X, chip8->instruction.X, chip8->reg.Vx[chip8->instruction.X]);
-            break;
-        
-        case 0xA:
-            // 0xAnnn -> LD I, addr
-            chip8->reg.I = chip8->instruction.NNN;
-            Log_Info("Set I to value: 0x%03X", chip8->reg.I);
-            break;
-        
-        case 0xD:
-            // 0xDxyn -> DRW Vx, Vy, nibble
-            if (draw_instruction(chip8) != 0)
-                return Log_Err("Fatal error, shutting down...");
-            
-            // start_x/y are the starting display coordinates of the sprite on screen
-            uint16_t start_x = chip8->reg.Vx[chip8->instruction.X] % chip8->displayX;
-            uint16_t start_y = chip8->reg.Vx[chip8->instruction.Y] % chip8->displayY;
-            Log_Info("Drawing sprite at location: 0x%03X, of size: [8-bits x %i] , at display coordinates V%1X(x): %i, V%1X(y): %i", chip8->reg.I, chip8->instruction.N, chip8->instruction.X, start_x, chip8->instruction.Y, start_y);
-            break;
-        
-        default:
-            bad_instruction(currentAddress, chip8->instruction.opcode);
-            break;
-    }
-
-    return 0;
-    // Re-enable message logging / clear shenanigans from above
-    #undef Log_Info
-}
-
-
-
 void bad_instruction(uint16_t address, uint16_t opcode)
 {
     printf("\n");
@@ -175,98 +179,340 @@ void bad_instruction(uint16_t address, uint16_t opcode)
 }
 
 // Validate that we are executing a correct address in RAM
-int validate_PC(chip8_t chip8)
+int validate_PC(const chip8_t *chip8)
 {
-    // Make sure we don't execute outside RAM
-    // we do >= of the sizeof(ram)-1 as we don't want to execute if PC >= 4095
+    // Make sure we don't execute outside the code space
+    // we do >= of CODE_SIZE-1 as we don't want to execute if PC >= 4095
     // 4095 is technically a valid RAM address but instructions are aligned to
     // the even address thus executing from the last odd address is not allowed.
     // So, in this case addresses <= 4094 are valid
-    if (chip8.reg.PC >= sizeof(chip8.ram) - 1)
-        return Log_Err("Chip-8 is trying to execute invalid RAM address: 0x%04X", chip8.reg.PC);
+    if (chip8->reg.PC >= CODE_SIZE - 1)
+        return Log_Err("Chip-8 is trying to execute invalid RAM address: 0x%04X", chip8->reg.PC);
 
     // Make sure PC is even, as instructions must be aligned to the even address
-    if (chip8.reg.PC % 2 == 1)
-        return Log_Err("Error, Chip-8 trying to execute non-even RAM address: 0x%04X", chip8.reg.PC);
+    if (chip8->reg.PC % 2 == 1)
+        return Log_Err("Error, Chip-8 trying to execute non-even RAM address: 0x%04X", chip8->reg.PC);
     
     return 0;
 }
 
-// Validate that the sprite instruction is correct
-int validate_sprite(chip8_t chip8)
+// Count the delay and sound timers down, called at 60Hz
+void tick_timers(chip8_t *chip8)
 {
-    // Verify that n is within sprite size limits
-    if (chip8.instruction.N > 15)
-        return Log_Err("Sprite of size 0x%1X too big. Must be <= 15", chip8.instruction.N);
+    if (chip8->reg.DT > 0)
+        chip8->reg.DT--;
+    if (chip8->reg.ST > 0)
+        chip8->reg.ST--;
+}
 
-    return 0;
+// Must be called after RAM is written so instructions are decoded again, this keeps
+// programs that modify their own code working with the decode cache
+void invalidate_decoded(chip8_t *chip8, uint16_t address, uint16_t length)
+{
+    if (length == 0)
+        return;
+
+    // An instruction starts at every even address, so a written byte belongs
+    // to the instruction at its address rounded down to even
+    uint32_t first = address >> 1;
+    uint32_t last = ((uint32_t)address + length - 1) >> 1;
+    const uint32_t entries = sizeof(chip8->decodeCache) / sizeof(chip8->decodeCache[0]);
+    if (first >= entries)
+        return;                                 // XO-CHIP data above the code space
+    if (last >= entries)
+        last = entries - 1;
+
+    memset(&chip8->decodeCache[first], 0, (last - first + 1) * sizeof(decoded_t));
+
+#if CHIP8_JIT
+    // Translated blocks go stale the same way
+    if (chip8->jit != NULL)
+        jit_invalidate(chip8->jit, address, length);
+#endif
 }
 
-int draw_instruction(chip8_t *chip8)
+// 64-bit FNV-1a hash, used to compare the final state of runs
+uint64_t hash_bytes(const void *data, size_t size)
 {
-    // Validate size of sprite is <= 15
-    if (validate_sprite(*chip8) != 0)
-        return 1;
+    const uint8_t *bytes = (const uint8_t*)data;
+    uint64_t hash = 0xCBF29CE484222325ULL;  // FNV offset basis
+    for (size_t i=0; i<size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;           // FNV prime
+    }
+    return hash;
+}
 
-    // start_x/y are the starting display coordinates of the sprite on screen
-    uint16_t start_x = chip8->reg.Vx[chip8->instruction.X] % chip8->displayX;
-    uint16_t start_y = chip8->reg.Vx[chip8->instruction.Y] % chip8->displayY;
-    // reset flags
-    chip8->reg.VF = 0;
+uint64_t hash_display(const chip8_t *chip8)
+{
+    return hash_bytes(chip8->display, chip8->displaySize);
+}
+
+uint64_t hash_ram(const chip8_t *chip8)
+{
+    return hash_bytes(chip8->ram, chip8->ramSize);
+}
+
+// Rotate right, the compiler turns this into a single ror instruction
+static inline uint64_t rotr64(uint64_t value, unsigned shift)
+{
+    shift &= 63;
+    return (value >> shift) | (value << ((64 - shift) & 63));
+}
+
+// XOR one 64-bit word of sprite pixels into the display, returns true on collision
+static inline bool xor_word(uint64_t *word, uint64_t pixels)
+{
+    bool collision = (*word & pixels) != 0;
+    *word ^= pixels;
+    return collision;
+}
+
+// Display kernels
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+// words (display row width in 64-bit words) and width (sprite width in pixels)
+// are constants at the call sites of the 64 and 128 pixel wide displays, so the
+// compiler inlines a copy of each kernel per resolution and sprite size with
+// the word loops unrolled. Other display widths share the generic copy. Draws
+// also get a copy for wrapping and one for clipping sprites.
+
+// Sprite rows are placed at the top of a 64-bit word (the leftmost display pixel
+// is the MSB), shifted to x, XORed into the row and checked for collision with
+// a single AND
+static inline bool draw_row(uint64_t *line, uint64_t pixels, const unsigned words, const unsigned width,
+    unsigned word_x, unsigned shift, bool wrap)
+{
+    if (words == 1)
+    {
+        // 64 pixel wide display, rotating wraps the sprite to the left
+        // edge, shifting drops the pixels past the right edge
+        return xor_word(line, wrap ? rotr64(pixels, shift) : pixels >> shift);
+    }
 
-    // 2D loop over sprite in sprite coordinates -> (pixel, row)
-    for (int row=0; row<chip8->instruction.N; row++)
+    // Wider displays, the sprite spans at most two words
+    bool collision = xor_word(&line[word_x], pixels >> shift);
+    if (shift > 64 - width)
     {
-        // Read in current row sprite data from RAM
-        uint8_t spriteData = chip8->ram[chip8->reg.I + row];
+        unsigned next_x = word_x + 1;
+        if (next_x == words)
+        {
+            if (!wrap)
+                return collision;               // clip at the right edge
+            next_x = 0;                         // wrap sprite
+        }
+        collision |= xor_word(&line[next_x], pixels << (64 - shift));
+    }
+    return collision;
+}
 
+// Draw a sprite into one plane, 8 pixel wide sprites have a byte per row and
+// 16 pixel wide ones two. height and wrap are passed by value so the display
+// writes don't force them to be reloaded every row.
+static inline bool draw_plane(uint64_t *plane, const uint8_t *sprite, const unsigned words, const unsigned width,
+    unsigned rows, uint16_t x, uint16_t y, uint16_t height, bool wrap)
+{
+    const unsigned word_x = x / 64;             // display word holding the sprite's left edge
+    const unsigned shift = x % 64;              // sprite's offset into that word
+    bool collision = false;
+
+    for (unsigned row=0; row<rows; row++)
+    {
         // Convert sprite coordinates to display coordinates
-        uint16_t disp_y = (start_y + row);
-        if (chip8->displayWrap)
-            disp_y %= chip8->displayY;      // wrap sprite
+        uint16_t disp_y = y + row;
+        if (disp_y >= height)
+        {
+            if (!wrap)
+                break;                          // clip at the bottom edge
+            disp_y -= height;                   // wrap sprite
+        }
+
+        const uint64_t pixels = width == 16 ? (uint64_t)(sprite[2 * row] << 8 | sprite[2 * row + 1]) << 48
+                                            : (uint64_t)sprite[row] << 56;
+        collision |= draw_row(&plane[disp_y * words], pixels, words, width, word_x, shift, wrap);
+    }
+    return collision;
+}
+
+// Pick the kernel for the display width and sprite size
+static inline bool draw_kernel(uint64_t *plane, const uint8_t *sprite, uint16_t words, bool big, unsigned rows,
+    uint16_t x, uint16_t y, uint16_t height, const bool wrap)
+{
+    if (words == 1)
+        return big ? draw_plane(plane, sprite, 1, 16, rows, x, y, height, wrap)
+                   : draw_plane(plane, sprite, 1, 8, rows, x, y, height, wrap);
+    if (words == 2)
+        return big ? draw_plane(plane, sprite, 2, 16, rows, x, y, height, wrap)
+                   : draw_plane(plane, sprite, 2, 8, rows, x, y, height, wrap);
+    return draw_plane(plane, sprite, words, big ? 16 : 8, rows, x, y, height, wrap);
+}
+
+// Draw the sprite at address into one plane with the kernel for the display
+// width and sprite size. Sprites are read in place, only one running past the
+// end of RAM is copied, wrapping to address 0.
+static inline bool draw_sprite(const chip8_t *chip8, uint64_t *plane, uint16_t address, bool big, unsigned rows,
+    uint16_t x, uint16_t y)
+{
+    const unsigned spriteBytes = big ? 32 : rows;
+    const uint16_t height = chip8->displayY;
+    const bool wrap = chip8->displayWrap;
+
+    uint8_t wrapped[32];
+    const uint8_t *sprite = &chip8->ram[address];
+    if ((uint32_t)address + spriteBytes > chip8->ramSize)
+    {
+        for (unsigned i=0; i<spriteBytes; i++)
+            wrapped[i] = chip8->ram[(address + i) & (chip8->ramSize - 1)];
+        sprite = wrapped;
+    }
+
+    // Wrapping is a quirk of the machine, a constant in each copy of the kernels
+    if (wrap)
+        return draw_kernel(plane, sprite, chip8->displayWords, big, rows, x, y, height, true);
+    return draw_kernel(plane, sprite, chip8->displayWords, big, rows, x, y, height, false);
+}
+
+int draw_instruction(chip8_t *chip8)
+{
+    // start_x/y are the starting display coordinates of the sprite on screen
+    const uint16_t start_x = chip8->reg.Vx[chip8->instruction.X] % chip8->displayX;
+    const uint16_t start_y = chip8->reg.Vx[chip8->instruction.Y] % chip8->displayY;
 
-        // loop over pixels in current row
-        for (int pixel=0; pixel<8; pixel++)
+    // SUPER-CHIP and XO-CHIP draw a 16x16 sprite for n = 0
+    const bool big = chip8->instruction.N == 0 && chip8->mode != MODE_CHIP8;
+    const unsigned rows = big ? 16 : chip8->instruction.N;
+    bool collision = false;
+
+    if (chip8->displayPlanes == 1)
+    {
+        // CHIP-8 and SUPER-CHIP, a single plane that is always selected
+        collision = draw_sprite(chip8, chip8->display, chip8->reg.I, big, rows, start_x, start_y);
+    }
+    else
+    {
+        // Every selected plane takes the next sprite from RAM, I wraps at the end of RAM
+        uint16_t address = chip8->reg.I;
+        for (uint8_t p=0; p<chip8->displayPlanes; p++)
         {
-            // Convert sprite coordinates to display coordinates
-            uint16_t disp_x = (start_x + pixel);
-            if (chip8->displayWrap)
-                disp_x %= chip8->displayX;  // wrap sprite
-            
-            // if we are not wrapping make sure that the display pixel is within the screen
-            // other wise skip to next row
-            if (disp_x >= chip8->displayX)
-                break;
-
-            // get the current state of the pixel being displayed
-            int disp_Index = (disp_y * chip8->displayX) + disp_x;
-            bool currentPixel = *(chip8->display + disp_Index);
-
-            // FIXME: You dumb shit, you reversed the bytes here...
-            //          with your bad bit shift...
-            //          hours wasted debugging this: 3.5 hrs
-            // ============================================================================================
-            // get the current state of the pixel in the sprite
-            // bool spritePixel = (spriteData >> pixel) & 0x01;
-            
-            // get the current state of the pixel in the sprite
-            bool spritePixel = (spriteData >> (7 - pixel)) & 0x01;
-
-            // Update pixels of Vf, we update pixels by XORing the specified sprite to the screen
-            // Vf is only set when both the screen pixel and the sprite pixel are both on
-            // Check pixel collision
-            if (spritePixel && currentPixel)
-            {
-                *(chip8->display + disp_Index) = false;
-                chip8->reg.VF = 1;
-            }
-            // Check if need to write pixel
-            else if (spritePixel && !currentPixel)
-            {
-                // *(currentPixelAddr) = true;
-                *(chip8->display + disp_Index) = true;
-            }
+            if (!(chip8->planeMask & (1 << p)))
+                continue;
+
+            collision |= draw_sprite(chip8, &chip8->display[p * chip8->planeWords], address, big, rows, start_x, start_y);
+            address = (address + (big ? 32 : rows)) & (chip8->ramSize - 1);
         }
     }
+
+    // Vf is only set when a sprite pixel turned a display pixel off
+    chip8->reg.VF = collision;
+    chip8->displayDirty = true;
     return 0;
 }
+
+void clear_display(chip8_t *chip8)
+{
+    const uint8_t allPlanes = (1 << chip8->displayPlanes) - 1;
+    if ((chip8->planeMask & allPlanes) == allPlanes)
+        memset(chip8->display, 0, chip8->displaySize);
+    else
+        for (uint8_t p=0; p<chip8->displayPlanes; p++)
+            if (chip8->planeMask & (1 << p))
+                memset(&chip8->display[p * chip8->planeWords], 0, chip8->planeWords * sizeof(uint64_t));
+
+    chip8->displayDirty = true;
+}
+
+// Vertical scrolls move whole rows, one memmove per plane
+static void scroll_rows(chip8_t *chip8, uint8_t rows, bool down)
+{
+    if (rows > chip8->displayY)
+        rows = chip8->displayY;
+    const size_t moved = (size_t)(chip8->displayY - rows) * chip8->displayWords * sizeof(uint64_t);
+    const size_t cleared = (size_t)rows * chip8->displayWords * sizeof(uint64_t);
+
+    for (uint8_t p=0; p<chip8->displayPlanes; p++)
+    {
+        if (!(chip8->planeMask & (1 << p)))
+            continue;
+
+        uint8_t *plane = (uint8_t*)&chip8->display[p * chip8->planeWords];
+        if (down)
+        {
+            memmove(plane + cleared, plane, moved);
+            memset(plane, 0, cleared);
+        }
+        else
+        {
+            memmove(plane, plane + cleared, moved);
+            memset(plane + moved, 0, cleared);
+        }
+    }
+    chip8->displayDirty = true;
+}
+
+void scroll_down(chip8_t *chip8, uint8_t rows)
+{
+    scroll_rows(chip8, rows, true);
+}
+
+void scroll_up(chip8_t *chip8, uint8_t rows)
+{
+    scroll_rows(chip8, rows, false);
+}
+
+// Horizontal scrolls by 4 pixels shift every row, carrying the bits between
+// the words of a row
+static inline void scroll_plane_right(uint64_t *plane, const unsigned words, uint16_t height)
+{
+    for (uint16_t y=0; y<height; y++, plane += words)
+    {
+        for (unsigned w=words-1; w>0; w--)
+            plane[w] = (plane[w] >> 4) | (plane[w - 1] << 60);
+        plane[0] >>= 4;
+    }
+}
+
+static inline void scroll_plane_left(uint64_t *plane, const unsigned words, uint16_t height)
+{
+    for (uint16_t y=0; y<height; y++, plane += words)
+    {
+        for (unsigned w=0; w<words-1; w++)
+            plane[w] = (plane[w] << 4) | (plane[w + 1] >> 60);
+        plane[words - 1] <<= 4;
+    }
+}
+
+void scroll_right(chip8_t *chip8)
+{
+    for (uint8_t p=0; p<chip8->displayPlanes; p++)
+    {
+        if (!(chip8->planeMask & (1 << p)))
+            continue;
+
+        uint64_t *plane = &chip8->display[p * chip8->planeWords];
+        if (chip8->displayWords == 1)
+            scroll_plane_right(plane, 1, chip8->displayY);
+        else if (chip8->displayWords == 2)
+            scroll_plane_right(plane, 2, chip8->displayY);
+        else
+            scroll_plane_right(plane, chip8->displayWords, chip8->displayY);
+    }
+    chip8->displayDirty = true;
+}
+
+void scroll_left(chip8_t *chip8)
+{
+    for (uint8_t p=0; p<chip8->displayPlanes; p++)
+    {
+        if (!(chip8->planeMask & (1 << p)))
+            continue;
+
+        uint64_t *plane = &chip8->display[p * chip8->planeWords];
+        if (chip8->displayWords == 1)
+            scroll_plane_left(plane, 1, chip8->displayY);
+        else if (chip8->displayWords == 2)
+            scroll_plane_left(plane, 2, chip8->displayY);
+        else
+            scroll_plane_left(plane, chip8->displayWords, chip8->displayY);
+    }
+    chip8->displayDirty = true;
+}
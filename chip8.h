@@ -1,6 +1,7 @@
 #ifndef CHIP8_H_IRISH
 #define CHIP8_H_IRISH
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -41,6 +42,48 @@ typedef enum {
     PAUSED          // chip-8 is paused and doing nothing
 } emulator_state_t;
 
+// Instruction sets, selected with --mode
+typedef enum {
+    MODE_CHIP8 = 0,     // COSMAC VIP CHIP-8, 64x32
+    MODE_SCHIP,         // SUPER-CHIP 1.1, adds 128x64 hires, scrolling, the big font and flag registers
+    MODE_XOCHIP,        // XO-CHIP, SUPER-CHIP plus 2 display planes, 64 KiB of RAM and 16-bit I loads
+    MODE_COUNT
+} machine_mode_t;
+
+// Compatibility quirk profiles, selected with --quirks. Every profile has its
+// own interpreter core in cpu.c with the quirks compiled in.
+typedef enum {
+    QUIRKS_MODERN = 0,  // what most ROMs written today expect, sprites wrap
+    QUIRKS_VIP,         // the original COSMAC VIP interpreter
+    QUIRKS_CHIP48,      // CHIP-48 on the HP-48
+    QUIRKS_SCHIP,       // SUPER-CHIP 1.1 on the HP-48
+    QUIRKS_COUNT
+} quirk_profile_t;
+
+// Quirks, the behaviors the profiles disagree on
+#define QUIRK_VF_RESET      0x01    // 8xy1, 8xy2 and 8xy3 set VF to 0
+#define QUIRK_SHIFT_VY      0x02    // 8xy6 and 8xyE shift Vy into Vx instead of shifting Vx
+#define QUIRK_MEMORY_X1     0x04    // Fx55 and Fx65 leave I at I + x + 1
+#define QUIRK_MEMORY_X      0x08    // Fx55 and Fx65 leave I at I + x
+#define QUIRK_JUMP_VX       0x10    // Bxnn jumps to xnn + Vx instead of nnn + V0
+#define QUIRK_CLIP          0x20    // sprites are clipped at the display edges instead of wrapping
+
+#define QUIRKS_MODERN_BITS  0
+#define QUIRKS_VIP_BITS     (QUIRK_VF_RESET | QUIRK_SHIFT_VY | QUIRK_MEMORY_X1 | QUIRK_CLIP)
+#define QUIRKS_CHIP48_BITS  (QUIRK_MEMORY_X | QUIRK_JUMP_VX | QUIRK_CLIP)
+#define QUIRKS_SCHIP_BITS   (QUIRK_JUMP_VX | QUIRK_CLIP)
+
+// RAM of the CHIP-8 and SUPER-CHIP, XO-CHIP has 64 KiB
+#define RAM_SIZE 0x1000
+#define RAM_SIZE_XOCHIP 0x10000
+
+// Jumps and calls take 12-bit addresses, so in every mode code runs from the
+// first 4 KiB and only data reaches the rest of XO-CHIP's RAM through I
+#define CODE_SIZE 0x1000
+
+// XO-CHIP has 2 display planes, the others 1
+#define MAX_DISPLAY_PLANES 2
+
 // TODO: verify that bitfields are indeed packed by compiler
 // TODO: correct for any endianness issues between big/little
 typedef union __attribute__((__packed__))
@@ -69,35 +112,145 @@ typedef union __attribute__((__packed__))
     };
 } instruction_t;
 
+// Pre-decoded instruction, the decode cache keeps one per even RAM address so
+// that instructions in loops are only decoded once
+typedef struct
+{
+    uint8_t op;                     // opcode_id_t of the instruction, 0 -> not decoded yet
+    uint8_t x;                      // x operand, 4-bit register index
+    uint8_t y;                      // y operand, 4-bit register index
+    uint8_t n;                      // n operand, 4-bit nibble
+    uint8_t kk;                     // kk operand, 8-bit byte
+    uint16_t nnn;                   // nnn operand, 12-bit address
+    uint16_t opcode;                // whole instruction, for logging and drawing
+} decoded_t;
+
+// Text sprites are copied into RAM here, below the 0x200 program entrypoint
+#define FONT_ADDRESS 0x050
+
+// SUPER-CHIP's 8x10 text sprites follow the 4x5 ones
+#define BIG_FONT_ADDRESS 0x0A0
+
+// Host cache line size, the machine's hot fields and big arrays start on one
+#define CACHE_LINE 64
+
 // CHIP-8 Machine object
+//
+// Laid out by how often the fields are touched: the hot block is read or written
+// by nearly every instruction and fits in the first two cache lines, the display
+// state follows for draws, then RAM and the decode cache, and the cold data only
+// used at startup, on save states or by the front end comes last.
 typedef struct {
+    // Hot, every instruction
+    _Alignas(CACHE_LINE) Registers_t reg;   // Chip-8 Registers
     emulator_state_t state;         // Current state of Chip-8
-    Registers_t reg;                // Chip-8 Registers
-    uint8_t ram[4096];              // 4 KiB of RAM
+    machine_mode_t mode;            // Instruction set
+    quirk_profile_t quirks;         // Compatibility quirks, decides the interpreter core
+    uint32_t ramSize;               // 4 KiB, or 64 KiB for XO-CHIP
+    uint32_t rngState;              // State of the random number generator, never 0
     uint16_t stack[16];             // 16 Byte stack for function calling
-    uint32_t displaySize;           // Size of the memory of the display
-    bool *display;                  // Pointer to display data
+    bool keypad[16];                // Hexadecimal keypad 0x0-0xF
+    struct trace_buffer *trace;     // Instruction trace, NULL -> tracing disabled
+    struct jit *jit;                // Recompiler, NULL -> interpreter only
+    struct profile *profile;        // Execution profile, NULL -> not profiling
+    struct debugger *debug;         // Breakpoints and stepping, NULL -> no debugger
+
+    // Warm, draws, scrolls and clears
+    _Alignas(CACHE_LINE) uint64_t *display; // Display planes one after the other, rows packed 1 bit per pixel, leftmost pixel is the MSB
+    uint32_t displaySize;           // Size of the memory of the display planes at the current resolution in bytes
+    uint32_t displayCapacity;       // Size of the display buffer in bytes, every plane at the highest resolution
+    uint32_t planeWords;            // number of 64-bit words per display plane at the current resolution
+    uint16_t displayWords;          // number of 64-bit words per display row
+    uint8_t displayPlanes;          // number of display planes, 1 or 2 for XO-CHIP
+    uint8_t planeMask;              // planes drawn, cleared and scrolled, XO-CHIP selects them with Fn01
+    bool displayDirty;              // display changed since the front end last rendered it
+    bool hires;                     // SUPER-CHIP high resolution, twice the width and height
+    bool displayWrap;               // should the sprites wrap on screen, off with QUIRK_CLIP
     uint16_t displayX;              // number of pixels for x direction of display
     uint16_t displayY;              // number of pixels for y direction of display
-    bool displayWrap;               // should the sprites wrap on screen
-    bool keypad[16];                // Hexadecimal keypad 0x0-0xF
-    uint8_t *textSprites[16][5];    // Pointer to default text sprites
+    uint16_t loresX;                // display width outside of high resolution
+    uint16_t loresY;                // display height outside of high resolution
+    instruction_t instruction;      // Currently executing draw instruction
     uint8_t spriteData[16];         // Temporary storage for sprite data
-    char *romName;                  // Name of ROM currently loaded
-    char *romPath;                  // Path to ROM currently loaded
 
+    // Decode cache and RAM, fetches only read the entry at PC
+    _Alignas(CACHE_LINE) decoded_t decodeCache[CODE_SIZE/2]; // Decoded instruction per even code address
+    _Alignas(CACHE_LINE) uint8_t ram[RAM_SIZE_XOCHIP];      // RAM, only the first ramSize bytes are addressable
+
+    // Cold, startup, save states and the front end
+    uint8_t flags[16];              // SUPER-CHIP/XO-CHIP flag registers, Fx75/Fx85
+    uint8_t audioPattern[16];       // XO-CHIP 1-bit audio pattern, F002
+    uint8_t pitch;                  // XO-CHIP audio pattern playback rate, Fx3A
+    uint8_t textSprites[16][5];     // Default text sprites, 0x0-0xF
     uint16_t entrypoint;            // Entrypoint for chip-8 programs
-    instruction_t instruction;      // Currently executing instruction
+    uint32_t exits;                 // 00FD run, it runs again for the rest of a budget once the ROM exited
+    char *romName;                  // Name of ROM currently loaded
+    char *romPath;                  // Path to ROM currently loaded
 } chip8_t;
 
+// Bytes of the hot block, the display state starts on the next cache line
+#define CHIP8_HOT_BYTES (offsetof(chip8_t, debug) + sizeof(struct debugger *))
+_Static_assert(CHIP8_HOT_BYTES <= 2 * CACHE_LINE, "hot block of chip8_t must fit in two cache lines");
+
+// Compatibility accessor for code that wants the display a pixel at a time,
+// returns the bits of every plane, plane 0 in bit 0
+static inline uint8_t get_pixel(const chip8_t *chip8, uint16_t x, uint16_t y)
+{
+    uint8_t color = 0;
+    for (uint8_t plane=0; plane<chip8->displayPlanes; plane++)
+    {
+        uint64_t word = chip8->display[(plane * chip8->planeWords) + (y * chip8->displayWords) + (x / 64)];
+        color |= ((word >> (63 - (x % 64))) & 0x01) << plane;
+    }
+    return color;
+}
+
+// Set a zeroed machine up for an instruction set and quirk profile, width and
+// height are the low resolution display. Allocates the display and copies the
+// big font into RAM.
+//
+// Returns
+//      0           -> success
+//      *           -> anything else on failure
+int setup_machine(chip8_t *chip8, machine_mode_t mode, quirk_profile_t quirks, uint16_t width, uint16_t height);
+const char *mode_name(machine_mode_t mode);
+const char *quirks_name(quirk_profile_t quirks);
+uint32_t quirk_bits(quirk_profile_t quirks);
+
+// Switch between low and high resolution, clears the display
+void set_resolution(chip8_t *chip8, bool hires);
+
+// Put a set up machine into its power on state: registers, timers, stack and
+// keypad zeroed, PC at the entrypoint, low resolution and a clear display. RAM,
+// the flag registers and the random number generator are left as they are.
+void restart_machine(chip8_t *chip8);
+
+// Copy a program into RAM at the entrypoint and zero the rest of RAM after it,
+// nothing decoded before is kept
+//
+// Returns
+//      0           -> success
+//      *           -> anything else when the program doesn't fit in RAM
+int copy_program(chip8_t *chip8, const uint8_t *program, size_t size);
+
 // Chip-8 Utility functions
 int load_rom(char *romPath, void *dest, int sz_inp, int num_elements);
-int emulate_instruction(chip8_t *chip8);
 void bad_instruction(uint16_t address, uint16_t opcode);
-int validate_PC(chip8_t chip8);
-int validate_sprite(chip8_t chip8);
+int validate_PC(const chip8_t *chip8);
+uint64_t hash_bytes(const void *data, size_t size);
+uint64_t hash_display(const chip8_t *chip8);
+uint64_t hash_ram(const chip8_t *chip8);
+void tick_timers(chip8_t *chip8);
+void invalidate_decoded(chip8_t *chip8, uint16_t address, uint16_t length);
 
 // Chip-8 Instruction functions, too big for switch statement
 int draw_instruction(chip8_t *chip8);
 
+// Display kernels, they work on the planes selected by planeMask
+void clear_display(chip8_t *chip8);
+void scroll_down(chip8_t *chip8, uint8_t rows);
+void scroll_up(chip8_t *chip8, uint8_t rows);
+void scroll_right(chip8_t *chip8);
+void scroll_left(chip8_t *chip8);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,771 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "chip8.h"
+#include "trace.h"
+#include "profile.h"
+#include "jit.h"
+#include "debug.h"
+#include "helpers/logging.h"
+#include "helpers/timing.h"
+
+// Chip-8 Instruction Reference
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+// Instruction word size:   2-bytes
+// Instructions stored as:  Big-Endian format
+// Instructions first bytes stored at EVEN address
+//      -> if program includes sprite data it should be padded
+//         so that any instructions following it will be
+//         properly aligned in RAM
+//
+// Variables used in instruction comments:
+//      - nnn || addr   -> a 12-bit value, lowest 12 bits of the instruction
+//      - n || nibble   -> a 4-bit value, lowest 4 bits of the instruction
+//      - x             -> a 4-bit value, lower 4 bits of the high byte of the instruction
+//      - y             -> a 4-bit value, upper 4 bits of the low byte of the instruction
+//      - kk || byte    -> 8-bit value, the lowest 8 bits of the instruction
+
+// Record every instruction into the trace ring buffer while tracing is enabled,
+// see trace.h. Compiled out with -DCHIP8_TRACE=0.
+#if CHIP8_TRACE
+#   define Trace_Fetch(chip8, opcode) if (chip8->trace != NULL) trace_instruction(chip8->trace, chip8, opcode);
+#else
+#   define Trace_Fetch(chip8, opcode)
+#endif
+
+// Shorthands for the operands of the currently executing instruction
+#define ARG_X   (ins->x)
+#define ARG_Y   (ins->y)
+#define ARG_N   (ins->n)
+#define ARG_KK  (ins->kk)
+#define ARG_NNN (ins->nnn)
+#define VX  (chip8->reg.Vx[ins->x])
+#define VY  (chip8->reg.Vx[ins->y])
+
+// 64K opcode -> opcode_id_t lookup table per machine_mode_t, shared by every
+// machine and read only once built. 1 byte per entry keeps them at 64 KiB each
+// instead of 512 KiB of pointers, and the instruction set costs nothing per
+// instruction, it only decides which table a decode cache miss reads.
+static uint8_t opcodeTable[MODE_COUNT][0x10000];
+static bool opcodeTableBuilt = false;
+
+// Decode an opcode the slow way, only used to build opcodeTable
+opcode_id_t decode_opcode(uint16_t opcode, machine_mode_t mode)
+{
+    const uint8_t kk = opcode & 0xFF;
+    const uint8_t n = opcode & 0x0F;
+    const bool schip = mode == MODE_SCHIP || mode == MODE_XOCHIP;
+    const bool xochip = mode == MODE_XOCHIP;
+
+    // Switch off of upper nibble of instruction
+    switch ((opcode >> 12) & 0x0F)
+    {
+        case 0x0:
+            // 0x0nnn -> SYS addr - not implemented on newer machines
+            if (opcode == 0x00E0) return OP_CLS;
+            if (opcode == 0x00EE) return OP_RET;
+            if (schip && (opcode & 0xFFF0) == 0x00C0) return OP_SCD;
+            if (xochip && (opcode & 0xFFF0) == 0x00D0) return OP_SCU;
+            if (schip && opcode == 0x00FB) return OP_SCR;
+            if (schip && opcode == 0x00FC) return OP_SCL;
+            if (schip && opcode == 0x00FD) return OP_EXIT;
+            if (schip && opcode == 0x00FE) return OP_LOW;
+            if (schip && opcode == 0x00FF) return OP_HIGH;
+            return OP_INVALID;
+        case 0x1: return OP_JP;
+        case 0x2: return OP_CALL;
+        case 0x3: return OP_SE_VX_KK;
+        case 0x4: return OP_SNE_VX_KK;
+        case 0x5:
+            if (n == 0x0) return OP_SE_VX_VY;
+            if (xochip && n == 0x2) return OP_SAVE_VX_VY;
+            if (xochip && n == 0x3) return OP_LOAD_VX_VY;
+            return OP_INVALID;
+        case 0x6: return OP_LD_VX_KK;
+        case 0x7: return OP_ADD_VX_KK;
+        case 0x8:
+            switch (n)
+            {
+                case 0x0: return OP_LD_VX_VY;
+                case 0x1: return OP_OR;
+                case 0x2: return OP_AND;
+                case 0x3: return OP_XOR;
+                case 0x4: return OP_ADD_VX_VY;
+                case 0x5: return OP_SUB;
+                case 0x6: return OP_SHR;
+                case 0x7: return OP_SUBN;
+                case 0xE: return OP_SHL;
+                default:  return OP_INVALID;
+            }
+        case 0x9: return (n == 0x0) ? OP_SNE_VX_VY : OP_INVALID;
+        case 0xA: return OP_LD_I;
+        case 0xB: return OP_JP_V0;
+        case 0xC: return OP_RND;
+        case 0xD: return OP_DRW;
+        case 0xE:
+            if (kk == 0x9E) return OP_SKP;
+            if (kk == 0xA1) return OP_SKNP;
+            return OP_INVALID;
+        case 0xF:
+            switch (kk)
+            {
+                case 0x07: return OP_LD_VX_DT;
+                case 0x0A: return OP_LD_VX_K;
+                case 0x15: return OP_LD_DT_VX;
+                case 0x18: return OP_LD_ST_VX;
+                case 0x1E: return OP_ADD_I_VX;
+                case 0x29: return OP_LD_F_VX;
+                case 0x33: return OP_LD_B_VX;
+                case 0x55: return OP_LD_I_VX;
+                case 0x65: return OP_LD_VX_I;
+                case 0x30: return schip ? OP_LD_HF_VX : OP_INVALID;
+                case 0x75: return schip ? OP_LD_R_VX : OP_INVALID;
+                case 0x85: return schip ? OP_LD_VX_R : OP_INVALID;
+                case 0x3A: return xochip ? OP_PITCH : OP_INVALID;
+                case 0x00: return xochip && opcode == 0xF000 ? OP_LD_I_LONG : OP_INVALID;
+                case 0x01: return xochip ? OP_PLANE : OP_INVALID;
+                case 0x02: return xochip && opcode == 0xF002 ? OP_AUDIO : OP_INVALID;
+                default:   return OP_INVALID;
+            }
+    }
+    return OP_INVALID;
+}
+
+void init_dispatch(void)
+{
+    if (opcodeTableBuilt)
+        return;
+
+    for (int mode=0; mode<MODE_COUNT; mode++)
+        for (uint32_t opcode=0; opcode<=0xFFFF; opcode++)
+            opcodeTable[mode][opcode] = (uint8_t)decode_opcode((uint16_t)opcode, (machine_mode_t)mode);
+    opcodeTableBuilt = true;
+}
+
+// Split an opcode into its operands, the slow path of the decode cache
+static inline void decode_instruction(const chip8_t *chip8, uint16_t opcode, decoded_t *ins)
+{
+    ins->opcode = opcode;
+    ins->x = (opcode >> 8) & 0x0F;
+    ins->y = (opcode >> 4) & 0x0F;
+    ins->n = opcode & 0x0F;
+    ins->kk = opcode & 0xFF;
+    ins->nnn = opcode & 0x0FFF;
+    ins->op = opcodeTable[chip8->mode][opcode];
+}
+
+// Make sure PC is set to valid address for instruction execution, the inline
+// test keeps the validate_PC() call off of the hot path
+//
+// Returns
+//      0           -> success
+//      *           -> anything else when PC is invalid
+static inline int check_PC(chip8_t *chip8)
+{
+    if ((chip8->reg.PC >= CODE_SIZE - 1 || chip8->reg.PC % 2 == 1) && validate_PC(chip8) != 0)
+        return Log_Err("Fatal error, shutting down...");
+    return 0;
+}
+
+// Read the opcode at PC from RAM and advance PC
+static inline uint16_t fetch_opcode(chip8_t *chip8)
+{
+    // FIXME: Make below work on big/little endian machines
+    // Load instruction from little endian host machine RAM into big endian Chip-8 RAM
+    uint16_t opcode = chip8->ram[chip8->reg.PC] << 8 | chip8->ram[chip8->reg.PC + 1];
+    Trace_Fetch(chip8, opcode);
+    chip8->reg.PC += 2;
+    return opcode;
+}
+
+// Decode cache miss, kept out of line so every engine handler's inlined copy of
+// fetch_decoded() stays a load and a test
+static __attribute__((noinline)) void decode_miss(chip8_t *chip8, decoded_t *ins)
+{
+    decode_instruction(chip8, chip8->ram[chip8->reg.PC] << 8 | chip8->ram[chip8->reg.PC + 1], ins);
+}
+
+// Look up the instruction at PC in the decode cache, decoding it on a miss, and
+// advance PC. Entries are cleared by invalidate_decoded() whenever RAM is written.
+// Forced inline, with the SUPER-CHIP and XO-CHIP handlers the engines outgrow
+// GCC's inlining budget and it would otherwise become a call per instruction.
+static inline __attribute__((always_inline)) const decoded_t *fetch_decoded(chip8_t *chip8)
+{
+    decoded_t *ins = &chip8->decodeCache[chip8->reg.PC >> 1];
+    if (ins->op == OP_UNDECODED)
+        decode_miss(chip8, ins);
+
+    Trace_Fetch(chip8, ins->opcode);
+    chip8->reg.PC += 2;
+    return ins;
+}
+
+// Skip the next instruction, XO-CHIP's F000 nnnn is 4 bytes long and skipped whole
+static inline void skip_instruction(chip8_t *chip8)
+{
+    if (chip8->mode == MODE_XOCHIP && chip8->ram[chip8->reg.PC] == 0xF0 && chip8->ram[chip8->reg.PC + 1] == 0x00)
+        chip8->reg.PC += 2;
+    chip8->reg.PC += 2;
+}
+
+// xorshift32, each machine has its own generator so runs are reproducible from a seed
+static inline uint8_t next_random(chip8_t *chip8)
+{
+    uint32_t x = chip8->rngState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    chip8->rngState = x;
+    return (uint8_t)(x >> 24);
+}
+
+
+// Instruction handlers
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+// Shared by every dispatch engine, all return 0 on success and anything else on fatal error
+
+static inline int op_invalid(chip8_t *chip8, const decoded_t *ins)
+{
+    bad_instruction(chip8->reg.PC - 2, ins->opcode);
+    return 0;
+}
+
+// 0x00E0 -> CLS - clear screen
+static inline int op_cls(chip8_t *chip8, const decoded_t *ins)
+{
+    (void)ins;
+    clear_display(chip8);
+    return 0;
+}
+
+// 0x00EE -> RET - return from subroutine
+static inline int op_ret(chip8_t *chip8, const decoded_t *ins)
+{
+    (void)ins;
+    if (chip8->reg.SP == 0)
+        return Log_Err("Stack underflow, return with empty stack at: 0x%04X", chip8->reg.PC - 2);
+
+    chip8->reg.PC = chip8->stack[chip8->reg.SP];
+    chip8->reg.SP--;
+    return 0;
+}
+
+// 0x1nnn -> JP addr - jump to location nnn
+static inline int op_jp(chip8_t *chip8, const decoded_t *ins)
+{
+    chip8->reg.PC = ARG_NNN;
+    return 0;
+}
+
+// 0x2nnn -> CALL addr - call subroutine at nnn
+static inline int op_call(chip8_t *chip8, const decoded_t *ins)
+{
+    // stack[0] is never used, SP points at the last pushed address
+    if (chip8->reg.SP >= (sizeof(chip8->stack) / sizeof(chip8->stack[0])) - 1)
+        return Log_Err("Stack overflow, call to 0x%04X at: 0x%04X", ARG_NNN, chip8->reg.PC - 2);
+
+    chip8->reg.SP++;
+    chip8->stack[chip8->reg.SP] = chip8->reg.PC;
+    chip8->reg.PC = ARG_NNN;
+    return 0;
+}
+
+// 0x3xkk -> SE Vx, byte - skip next instruction if Vx == kk
+static inline int op_se_vx_kk(chip8_t *chip8, const decoded_t *ins)
+{
+    if (VX == ARG_KK)
+        skip_instruction(chip8);
+    return 0;
+}
+
+// 0x4xkk -> SNE Vx, byte - skip next instruction if Vx != kk
+static inline int op_sne_vx_kk(chip8_t *chip8, const decoded_t *ins)
+{
+    if (VX != ARG_KK)
+        skip_instruction(chip8);
+    return 0;
+}
+
+// 0x5xy0 -> SE Vx, Vy - skip next instruction if Vx == Vy
+static inline int op_se_vx_vy(chip8_t *chip8, const decoded_t *ins)
+{
+    if (VX == VY)
+        skip_instruction(chip8);
+    return 0;
+}
+
+// 0x6xkk -> LD Vx, byte
+static inline int op_ld_vx_kk(chip8_t *chip8, const decoded_t *ins)
+{
+    VX = ARG_KK;
+    return 0;
+}
+
+// 0x7xkk -> ADD Vx, byte - VF is not affected
+static inline int op_add_vx_kk(chip8_t *chip8, const decoded_t *ins)
+{
+    VX += ARG_KK;
+    return 0;
+}
+
+// 0x8xy0 -> LD Vx, Vy
+static inline int op_ld_vx_vy(chip8_t *chip8, const decoded_t *ins)
+{
+    VX = VY;
+    return 0;
+}
+
+// 0x8xy1-3 -> OR/AND/XOR, 0x8xy6/E -> SHR/SHL, 0xBnnn -> JP V0 and 0xFx55/65 -> LD [I]/LD Vx
+// depend on the quirk profile, see cpu_core.h
+
+// The flag producing 0x8xy_ instructions write VF after the result, so that
+// when x is F the flag wins over the result
+
+// 0x8xy4 -> ADD Vx, Vy - VF = carry
+static inline int op_add_vx_vy(chip8_t *chip8, const decoded_t *ins)
+{
+    uint16_t sum = VX + VY;
+    VX = (uint8_t)sum;
+    chip8->reg.VF = sum > 0xFF;
+    return 0;
+}
+
+// 0x8xy5 -> SUB Vx, Vy - VF = NOT borrow
+static inline int op_sub(chip8_t *chip8, const decoded_t *ins)
+{
+    uint8_t notBorrow = VX >= VY;
+    VX -= VY;
+    chip8->reg.VF = notBorrow;
+    return 0;
+}
+
+// 0x8xy7 -> SUBN Vx, Vy - Vx = Vy - Vx, VF = NOT borrow
+static inline int op_subn(chip8_t *chip8, const decoded_t *ins)
+{
+    uint8_t notBorrow = VY >= VX;
+    VX = VY - VX;
+    chip8->reg.VF = notBorrow;
+    return 0;
+}
+
+// 0x9xy0 -> SNE Vx, Vy - skip next instruction if Vx != Vy
+static inline int op_sne_vx_vy(chip8_t *chip8, const decoded_t *ins)
+{
+    if (VX != VY)
+        skip_instruction(chip8);
+    return 0;
+}
+
+// 0xAnnn -> LD I, addr
+static inline int op_ld_i(chip8_t *chip8, const decoded_t *ins)
+{
+    chip8->reg.I = ARG_NNN;
+    return 0;
+}
+
+// 0xCxkk -> RND Vx, byte - Vx = random byte AND kk
+static inline int op_rnd(chip8_t *chip8, const decoded_t *ins)
+{
+    VX = next_random(chip8) & ARG_KK;
+    return 0;
+}
+
+// 0xDxyn -> DRW Vx, Vy, nibble
+static inline int op_drw(chip8_t *chip8, const decoded_t *ins)
+{
+    chip8->instruction.opcode = ins->opcode;
+    if (draw_instruction(chip8) != 0)
+        return Log_Err("Fatal error, shutting down...");
+
+    return 0;
+}
+
+// 0xEx9E -> SKP Vx - skip next instruction if key Vx is pressed
+static inline int op_skp(chip8_t *chip8, const decoded_t *ins)
+{
+    if (chip8->keypad[VX & 0x0F])
+        skip_instruction(chip8);
+    return 0;
+}
+
+// 0xExA1 -> SKNP Vx - skip next instruction if key Vx is not pressed
+static inline int op_sknp(chip8_t *chip8, const decoded_t *ins)
+{
+    if (!chip8->keypad[VX & 0x0F])
+        skip_instruction(chip8);
+    return 0;
+}
+
+// 0xFx07 -> LD Vx, DT
+static inline int op_ld_vx_dt(chip8_t *chip8, const decoded_t *ins)
+{
+    VX = chip8->reg.DT;
+    return 0;
+}
+
+// 0xFx0A -> LD Vx, K - wait for a key press and store it in Vx
+static inline int op_ld_vx_k(chip8_t *chip8, const decoded_t *ins)
+{
+    for (uint8_t key=0; key<16; key++)
+    {
+        if (chip8->keypad[key])
+        {
+            VX = key;
+            return 0;
+        }
+    }
+
+    // No key pressed, execute this instruction again; timers keep running meanwhile
+    chip8->reg.PC -= 2;
+    return 0;
+}
+
+// 0xFx15 -> LD DT, Vx
+static inline int op_ld_dt_vx(chip8_t *chip8, const decoded_t *ins)
+{
+    chip8->reg.DT = VX;
+    return 0;
+}
+
+// 0xFx18 -> LD ST, Vx
+static inline int op_ld_st_vx(chip8_t *chip8, const decoded_t *ins)
+{
+    chip8->reg.ST = VX;
+    return 0;
+}
+
+// 0xFx1E -> ADD I, Vx
+static inline int op_add_i_vx(chip8_t *chip8, const decoded_t *ins)
+{
+    chip8->reg.I += VX;
+    return 0;
+}
+
+// 0xFx29 -> LD F, Vx - I = address of the text sprite for digit Vx
+static inline int op_ld_f_vx(chip8_t *chip8, const decoded_t *ins)
+{
+    chip8->reg.I = FONT_ADDRESS + (VX & 0x0F) * sizeof(chip8->textSprites[0]);
+    return 0;
+}
+
+// 0xFx33 -> LD B, Vx - store BCD of Vx at I, I+1 and I+2
+static inline int op_ld_b_vx(chip8_t *chip8, const decoded_t *ins)
+{
+    if ((size_t)chip8->reg.I + 2 >= chip8->ramSize)
+        return Log_Err("BCD store to 0x%04X is outside of RAM", chip8->reg.I);
+
+    uint8_t value = VX;
+    chip8->ram[chip8->reg.I + 2] = value % 10;
+    value /= 10;
+    chip8->ram[chip8->reg.I + 1] = value % 10;
+    chip8->ram[chip8->reg.I] = value / 10;
+
+    // ins may point at an entry that is cleared here, so it is not used after this
+    invalidate_decoded(chip8, chip8->reg.I, 3);
+    return 0;
+}
+
+// SUPER-CHIP instructions, decoded in the schip and xochip modes only
+
+// 0x00Cn -> SCD nibble - scroll the display down n rows
+static inline int op_scd(chip8_t *chip8, const decoded_t *ins)
+{
+    scroll_down(chip8, ARG_N);
+    return 0;
+}
+
+// 0x00FB -> SCR - scroll the display right 4 pixels
+static inline int op_scr(chip8_t *chip8, const decoded_t *ins)
+{
+    (void)ins;
+    scroll_right(chip8);
+    return 0;
+}
+
+// 0x00FC -> SCL - scroll the display left 4 pixels
+static inline int op_scl(chip8_t *chip8, const decoded_t *ins)
+{
+    (void)ins;
+    scroll_left(chip8);
+    return 0;
+}
+
+// 0x00FD -> EXIT - stop the interpreter, executed again until the front end quits
+static inline int op_exit(chip8_t *chip8, const decoded_t *ins)
+{
+    (void)ins;
+    chip8->state = QUIT;
+    chip8->reg.PC -= 2;
+    chip8->exits++;
+    return 0;
+}
+
+// 0x00FE -> LOW - 64x32 display, clears it
+static inline int op_low(chip8_t *chip8, const decoded_t *ins)
+{
+    (void)ins;
+    set_resolution(chip8, false);
+    return 0;
+}
+
+// 0x00FF -> HIGH - 128x64 display, clears it
+static inline int op_high(chip8_t *chip8, const decoded_t *ins)
+{
+    (void)ins;
+    set_resolution(chip8, true);
+    return 0;
+}
+
+// 0xFx30 -> LD HF, Vx - I = address of the big text sprite for digit Vx
+static inline int op_ld_hf_vx(chip8_t *chip8, const decoded_t *ins)
+{
+    chip8->reg.I = BIG_FONT_ADDRESS + (VX & 0x0F) * 10;
+    return 0;
+}
+
+// 0xFx75 -> LD R, Vx - store V0 through Vx in the flag registers
+static inline int op_ld_r_vx(chip8_t *chip8, const decoded_t *ins)
+{
+    memcpy(chip8->flags, chip8->reg.Vx, ARG_X + 1);
+    return 0;
+}
+
+// 0xFx85 -> LD Vx, R - load V0 through Vx from the flag registers
+static inline int op_ld_vx_r(chip8_t *chip8, const decoded_t *ins)
+{
+    memcpy(chip8->reg.Vx, chip8->flags, ARG_X + 1);
+    return 0;
+}
+
+// XO-CHIP instructions, decoded in the xochip mode only
+
+// 0x00Dn -> SCU nibble - scroll the display up n rows
+static inline int op_scu(chip8_t *chip8, const decoded_t *ins)
+{
+    scroll_up(chip8, ARG_N);
+    return 0;
+}
+
+// 0x5xy2 -> LD [I], Vx-Vy - store Vx through Vy at I, in either direction, I is left unchanged
+static inline int op_save_vx_vy(chip8_t *chip8, const decoded_t *ins)
+{
+    const uint8_t count = (ARG_X > ARG_Y ? ARG_X - ARG_Y : ARG_Y - ARG_X) + 1;
+    if ((size_t)chip8->reg.I + count > chip8->ramSize)
+        return Log_Err("Register store to 0x%04X is outside of RAM", chip8->reg.I);
+
+    const int step = ARG_X > ARG_Y ? -1 : 1;
+    for (uint8_t i=0; i<count; i++)
+        chip8->ram[chip8->reg.I + i] = chip8->reg.Vx[ARG_X + step * i];
+
+    // ins may point at an entry that is cleared here, so it is not used after this
+    invalidate_decoded(chip8, chip8->reg.I, count);
+    return 0;
+}
+
+// 0x5xy3 -> LD Vx-Vy, [I] - load Vx through Vy from I, in either direction, I is left unchanged
+static inline int op_load_vx_vy(chip8_t *chip8, const decoded_t *ins)
+{
+    const uint8_t count = (ARG_X > ARG_Y ? ARG_X - ARG_Y : ARG_Y - ARG_X) + 1;
+    if ((size_t)chip8->reg.I + count > chip8->ramSize)
+        return Log_Err("Register load from 0x%04X is outside of RAM", chip8->reg.I);
+
+    const int step = ARG_X > ARG_Y ? -1 : 1;
+    for (uint8_t i=0; i<count; i++)
+        chip8->reg.Vx[ARG_X + step * i] = chip8->ram[chip8->reg.I + i];
+    return 0;
+}
+
+// 0xF000 nnnn -> LD I, long addr - I = the 16-bit address in the next 2 bytes
+static inline int op_ld_i_long(chip8_t *chip8, const decoded_t *ins)
+{
+    (void)ins;
+    chip8->reg.I = chip8->ram[chip8->reg.PC] << 8 | chip8->ram[chip8->reg.PC + 1];
+    chip8->reg.PC += 2;
+    return 0;
+}
+
+// 0xFn01 -> PLANE n - select the display planes drawn, cleared and scrolled
+static inline int op_plane(chip8_t *chip8, const decoded_t *ins)
+{
+    chip8->planeMask = ARG_X & 0x03;
+    return 0;
+}
+
+// 0xF002 -> AUDIO - load the 16 byte audio pattern from I
+static inline int op_audio(chip8_t *chip8, const decoded_t *ins)
+{
+    (void)ins;
+    if ((size_t)chip8->reg.I + sizeof(chip8->audioPattern) > chip8->ramSize)
+        return Log_Err("Audio pattern load from 0x%04X is outside of RAM", chip8->reg.I);
+
+    memcpy(chip8->audioPattern, &chip8->ram[chip8->reg.I], sizeof(chip8->audioPattern));
+    return 0;
+}
+
+// 0xFx3A -> PITCH Vx - audio pattern playback rate
+static inline int op_pitch(chip8_t *chip8, const decoded_t *ins)
+{
+    chip8->pitch = VX;
+    return 0;
+}
+
+
+// SUPER-CHIP and XO-CHIP instructions, they depend on the instruction set so
+// they are looked up in the decode table of the machine's mode
+static int execute_extended(chip8_t *chip8, const decoded_t *ins)
+{
+    switch (opcodeTable[chip8->mode][ins->opcode])
+    {
+        case OP_SCD:        return op_scd(chip8, ins);
+        case OP_SCR:        return op_scr(chip8, ins);
+        case OP_SCL:        return op_scl(chip8, ins);
+        case OP_EXIT:       return op_exit(chip8, ins);
+        case OP_LOW:        return op_low(chip8, ins);
+        case OP_HIGH:       return op_high(chip8, ins);
+        case OP_LD_HF_VX:   return op_ld_hf_vx(chip8, ins);
+        case OP_LD_R_VX:    return op_ld_r_vx(chip8, ins);
+        case OP_LD_VX_R:    return op_ld_vx_r(chip8, ins);
+        case OP_SCU:        return op_scu(chip8, ins);
+        case OP_SAVE_VX_VY: return op_save_vx_vy(chip8, ins);
+        case OP_LOAD_VX_VY: return op_load_vx_vy(chip8, ins);
+        case OP_LD_I_LONG:  return op_ld_i_long(chip8, ins);
+        case OP_PLANE:      return op_plane(chip8, ins);
+        case OP_AUDIO:      return op_audio(chip8, ins);
+        case OP_PITCH:      return op_pitch(chip8, ins);
+        default:            return op_invalid(chip8, ins);
+    }
+}
+
+
+// Interpreter cores
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+// Every quirk profile gets its own copy of the quirk handlers and the dispatch
+// engines, instantiated from cpu_core.h with the profile's quirks as constants.
+// The core is picked once per run_cycles() call, never per instruction.
+
+typedef int (*opcode_handler_t)(chip8_t *chip8, const decoded_t *ins);
+
+typedef struct
+{
+    const opcode_handler_t *handlers;       // table engine's handler per opcode_id_t
+    int (*run_switch)(chip8_t *chip8, uint32_t cycles);
+    int (*run_table)(chip8_t *chip8, uint32_t cycles);
+    int (*run_goto)(chip8_t *chip8, uint32_t cycles);
+    int (*run_profiled)(chip8_t *chip8, uint32_t cycles);
+    int (*run_debug)(chip8_t *chip8, uint32_t cycles);
+} core_t;
+
+#define CORE_QUIRKS QUIRKS_MODERN_BITS
+#define CORE(name) name##_modern
+#include "cpu_core.h"
+#undef CORE
+#undef CORE_QUIRKS
+
+#define CORE_QUIRKS QUIRKS_VIP_BITS
+#define CORE(name) name##_vip
+#include "cpu_core.h"
+#undef CORE
+#undef CORE_QUIRKS
+
+#define CORE_QUIRKS QUIRKS_CHIP48_BITS
+#define CORE(name) name##_chip48
+#include "cpu_core.h"
+#undef CORE
+#undef CORE_QUIRKS
+
+#define CORE_QUIRKS QUIRKS_SCHIP_BITS
+#define CORE(name) name##_schip
+#include "cpu_core.h"
+#undef CORE
+#undef CORE_QUIRKS
+
+static const core_t *const cores[QUIRKS_COUNT] = {
+    [QUIRKS_MODERN] = &core_modern,
+    [QUIRKS_VIP]    = &core_vip,
+    [QUIRKS_CHIP48] = &core_chip48,
+    [QUIRKS_SCHIP]  = &core_schip,
+};
+
+
+// Build selected engine
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+
+int run_cycles_switch(chip8_t *chip8, uint32_t cycles)
+{
+    return cores[chip8->quirks]->run_switch(chip8, cycles);
+}
+
+int run_cycles_table(chip8_t *chip8, uint32_t cycles)
+{
+    return cores[chip8->quirks]->run_table(chip8, cycles);
+}
+
+#if defined(__GNUC__)
+int run_cycles_goto(chip8_t *chip8, uint32_t cycles)
+{
+    return cores[chip8->quirks]->run_goto(chip8, cycles);
+}
+#endif
+
+int run_cycles_profiled(chip8_t *chip8, uint32_t cycles)
+{
+#if CHIP8_PROFILE
+    return cores[chip8->quirks]->run_profiled(chip8, cycles);
+#else
+    return run_cycles_interpreter(chip8, cycles);
+#endif
+}
+
+int run_cycles_debug(chip8_t *chip8, uint32_t cycles)
+{
+    return cores[chip8->quirks]->run_debug(chip8, cycles);
+}
+
+int run_cycles_interpreter(chip8_t *chip8, uint32_t cycles)
+{
+#if CHIP8_DISPATCH == DISPATCH_GOTO
+    return run_cycles_goto(chip8, cycles);
+#elif CHIP8_DISPATCH == DISPATCH_TABLE
+    return run_cycles_table(chip8, cycles);
+#else
+    return run_cycles_switch(chip8, cycles);
+#endif
+}
+
+int execute_instruction(chip8_t *chip8, uint16_t opcode)
+{
+    decoded_t ins;
+    decode_instruction(chip8, opcode, &ins);
+    return cores[chip8->quirks]->handlers[ins.op](chip8, &ins);
+}
+
+int run_cycles(chip8_t *chip8, uint32_t cycles)
+{
+    if (chip8->debug != NULL && chip8->debug->active)
+    {
+        const int status = run_cycles_debug(chip8, cycles);
+#if CHIP8_JIT
+        // The recompiler's machine didn't see what the debug engine ran
+        if (chip8->jit != NULL)
+            jit_resync(chip8->jit, chip8);
+#endif
+        return status;
+    }
+#if CHIP8_PROFILE
+    if (chip8->profile != NULL)
+        return run_cycles_profiled(chip8, cycles);
+#endif
+#if CHIP8_JIT
+    if (chip8->jit != NULL)
+        return run_cycles_jit(chip8, cycles);
+#endif
+    return run_cycles_interpreter(chip8, cycles);
+}
+
+int emulate_instruction(chip8_t *chip8)
+{
+    return run_cycles(chip8, 1);
+}
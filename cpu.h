@@ -0,0 +1,125 @@
+#ifndef CPU_H_IRISH
+#define CPU_H_IRISH
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+// Opcode dispatch engines, selected at build time with -DCHIP8_DISPATCH=...
+//      DISPATCH_SWITCH -> nested switch on the opcode nibbles, decodes every instruction
+//      DISPATCH_TABLE  -> decode cache + handler table, one indirect call per instruction
+//      DISPATCH_GOTO   -> decode cache + computed-goto threading, GCC/Clang only
+#define DISPATCH_SWITCH 0
+#define DISPATCH_TABLE  1
+#define DISPATCH_GOTO   2
+
+#ifndef CHIP8_DISPATCH
+#   if defined(__GNUC__)
+#       define CHIP8_DISPATCH DISPATCH_GOTO
+#   else
+#       define CHIP8_DISPATCH DISPATCH_TABLE
+#   endif
+#endif
+
+#if CHIP8_DISPATCH == DISPATCH_GOTO && !defined(__GNUC__)
+#   error "DISPATCH_GOTO needs the GCC/Clang labels as values extension"
+#endif
+
+// Every instruction the interpreter knows, used as index into the dispatch tables
+typedef enum {
+    OP_UNDECODED = 0,   // decode cache entry that has not been decoded yet
+    OP_INVALID,         // unknown/unimplemented instruction
+    OP_CLS,             // 0x00E0
+    OP_RET,             // 0x00EE
+    OP_JP,              // 0x1nnn
+    OP_CALL,            // 0x2nnn
+    OP_SE_VX_KK,        // 0x3xkk
+    OP_SNE_VX_KK,       // 0x4xkk
+    OP_SE_VX_VY,        // 0x5xy0
+    OP_LD_VX_KK,        // 0x6xkk
+    OP_ADD_VX_KK,       // 0x7xkk
+    OP_LD_VX_VY,        // 0x8xy0
+    OP_OR,              // 0x8xy1
+    OP_AND,             // 0x8xy2
+    OP_XOR,             // 0x8xy3
+    OP_ADD_VX_VY,       // 0x8xy4
+    OP_SUB,             // 0x8xy5
+    OP_SHR,             // 0x8xy6
+    OP_SUBN,            // 0x8xy7
+    OP_SHL,             // 0x8xyE
+    OP_SNE_VX_VY,       // 0x9xy0
+    OP_LD_I,            // 0xAnnn
+    OP_JP_V0,           // 0xBnnn
+    OP_RND,             // 0xCxkk
+    OP_DRW,             // 0xDxyn
+    OP_SKP,             // 0xEx9E
+    OP_SKNP,            // 0xExA1
+    OP_LD_VX_DT,        // 0xFx07
+    OP_LD_VX_K,         // 0xFx0A
+    OP_LD_DT_VX,        // 0xFx15
+    OP_LD_ST_VX,        // 0xFx18
+    OP_ADD_I_VX,        // 0xFx1E
+    OP_LD_F_VX,         // 0xFx29
+    OP_LD_B_VX,         // 0xFx33
+    OP_LD_I_VX,         // 0xFx55
+    OP_LD_VX_I,         // 0xFx65
+
+    // SUPER-CHIP
+    OP_SCD,             // 0x00Cn
+    OP_SCR,             // 0x00FB
+    OP_SCL,             // 0x00FC
+    OP_EXIT,            // 0x00FD
+    OP_LOW,             // 0x00FE
+    OP_HIGH,            // 0x00FF
+    OP_LD_HF_VX,        // 0xFx30
+    OP_LD_R_VX,         // 0xFx75
+    OP_LD_VX_R,         // 0xFx85
+
+    // XO-CHIP
+    OP_SCU,             // 0x00Dn
+    OP_SAVE_VX_VY,      // 0x5xy2
+    OP_LOAD_VX_VY,      // 0x5xy3
+    OP_LD_I_LONG,       // 0xF000 nnnn
+    OP_PLANE,           // 0xFn01
+    OP_AUDIO,           // 0xF002
+    OP_PITCH,           // 0xFx3A
+    OP_COUNT
+} opcode_id_t;
+
+// Build the shared 64K opcode lookup tables, one per machine_mode_t, safe to
+// call more than once
+void init_dispatch(void);
+opcode_id_t decode_opcode(uint16_t opcode, machine_mode_t mode);
+
+// Run the given number of instructions with a specific engine, on the core
+// specialized for the machine's quirk profile
+//
+// Returns
+//      0           -> success
+//      *           -> anything else on fatal emulation error
+int run_cycles_switch(chip8_t *chip8, uint32_t cycles);
+int run_cycles_table(chip8_t *chip8, uint32_t cycles);
+#if defined(__GNUC__)
+int run_cycles_goto(chip8_t *chip8, uint32_t cycles);
+#endif
+
+// Run instructions with the engine selected at build time
+int run_cycles_interpreter(chip8_t *chip8, uint32_t cycles);
+
+// Table engine that also counts into chip8->profile, see profile.h
+int run_cycles_profiled(chip8_t *chip8, uint32_t cycles);
+
+// Table engine that stops in the debugger, see debug.h
+int run_cycles_debug(chip8_t *chip8, uint32_t cycles);
+
+// Run one instruction with its handler, PC must already point past it.
+// Used by the JIT for the instructions it doesn't translate.
+int execute_instruction(chip8_t *chip8, uint16_t opcode);
+
+// Run instructions with the debugger while it has something to stop on, with
+// the profiler or the JIT when the machine has one, otherwise with the engine
+// selected at build time
+int run_cycles(chip8_t *chip8, uint32_t cycles);
+int emulate_instruction(chip8_t *chip8);
+
+#endif
@@ -0,0 +1,402 @@
+// Interpreter core template, cpu.c includes it once per quirk profile with
+//      CORE_QUIRKS     -> the profile's QUIRK_* bits, see chip8.h
+//      CORE(name)      -> name suffixed with the profile, e.g. CORE(core) -> core_vip
+//
+// Quirks are only ever tested against CORE_QUIRKS, a compile time constant, so
+// every profile gets its own handlers and engines with its quirks folded in and
+// nothing is branched on per instruction. Included repeatedly so there is no
+// include guard, and it is empty outside of cpu.c.
+
+#if defined(CORE_QUIRKS) && defined(CORE)
+
+// Quirk handlers
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+// The instructions the quirk profiles disagree on, the rest are shared and live in cpu.c
+
+// 0x8xy1 -> OR Vx, Vy - QUIRK_VF_RESET: VF = 0
+static inline int CORE(op_or)(chip8_t *chip8, const decoded_t *ins)
+{
+    VX |= VY;
+    if (CORE_QUIRKS & QUIRK_VF_RESET)
+        chip8->reg.VF = 0;
+    return 0;
+}
+
+// 0x8xy2 -> AND Vx, Vy - QUIRK_VF_RESET: VF = 0
+static inline int CORE(op_and)(chip8_t *chip8, const decoded_t *ins)
+{
+    VX &= VY;
+    if (CORE_QUIRKS & QUIRK_VF_RESET)
+        chip8->reg.VF = 0;
+    return 0;
+}
+
+// 0x8xy3 -> XOR Vx, Vy - QUIRK_VF_RESET: VF = 0
+static inline int CORE(op_xor)(chip8_t *chip8, const decoded_t *ins)
+{
+    VX ^= VY;
+    if (CORE_QUIRKS & QUIRK_VF_RESET)
+        chip8->reg.VF = 0;
+    return 0;
+}
+
+// 0x8xy6 -> SHR Vx {, Vy} - VF = shifted out bit, QUIRK_SHIFT_VY: Vx = Vy >> 1
+static inline int CORE(op_shr)(chip8_t *chip8, const decoded_t *ins)
+{
+    uint8_t value = (CORE_QUIRKS & QUIRK_SHIFT_VY) ? VY : VX;
+    VX = value >> 1;
+    chip8->reg.VF = value & 0x01;
+    return 0;
+}
+
+// 0x8xyE -> SHL Vx {, Vy} - VF = shifted out bit, QUIRK_SHIFT_VY: Vx = Vy << 1
+static inline int CORE(op_shl)(chip8_t *chip8, const decoded_t *ins)
+{
+    uint8_t value = (CORE_QUIRKS & QUIRK_SHIFT_VY) ? VY : VX;
+    VX = value << 1;
+    chip8->reg.VF = (value >> 7) & 0x01;
+    return 0;
+}
+
+// 0xBnnn -> JP V0, addr - jump to location nnn + V0, QUIRK_JUMP_VX: nnn + Vx
+static inline int CORE(op_jp_v0)(chip8_t *chip8, const decoded_t *ins)
+{
+    chip8->reg.PC = ARG_NNN + ((CORE_QUIRKS & QUIRK_JUMP_VX) ? VX : chip8->reg.V0);
+    return 0;
+}
+
+// Move I past the registers an 0xFx55/0xFx65 transferred, if the profile does
+static inline void CORE(advance_I)(chip8_t *chip8, uint8_t x)
+{
+    if (CORE_QUIRKS & QUIRK_MEMORY_X1)
+        chip8->reg.I += x + 1;
+    else if (CORE_QUIRKS & QUIRK_MEMORY_X)
+        chip8->reg.I += x;
+}
+
+// 0xFx55 -> LD [I], Vx - store V0 through Vx at I
+static inline int CORE(op_ld_i_vx)(chip8_t *chip8, const decoded_t *ins)
+{
+    if ((size_t)chip8->reg.I + ARG_X >= chip8->ramSize)
+        return Log_Err("Register store to 0x%04X is outside of RAM", chip8->reg.I);
+
+    const uint8_t x = ARG_X;
+    memcpy(&chip8->ram[chip8->reg.I], chip8->reg.Vx, x + 1);
+
+    // ins may point at an entry that is cleared here, so it is not used after this
+    invalidate_decoded(chip8, chip8->reg.I, x + 1);
+    CORE(advance_I)(chip8, x);
+    return 0;
+}
+
+// 0xFx65 -> LD Vx, [I] - load V0 through Vx from I
+static inline int CORE(op_ld_vx_i)(chip8_t *chip8, const decoded_t *ins)
+{
+    if ((size_t)chip8->reg.I + ARG_X >= chip8->ramSize)
+        return Log_Err("Register load from 0x%04X is outside of RAM", chip8->reg.I);
+
+    memcpy(chip8->reg.Vx, &chip8->ram[chip8->reg.I], ARG_X + 1);
+    CORE(advance_I)(chip8, ARG_X);
+    return 0;
+}
+
+
+// Switch engine
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+// Decodes every instruction with nested switches, needs no tables and works with any compiler
+
+static inline int CORE(execute_switch)(chip8_t *chip8, const decoded_t *ins)
+{
+    // Switch off of upper nibble of instruction
+    switch ((ins->opcode >> 12) & 0x0F)
+    {
+        case 0x0:
+            if (ins->opcode == 0x00E0) return op_cls(chip8, ins);
+            if (ins->opcode == 0x00EE) return op_ret(chip8, ins);
+            return execute_extended(chip8, ins);
+        case 0x1: return op_jp(chip8, ins);
+        case 0x2: return op_call(chip8, ins);
+        case 0x3: return op_se_vx_kk(chip8, ins);
+        case 0x4: return op_sne_vx_kk(chip8, ins);
+        case 0x5: return (ARG_N == 0x0) ? op_se_vx_vy(chip8, ins) : execute_extended(chip8, ins);
+        case 0x6: return op_ld_vx_kk(chip8, ins);
+        case 0x7: return op_add_vx_kk(chip8, ins);
+        case 0x8:
+            switch (ARG_N)
+            {
+                case 0x0: return op_ld_vx_vy(chip8, ins);
+                case 0x1: return CORE(op_or)(chip8, ins);
+                case 0x2: return CORE(op_and)(chip8, ins);
+                case 0x3: return CORE(op_xor)(chip8, ins);
+                case 0x4: return op_add_vx_vy(chip8, ins);
+                case 0x5: return op_sub(chip8, ins);
+                case 0x6: return CORE(op_shr)(chip8, ins);
+                case 0x7: return op_subn(chip8, ins);
+                case 0xE: return CORE(op_shl)(chip8, ins);
+                default:  return op_invalid(chip8, ins);
+            }
+        case 0x9: return (ARG_N == 0x0) ? op_sne_vx_vy(chip8, ins) : op_invalid(chip8, ins);
+        case 0xA: return op_ld_i(chip8, ins);
+        case 0xB: return CORE(op_jp_v0)(chip8, ins);
+        case 0xC: return op_rnd(chip8, ins);
+        case 0xD: return op_drw(chip8, ins);
+        case 0xE:
+            if (ARG_KK == 0x9E) return op_skp(chip8, ins);
+            if (ARG_KK == 0xA1) return op_sknp(chip8, ins);
+            return op_invalid(chip8, ins);
+        case 0xF:
+            switch (ARG_KK)
+            {
+                case 0x07: return op_ld_vx_dt(chip8, ins);
+                case 0x0A: return op_ld_vx_k(chip8, ins);
+                case 0x15: return op_ld_dt_vx(chip8, ins);
+                case 0x18: return op_ld_st_vx(chip8, ins);
+                case 0x1E: return op_add_i_vx(chip8, ins);
+                case 0x29: return op_ld_f_vx(chip8, ins);
+                case 0x33: return op_ld_b_vx(chip8, ins);
+                case 0x55: return CORE(op_ld_i_vx)(chip8, ins);
+                case 0x65: return CORE(op_ld_vx_i)(chip8, ins);
+                default:   return execute_extended(chip8, ins);
+            }
+    }
+    return op_invalid(chip8, ins);
+}
+
+static int CORE(run_cycles_switch)(chip8_t *chip8, uint32_t cycles)
+{
+    decoded_t ins;
+    for (uint32_t i=0; i<cycles; i++)
+    {
+        if (check_PC(chip8) != 0)
+            return 1;
+
+        // the switch does its own decoding, only the operands are needed
+        uint16_t opcode = fetch_opcode(chip8);
+        ins.opcode = opcode;
+        ins.x = (opcode >> 8) & 0x0F;
+        ins.y = (opcode >> 4) & 0x0F;
+        ins.n = opcode & 0x0F;
+        ins.kk = opcode & 0xFF;
+        ins.nnn = opcode & 0x0FFF;
+
+        if (CORE(execute_switch)(chip8, &ins) != 0)
+            return 1;
+    }
+    return 0;
+}
+
+
+// Table engine
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+// One table lookup and one indirect call per instruction
+
+static const opcode_handler_t CORE(handlerTable)[OP_COUNT] = {
+    [OP_UNDECODED]  = op_invalid,
+    [OP_INVALID]    = op_invalid,
+    [OP_CLS]        = op_cls,
+    [OP_RET]        = op_ret,
+    [OP_JP]         = op_jp,
+    [OP_CALL]       = op_call,
+    [OP_SE_VX_KK]   = op_se_vx_kk,
+    [OP_SNE_VX_KK]  = op_sne_vx_kk,
+    [OP_SE_VX_VY]   = op_se_vx_vy,
+    [OP_LD_VX_KK]   = op_ld_vx_kk,
+    [OP_ADD_VX_KK]  = op_add_vx_kk,
+    [OP_LD_VX_VY]   = op_ld_vx_vy,
+    [OP_OR]         = CORE(op_or),
+    [OP_AND]        = CORE(op_and),
+    [OP_XOR]        = CORE(op_xor),
+    [OP_ADD_VX_VY]  = op_add_vx_vy,
+    [OP_SUB]        = op_sub,
+    [OP_SHR]        = CORE(op_shr),
+    [OP_SUBN]       = op_subn,
+    [OP_SHL]        = CORE(op_shl),
+    [OP_SNE_VX_VY]  = op_sne_vx_vy,
+    [OP_LD_I]       = op_ld_i,
+    [OP_JP_V0]      = CORE(op_jp_v0),
+    [OP_RND]        = op_rnd,
+    [OP_DRW]        = op_drw,
+    [OP_SKP]        = op_skp,
+    [OP_SKNP]       = op_sknp,
+    [OP_LD_VX_DT]   = op_ld_vx_dt,
+    [OP_LD_VX_K]    = op_ld_vx_k,
+    [OP_LD_DT_VX]   = op_ld_dt_vx,
+    [OP_LD_ST_VX]   = op_ld_st_vx,
+    [OP_ADD_I_VX]   = op_add_i_vx,
+    [OP_LD_F_VX]    = op_ld_f_vx,
+    [OP_LD_B_VX]    = op_ld_b_vx,
+    [OP_LD_I_VX]    = CORE(op_ld_i_vx),
+    [OP_LD_VX_I]    = CORE(op_ld_vx_i),
+    [OP_SCD]        = op_scd,
+    [OP_SCR]        = op_scr,
+    [OP_SCL]        = op_scl,
+    [OP_EXIT]       = op_exit,
+    [OP_LOW]        = op_low,
+    [OP_HIGH]       = op_high,
+    [OP_LD_HF_VX]   = op_ld_hf_vx,
+    [OP_LD_R_VX]    = op_ld_r_vx,
+    [OP_LD_VX_R]    = op_ld_vx_r,
+    [OP_SCU]        = op_scu,
+    [OP_SAVE_VX_VY] = op_save_vx_vy,
+    [OP_LOAD_VX_VY] = op_load_vx_vy,
+    [OP_LD_I_LONG]  = op_ld_i_long,
+    [OP_PLANE]      = op_plane,
+    [OP_AUDIO]      = op_audio,
+    [OP_PITCH]      = op_pitch,
+};
+
+static int CORE(run_cycles_table)(chip8_t *chip8, uint32_t cycles)
+{
+    for (uint32_t i=0; i<cycles; i++)
+    {
+        if (check_PC(chip8) != 0)
+            return 1;
+
+        const decoded_t *ins = fetch_decoded(chip8);
+        if (CORE(handlerTable)[ins->op](chip8, ins) != 0)
+            return 1;
+    }
+    return 0;
+}
+
+
+// Computed-goto engine
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+// Every handler ends in its own copy of the dispatch code, so the host branch predictor
+// gets one indirect jump per handler to learn instead of a single shared one, see cpu_goto.h
+
+#if defined(__GNUC__)
+#define GOTO_ENGINE CORE(run_cycles_goto)
+#define GOTO_COUNTED 0
+#include "cpu_goto.h"
+#undef GOTO_COUNTED
+#undef GOTO_ENGINE
+#endif
+
+
+// Profiled engine
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+// The engine CHIP8_DISPATCH picks plus counters, and the host time of one in every
+// PROFILE_SAMPLE_PERIOD instructions on average. The untimed instructions run as
+// one stretch up to the next timed one, so sampling costs nothing per instruction.
+
+#if CHIP8_PROFILE
+#if defined(__GNUC__) && CHIP8_DISPATCH == DISPATCH_GOTO
+#define GOTO_ENGINE CORE(run_cycles_counted)
+#define GOTO_COUNTED 1
+#include "cpu_goto.h"
+#undef GOTO_COUNTED
+#undef GOTO_ENGINE
+#else
+// The table engine plus counters, also stands in for the switch engine, which
+// doesn't know the opcode_id_t of what it runs
+static int CORE(run_cycles_counted)(chip8_t *chip8, uint32_t cycles)
+{
+    profile_t *profile = chip8->profile;
+    for (uint32_t i=0; i<cycles; i++)
+    {
+        if (check_PC(chip8) != 0)
+            return 1;
+
+        profile->addresses[chip8->reg.PC]++;
+        const decoded_t *ins = fetch_decoded(chip8);
+        profile->opcodes[ins->op]++;
+        if (ins->op == OP_DRW)
+            profile->drawRows += (ins->n == 0 && chip8->mode != MODE_CHIP8) ? 16 : ins->n;
+        if (CORE(handlerTable)[ins->op](chip8, ins) != 0)
+            return 1;
+    }
+    return 0;
+}
+#endif
+
+static int CORE(run_cycles_profiled)(chip8_t *chip8, uint32_t cycles)
+{
+    profile_t *profile = chip8->profile;
+
+    while (cycles > 0)
+    {
+        // Counted only, up to the instruction before the next timed one
+        const uint32_t counted = profile->countdown - 1 < cycles ? profile->countdown - 1 : cycles;
+        if (counted > 0)
+        {
+            profile->countdown -= counted;
+            cycles -= counted;
+            if (CORE(run_cycles_counted)(chip8, counted) != 0)
+                return 1;
+            if (cycles == 0)
+                return 0;
+        }
+
+        // Counted and timed
+        if (check_PC(chip8) != 0)
+            return 1;
+
+        profile->addresses[chip8->reg.PC]++;
+        const decoded_t *ins = fetch_decoded(chip8);
+        profile->opcodes[ins->op]++;
+        if (ins->op == OP_DRW)
+            profile->drawRows += (ins->n == 0 && chip8->mode != MODE_CHIP8) ? 16 : ins->n;
+
+        const uint64_t start = Time_Now_NS();
+        const int status = CORE(handlerTable)[ins->op](chip8, ins);
+        const double elapsed = (double)(Time_Now_NS() - start) - profile->timerNs;
+
+        profile->sampleNs[ins->op] += elapsed > 0 ? (uint64_t)elapsed : 0;
+        profile->samples[ins->op]++;
+        profile->countdown = profile_next_sample(profile);
+        cycles--;
+        if (status != 0)
+            return status;
+    }
+    return 0;
+}
+#endif
+
+
+// Debug engine
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+// The table engine, with the debugger looking at every instruction before it runs
+
+static int CORE(run_cycles_debug)(chip8_t *chip8, uint32_t cycles)
+{
+    for (uint32_t i=0; i<cycles && chip8->debug->active; i++)
+    {
+        if (check_PC(chip8) != 0)
+            return 1;
+
+        decoded_t *ins = &chip8->decodeCache[chip8->reg.PC >> 1];
+        if (ins->op == OP_UNDECODED)
+            decode_instruction(chip8, chip8->ram[chip8->reg.PC] << 8 | chip8->ram[chip8->reg.PC + 1], ins);
+
+        debug_check(chip8, ins);
+        if (chip8->state == QUIT)
+            return 0;
+
+        fetch_decoded(chip8);
+        if (CORE(handlerTable)[ins->op](chip8, ins) != 0)
+            return 1;
+
+        // Nothing left to stop on, the rest of the cycles run at full speed
+        if (!chip8->debug->active)
+            return run_cycles(chip8, cycles - i - 1);
+    }
+    return 0;
+}
+
+
+// This profile's core, cpu.c dispatches to it by the machine's quirk profile
+static const core_t CORE(core) = {
+    .handlers       = CORE(handlerTable),
+    .run_switch     = CORE(run_cycles_switch),
+    .run_table      = CORE(run_cycles_table),
+#if defined(__GNUC__)
+    .run_goto       = CORE(run_cycles_goto),
+#endif
+#if CHIP8_PROFILE
+    .run_profiled   = CORE(run_cycles_profiled),
+#endif
+    .run_debug      = CORE(run_cycles_debug),
+};
+
+#endif
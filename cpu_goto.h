@@ -0,0 +1,169 @@
+// Computed-goto engine template, cpu_core.h includes it once per engine with
+//      GOTO_ENGINE     -> name of the engine function
+//      GOTO_COUNTED    -> 1 counts executions per opcode and per address into
+//                         chip8->profile for the profiler, 0 doesn't
+//
+// The counted copy keeps the profiler on the same dispatch as the normal engine,
+// its only extra work per instruction is the two counters. Included repeatedly
+// so there is no include guard.
+
+#if defined(GOTO_ENGINE) && defined(GOTO_COUNTED)
+
+static int GOTO_ENGINE(chip8_t *chip8, uint32_t cycles)
+{
+#if GOTO_COUNTED
+    profile_t *profile = chip8->profile;
+#endif
+    static const void *labelTable[OP_COUNT] = {
+        [OP_UNDECODED]  = &&do_invalid,
+        [OP_INVALID]    = &&do_invalid,
+        [OP_CLS]        = &&do_cls,
+        [OP_RET]        = &&do_ret,
+        [OP_JP]         = &&do_jp,
+        [OP_CALL]       = &&do_call,
+        [OP_SE_VX_KK]   = &&do_se_vx_kk,
+        [OP_SNE_VX_KK]  = &&do_sne_vx_kk,
+        [OP_SE_VX_VY]   = &&do_se_vx_vy,
+        [OP_LD_VX_KK]   = &&do_ld_vx_kk,
+        [OP_ADD_VX_KK]  = &&do_add_vx_kk,
+        [OP_LD_VX_VY]   = &&do_ld_vx_vy,
+        [OP_OR]         = &&do_or,
+        [OP_AND]        = &&do_and,
+        [OP_XOR]        = &&do_xor,
+        [OP_ADD_VX_VY]  = &&do_add_vx_vy,
+        [OP_SUB]        = &&do_sub,
+        [OP_SHR]        = &&do_shr,
+        [OP_SUBN]       = &&do_subn,
+        [OP_SHL]        = &&do_shl,
+        [OP_SNE_VX_VY]  = &&do_sne_vx_vy,
+        [OP_LD_I]       = &&do_ld_i,
+        [OP_JP_V0]      = &&do_jp_v0,
+        [OP_RND]        = &&do_rnd,
+        [OP_DRW]        = &&do_drw,
+        [OP_SKP]        = &&do_skp,
+        [OP_SKNP]       = &&do_sknp,
+        [OP_LD_VX_DT]   = &&do_ld_vx_dt,
+        [OP_LD_VX_K]    = &&do_ld_vx_k,
+        [OP_LD_DT_VX]   = &&do_ld_dt_vx,
+        [OP_LD_ST_VX]   = &&do_ld_st_vx,
+        [OP_ADD_I_VX]   = &&do_add_i_vx,
+        [OP_LD_F_VX]    = &&do_ld_f_vx,
+        [OP_LD_B_VX]    = &&do_ld_b_vx,
+        [OP_LD_I_VX]    = &&do_ld_i_vx,
+        [OP_LD_VX_I]    = &&do_ld_vx_i,
+        [OP_SCD]        = &&do_scd,
+        [OP_SCR]        = &&do_scr,
+        [OP_SCL]        = &&do_scl,
+        [OP_EXIT]       = &&do_exit,
+        [OP_LOW]        = &&do_low,
+        [OP_HIGH]       = &&do_high,
+        [OP_LD_HF_VX]   = &&do_ld_hf_vx,
+        [OP_LD_R_VX]    = &&do_ld_r_vx,
+        [OP_LD_VX_R]    = &&do_ld_vx_r,
+        [OP_SCU]        = &&do_scu,
+        [OP_SAVE_VX_VY] = &&do_save_vx_vy,
+        [OP_LOAD_VX_VY] = &&do_load_vx_vy,
+        [OP_LD_I_LONG]  = &&do_ld_i_long,
+        [OP_PLANE]      = &&do_plane,
+        [OP_AUDIO]      = &&do_audio,
+        [OP_PITCH]      = &&do_pitch,
+    };
+
+    const decoded_t *ins;
+
+#if GOTO_COUNTED
+    #define COUNT_ADDRESS() profile->addresses[chip8->reg.PC]++;
+    #define COUNT_OPCODE()  profile->opcodes[ins->op]++;
+#else
+    #define COUNT_ADDRESS()
+    #define COUNT_OPCODE()
+#endif
+
+    #define DISPATCH()                                                  \
+        if (cycles-- == 0) return 0;                                    \
+        if (check_PC(chip8) != 0) return 1;                             \
+        COUNT_ADDRESS()                                                 \
+        ins = fetch_decoded(chip8);                                     \
+        COUNT_OPCODE()                                                  \
+        goto *labelTable[ins->op];
+
+    #define HANDLER(name)                                               \
+        do_##name:                                                      \
+            if (op_##name(chip8, ins) != 0) return 1;                   \
+            DISPATCH();
+
+    #define QUIRK_HANDLER(name)                                         \
+        do_##name:                                                      \
+            if (CORE(op_##name)(chip8, ins) != 0) return 1;             \
+            DISPATCH();
+
+    DISPATCH();
+
+    HANDLER(invalid)
+    HANDLER(cls)
+    HANDLER(ret)
+    HANDLER(jp)
+    HANDLER(call)
+    HANDLER(se_vx_kk)
+    HANDLER(sne_vx_kk)
+    HANDLER(se_vx_vy)
+    HANDLER(ld_vx_kk)
+    HANDLER(add_vx_kk)
+    HANDLER(ld_vx_vy)
+    QUIRK_HANDLER(or)
+    QUIRK_HANDLER(and)
+    QUIRK_HANDLER(xor)
+    HANDLER(add_vx_vy)
+    HANDLER(sub)
+    QUIRK_HANDLER(shr)
+    HANDLER(subn)
+    QUIRK_HANDLER(shl)
+    HANDLER(sne_vx_vy)
+    HANDLER(ld_i)
+    QUIRK_HANDLER(jp_v0)
+    HANDLER(rnd)
+#if GOTO_COUNTED
+    // Sprite rows only need counting on draws, not on every instruction
+    do_drw:
+        profile->drawRows += (ins->n == 0 && chip8->mode != MODE_CHIP8) ? 16 : ins->n;
+        if (op_drw(chip8, ins) != 0) return 1;
+        DISPATCH();
+#else
+    HANDLER(drw)
+#endif
+    HANDLER(skp)
+    HANDLER(sknp)
+    HANDLER(ld_vx_dt)
+    HANDLER(ld_vx_k)
+    HANDLER(ld_dt_vx)
+    HANDLER(ld_st_vx)
+    HANDLER(add_i_vx)
+    HANDLER(ld_f_vx)
+    HANDLER(ld_b_vx)
+    QUIRK_HANDLER(ld_i_vx)
+    QUIRK_HANDLER(ld_vx_i)
+    HANDLER(scd)
+    HANDLER(scr)
+    HANDLER(scl)
+    HANDLER(exit)
+    HANDLER(low)
+    HANDLER(high)
+    HANDLER(ld_hf_vx)
+    HANDLER(ld_r_vx)
+    HANDLER(ld_vx_r)
+    HANDLER(scu)
+    HANDLER(save_vx_vy)
+    HANDLER(load_vx_vy)
+    HANDLER(ld_i_long)
+    HANDLER(plane)
+    HANDLER(audio)
+    HANDLER(pitch)
+
+    #undef QUIRK_HANDLER
+    #undef HANDLER
+    #undef DISPATCH
+    #undef COUNT_OPCODE
+    #undef COUNT_ADDRESS
+}
+
+#endif
@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "debug.h"
+#include "chip8.h"
+#include "cpu.h"
+#include "trace.h"
+#include "helpers/logging.h"
+
+// Default lengths of the mem and dis commands
+#define DEBUG_MEM_BYTES 64
+#define DEBUG_DIS_INSTRUCTIONS 8
+
+static inline bool test_bit(const uint64_t *bits, uint16_t address)
+{
+    return (bits[address / 64] >> (address % 64)) & 0x01;
+}
+
+// Set or clear the bits of a RAM range
+//
+// Returns the number of bits that changed
+static uint32_t set_bits(uint64_t *bits, uint16_t address, uint16_t length, bool value)
+{
+    uint32_t changed = 0;
+    for (uint32_t i=0; i<length; i++)
+    {
+        const uint16_t a = (address + i) & 0xFFF;
+        if (test_bit(bits, a) == value)
+            continue;
+        bits[a / 64] ^= 1ull << (a % 64);
+        changed++;
+    }
+    return changed;
+}
+
+// Watchpoints cover the first 4 KiB, XO-CHIP RAM above it can't be watched
+static bool any_bit(const uint64_t *bits, uint16_t address, uint16_t length)
+{
+    for (uint32_t i=0; i<length; i++)
+        if ((uint32_t)address + i < 4096 && test_bit(bits, address + i))
+            return true;
+    return false;
+}
+
+// The debug engine is only needed while there is something to stop on
+static void update_active(debugger_t *debug)
+{
+    debug->active = debug->breakRequested || debug->stepRemaining != 0
+        || debug->breakpointCount != 0 || debug->watchCount != 0;
+}
+
+// Parse a RAM address, hex with or without 0x
+//
+// Returns
+//      0           -> success
+//      *           -> anything else when it isn't an address
+static int parse_address(const char *text, uint16_t *address)
+{
+    char *end = NULL;
+    errno = 0;
+    unsigned long value = strtoul(text, &end, 16);
+    if (errno != 0 || end == text || (*end != '\0' && *end != ',') || value > 0xFFF)
+        return 1;
+    *address = (uint16_t)value;
+    return 0;
+}
+
+int init_debugger(debugger_t *debug, const char *breakpoints, bool stopAtStart)
+{
+    memset(debug, 0, sizeof(debugger_t));
+    debug->breakRequested = stopAtStart;
+
+    for (const char *p = breakpoints; p != NULL && *p != '\0'; )
+    {
+        uint16_t address;
+        if (parse_address(p, &address) != 0)
+            return Log_Err("Invalid breakpoint address in '%s', must be 0-FFF", breakpoints);
+        debug->breakpointCount += set_bits(debug->breakpoints, address, 1, true);
+
+        p = strchr(p, ',');
+        if (p != NULL)
+            p++;
+    }
+
+    update_active(debug);
+    return 0;
+}
+
+void debug_break(debugger_t *debug)
+{
+    debug->breakRequested = true;
+    debug->active = true;
+}
+
+// RAM an instruction is about to read or write, only the ones that go through I
+//
+// Returns true when it accesses RAM
+static bool ram_access(const chip8_t *chip8, const decoded_t *ins, uint16_t *address, uint16_t *length, bool *write)
+{
+    *address = chip8->reg.I;
+    const uint16_t range = (ins->x > ins->y ? ins->x - ins->y : ins->y - ins->x) + 1;
+
+    // Sprites are read once per selected plane, 16x16 sprites are 32 bytes
+    uint16_t planes = 0;
+    for (uint8_t p=0; p<chip8->displayPlanes; p++)
+        planes += (chip8->planeMask >> p) & 0x01;
+    const uint16_t sprite = ins->n == 0 && chip8->mode != MODE_CHIP8 ? 32 : ins->n;
+
+    switch (ins->op)
+    {
+        case OP_LD_I_VX:        *length = ins->x + 1;       *write = true;  return true;
+        case OP_LD_B_VX:        *length = 3;                *write = true;  return true;
+        case OP_SAVE_VX_VY:     *length = range;            *write = true;  return true;
+        case OP_LD_VX_I:        *length = ins->x + 1;       *write = false; return true;
+        case OP_LOAD_VX_VY:     *length = range;            *write = false; return true;
+        case OP_AUDIO:          *length = 16;               *write = false; return true;
+        case OP_DRW:            *length = sprite * planes;  *write = false; return *length != 0;
+        default:
+            return false;
+    }
+}
+
+
+// Inspection
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+
+static void print_registers(const chip8_t *chip8)
+{
+    for (int i=0; i<16; i++)
+        printf("V%X=%02X%s", i, chip8->reg.Vx[i], i % 8 == 7 ? "\n" : " ");
+    printf("PC=%03X I=%03X SP=%X DT=%02X ST=%02X\n", chip8->reg.PC, chip8->reg.I, chip8->reg.SP, chip8->reg.DT, chip8->reg.ST);
+}
+
+static void print_memory(const chip8_t *chip8, uint16_t address, uint16_t length)
+{
+    for (uint32_t i=0; i<length; i++)
+    {
+        const uint16_t a = (address + i) & 0xFFF;
+        if (i % 16 == 0)
+            printf("%s%03X:", i ? "\n" : "", a);
+        printf(" %02X", chip8->ram[a]);
+    }
+    printf("\n");
+}
+
+static void print_stack(const chip8_t *chip8)
+{
+    if (chip8->reg.SP == 0)
+        printf("stack is empty\n");
+    for (int i=chip8->reg.SP - 1; i>=0; i--)
+        printf("%2d: %03X\n", i, chip8->stack[i]);
+}
+
+static void print_disassembly(const chip8_t *chip8, uint16_t address, uint16_t count)
+{
+    for (uint32_t i=0; i<count; i++)
+    {
+        const uint16_t a = (address + 2 * i) & 0xFFF;
+        const uint16_t opcode = chip8->ram[a] << 8 | chip8->ram[(a + 1) & 0xFFF];
+        char text[32];
+        disassemble(opcode, text, sizeof(text));
+        printf("%s%03X  %04X  %s%s\n", a == chip8->reg.PC ? "> " : "  ", a, opcode, text,
+            test_bit(chip8->debug->breakpoints, a) ? "  [break]" : "");
+    }
+}
+
+static void print_display(const chip8_t *chip8)
+{
+    for (uint16_t y=0; y<chip8->displayY; y++)
+    {
+        for (uint16_t x=0; x<chip8->displayX; x++)
+            putchar(".#+@"[get_pixel(chip8, x, y)]);
+        putchar('\n');
+    }
+}
+
+// Print a bitmap as address ranges
+static void print_ranges(const char *name, const uint64_t *bits)
+{
+    for (int a=0; a<4096; a++)
+    {
+        if (!test_bit(bits, (uint16_t)a))
+            continue;
+        int end = a;
+        while (end + 1 < 4096 && test_bit(bits, (uint16_t)(end + 1)))
+            end++;
+
+        if (end == a)
+            printf("%s %03X\n", name, a);
+        else
+            printf("%s %03X-%03X\n", name, a, end);
+        a = end;
+    }
+}
+
+static void print_help(void)
+{
+    printf("c                   continue until a breakpoint or watchpoint\n");
+    printf("s [N]               step N instructions (default: 1)\n");
+    printf("b ADDR              break before executing ADDR\n");
+    printf("rw ADDR [LEN]       break before an instruction reads ADDR..ADDR+LEN-1\n");
+    printf("ww ADDR [LEN]       break before an instruction writes ADDR..ADDR+LEN-1\n");
+    printf("d ADDR [LEN] | all  delete breakpoints and watchpoints\n");
+    printf("l                   list breakpoints and watchpoints\n");
+    printf("r                   registers\n");
+    printf("m ADDR [LEN]        RAM (default: %d bytes)\n", DEBUG_MEM_BYTES);
+    printf("k                   stack\n");
+    printf("x [ADDR] [N]        disassemble N instructions (default: PC, %d)\n", DEBUG_DIS_INSTRUCTIONS);
+    printf("v                   display\n");
+    printf("q                   quit\n");
+}
+
+
+// Prompt
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+
+// Read commands until one resumes emulation, the machine stays in STEPPING
+// while the prompt is up
+static void prompt(chip8_t *chip8)
+{
+    debugger_t *debug = chip8->debug;
+    const emulator_state_t resumeState = chip8->state == STEPPING ? RUNNING : chip8->state;
+    chip8->state = STEPPING;
+
+    // Queued log messages go out before the prompt, not in the middle of it
+    flush_logging();
+    print_disassembly(chip8, chip8->reg.PC, 1);
+
+    char line[256];
+    while (true)
+    {
+        printf("(chip8) ");
+        fflush(stdout);
+
+        // Without a terminal there is nobody left to continue, run on detached
+        if (fgets(line, sizeof(line), stdin) == NULL)
+        {
+            printf("\n");
+            Log_Warn("End of debugger input, continuing without breakpoints");
+            memset(debug, 0, sizeof(debugger_t));
+            chip8->state = resumeState;
+            return;
+        }
+
+        char command[16] = {0}, arg1[32] = {0}, arg2[32] = {0};
+        const int args = sscanf(line, "%15s %31s %31s", command, arg1, arg2);
+        if (args <= 0)
+            continue;
+
+        // ADDR is hex, LEN and N are decimal
+        uint16_t address = 0;
+        unsigned long count = 0, value = 0;
+        const bool hasAddress = args >= 2 && parse_address(arg1, &address) == 0;
+        const bool hasCount = args >= 2 && sscanf(arg1, "%lu", &count) == 1;
+        const bool hasValue = args >= 3 && sscanf(arg2, "%lu", &value) == 1;
+
+        if (strcmp(command, "c") == 0)
+        {
+            debug->stepRemaining = 0;
+            chip8->state = resumeState;
+            update_active(debug);
+            return;
+        }
+        else if (strcmp(command, "s") == 0)
+        {
+            debug->stepRemaining = hasCount && count != 0 && count <= UINT32_MAX ? (uint32_t)count : 1;
+            update_active(debug);
+            return;
+        }
+        else if (strcmp(command, "q") == 0)
+        {
+            chip8->state = QUIT;
+            return;
+        }
+        else if (strcmp(command, "b") == 0 && hasAddress)
+        {
+            debug->breakpointCount += set_bits(debug->breakpoints, address, 1, true);
+        }
+        else if ((strcmp(command, "rw") == 0 || strcmp(command, "ww") == 0) && hasAddress)
+        {
+            const uint16_t length = hasValue && value != 0 && value <= 4096 ? (uint16_t)value : 1;
+            debug->watchCount += set_bits(command[0] == 'r' ? debug->watchReads : debug->watchWrites, address, length, true);
+        }
+        else if (strcmp(command, "d") == 0 && strcmp(arg1, "all") == 0)
+        {
+            memset(debug->breakpoints, 0, sizeof(debug->breakpoints));
+            memset(debug->watchReads, 0, sizeof(debug->watchReads));
+            memset(debug->watchWrites, 0, sizeof(debug->watchWrites));
+            debug->breakpointCount = debug->watchCount = 0;
+        }
+        else if (strcmp(command, "d") == 0 && hasAddress)
+        {
+            const uint16_t length = hasValue && value != 0 && value <= 4096 ? (uint16_t)value : 1;
+            debug->breakpointCount -= set_bits(debug->breakpoints, address, length, false);
+            debug->watchCount -= set_bits(debug->watchReads, address, length, false);
+            debug->watchCount -= set_bits(debug->watchWrites, address, length, false);
+        }
+        else if (strcmp(command, "l") == 0)
+        {
+            if (debug->breakpointCount == 0 && debug->watchCount == 0)
+                printf("no breakpoints or watchpoints\n");
+            print_ranges("break", debug->breakpoints);
+            print_ranges("read ", debug->watchReads);
+            print_ranges("write", debug->watchWrites);
+        }
+        else if (strcmp(command, "r") == 0)
+        {
+            print_registers(chip8);
+        }
+        else if (strcmp(command, "m") == 0 && hasAddress)
+        {
+            print_memory(chip8, address, hasValue && value != 0 && value <= 4096 ? (uint16_t)value : DEBUG_MEM_BYTES);
+        }
+        else if (strcmp(command, "k") == 0)
+        {
+            print_stack(chip8);
+        }
+        else if (strcmp(command, "x") == 0)
+        {
+            print_disassembly(chip8, hasAddress ? address : chip8->reg.PC,
+                hasValue && value != 0 && value <= 2048 ? (uint16_t)value : DEBUG_DIS_INSTRUCTIONS);
+        }
+        else if (strcmp(command, "v") == 0)
+        {
+            print_display(chip8);
+        }
+        else
+        {
+            print_help();
+        }
+    }
+}
+
+void debug_check(chip8_t *chip8, const decoded_t *ins)
+{
+    debugger_t *debug = chip8->debug;
+    const uint16_t PC = chip8->reg.PC;
+    uint16_t address, length;
+    bool write;
+
+    if (debug->breakRequested)
+    {
+        debug->breakRequested = false;
+        printf("\n");
+        Log_Info("Stopped at 0x%03X", PC);
+    }
+    else if (test_bit(debug->breakpoints, PC))
+    {
+        printf("\n");
+        Log_Info("Breakpoint at 0x%03X", PC);
+    }
+    else if (debug->watchCount != 0 && ram_access(chip8, ins, &address, &length, &write)
+        && any_bit(write ? debug->watchWrites : debug->watchReads, address, length))
+    {
+        printf("\n");
+        Log_Info("Watchpoint, 0x%03X %s 0x%03X-0x%03X", PC, write ? "writes" : "reads", address, (uint16_t)(address + length - 1));
+    }
+    else if (debug->stepRemaining == 0 || --debug->stepRemaining != 0)
+    {
+        return;
+    }
+
+    // A breakpoint or watchpoint cuts stepping short
+    debug->stepRemaining = 0;
+    prompt(chip8);
+}
@@ -0,0 +1,43 @@
+#ifndef DEBUG_H_IRISH
+#define DEBUG_H_IRISH
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+#include "cpu.h"
+
+// Terminal debugger: PC breakpoints, RAM read/write watchpoints, stepping and
+// register/RAM/stack/display inspection.
+//
+// Breakpoints and watchpoints are bitmaps with one bit per RAM address, so the
+// check before an instruction costs the same however many are set. And while
+// none are set, nothing is stepped and no break was asked for, active is false
+// and run_cycles() never enters the debug engine: the normal engines and the
+// recompiler run at full speed.
+typedef struct debugger
+{
+    bool active;                        // run_cycles() uses the debug engine
+    bool breakRequested;                // stop before the next instruction
+    uint32_t stepRemaining;             // instructions left to step, 0 -> not stepping
+
+    uint64_t breakpoints[4096/64];      // bit per address, stop before executing it
+    uint64_t watchReads[4096/64];       // bit per address, stop before an instruction reads it
+    uint64_t watchWrites[4096/64];      // bit per address, stop before an instruction writes it
+    uint32_t breakpointCount;
+    uint32_t watchCount;
+} debugger_t;
+
+// Set up a debugger, breakpoints is a comma separated list of addresses, NULL
+// -> none. With stopAtStart the prompt comes up before the first instruction.
+int init_debugger(debugger_t *debug, const char *breakpoints, bool stopAtStart);
+
+// Stop before the next instruction, e.g. from a hotkey
+void debug_break(debugger_t *debug);
+
+// Called by the debug engine before every instruction, shows the prompt when
+// the instruction hits a breakpoint or watchpoint, or while stepping.
+// Returns once the user continues, steps or quits (chip8->state == QUIT).
+void debug_check(chip8_t *chip8, const decoded_t *ins);
+
+#endif
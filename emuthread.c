@@ -0,0 +1,181 @@
+// pthreads are POSIX, not part of -std=c17
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include <SDL2/SDL.h>
+
+#include "emuthread.h"
+#include "main.h"
+#include "chip8.h"
+#include "helpers/logging.h"
+
+// Copy the machine's display into the back buffer and make it the middle one
+static void publish_frame(emu_thread_t *thread, const chip8_t *chip8, uint32_t keyTicks)
+{
+    frame_t *frame = &thread->frames[thread->back];
+    memcpy(frame->display, chip8->display, chip8->displaySize);
+    frame->planeWords = chip8->planeWords;
+    frame->displayWords = chip8->displayWords;
+    frame->displayX = chip8->displayX;
+    frame->displayY = chip8->displayY;
+    frame->displayPlanes = chip8->displayPlanes;
+    frame->keyTicks = keyTicks;
+
+    const unsigned old = atomic_exchange_explicit(&thread->middle, thread->back | EMU_FRAME_FRESH, memory_order_acq_rel);
+    thread->back = old & ~EMU_FRAME_FRESH;
+    thread->framesPublished++;
+}
+
+// Swap the newest frame into the front buffer
+//
+// Returns
+//      true        -> there was a new frame
+//      false       -> the front buffer is still the newest
+static bool take_frame(emu_thread_t *thread)
+{
+    if (!(atomic_load_explicit(&thread->middle, memory_order_relaxed) & EMU_FRAME_FRESH))
+        return false;
+
+    const unsigned old = atomic_exchange_explicit(&thread->middle, thread->front, memory_order_acq_rel);
+    thread->front = old & ~EMU_FRAME_FRESH;
+    return true;
+}
+
+static void *emulation_thread(void *arg)
+{
+    emu_thread_t *thread = (emu_thread_t*)arg;
+    emulator_t *emu = thread->emu;
+    chip8_t *chip8 = emu->chip8;
+
+    while (chip8->state != QUIT)
+    {
+        // The time stamp is taken before the keys, so these keys include its change
+        hotkeys_t hotkeys = {0};
+        hotkeys.keyTicks = atomic_exchange_explicit(&thread->keyTicks, 0, memory_order_acquire);
+        const unsigned input = atomic_load_explicit(&thread->input, memory_order_acquire);
+        const unsigned commands = atomic_exchange_explicit(&thread->commands, 0, memory_order_acquire);
+
+        hotkeys.keys = input & 0xFFFF;
+        hotkeys.rewind = input & EMU_INPUT_REWIND;
+        hotkeys.saveState = commands & EMU_CMD_SAVE_STATE;
+        hotkeys.loadState = commands & EMU_CMD_LOAD_STATE;
+        hotkeys.debugBreak = commands & EMU_CMD_DEBUG_BREAK;
+        hotkeys.pause = commands & EMU_CMD_PAUSE;
+        hotkeys.quit = commands & EMU_CMD_QUIT;
+
+        emulate_frame(emu, &hotkeys);
+        if (chip8->state == QUIT)
+            break;
+
+        // Frames with a keypad change go out even when nothing was drawn, so
+        // its latency is counted
+        if (chip8->displayDirty || hotkeys.keyTicks != 0)
+        {
+            publish_frame(thread, chip8, hotkeys.keyTicks);
+            chip8->displayDirty = false;
+        }
+
+        // Sleep off the rest of the frame
+        wait_for_next_frame(&emu->frameTimer);
+    }
+
+    atomic_store_explicit(&thread->done, true, memory_order_release);
+    return NULL;
+}
+
+int run_emulation_thread(emulator_t *emu, sdl_t sdl, const config_t config, latency_t *latency)
+{
+    emu_thread_t thread = { .emu = emu, .back = 0, .front = 1 };
+    atomic_init(&thread.input, 0);
+    atomic_init(&thread.commands, 0);
+    atomic_init(&thread.keyTicks, 0);
+    atomic_init(&thread.middle, 2);
+    atomic_init(&thread.done, false);
+
+    for (int f=0; f<3; f++)
+    {
+        thread.frames[f].display = (uint64_t*) calloc(1, emu->chip8->displayCapacity);
+        if (thread.frames[f].display == NULL)
+        {
+            for (int g=0; g<f; g++)
+                free(thread.frames[g].display);
+            return Log_Err("Unable to allocate dynamic memory for the emulation thread's frames");
+        }
+    }
+
+    if (pthread_create(&thread.thread, NULL, emulation_thread, &thread) != 0)
+    {
+        for (int f=0; f<3; f++)
+            free(thread.frames[f].display);
+        return Log_Err("Unable to start the emulation thread");
+    }
+    Log_Info("Started the emulation thread");
+
+    // Window loop, events and presenting only, a millisecond per iteration
+    hotkeys_t hotkeys = {0};
+    unsigned lastInput = 0;
+    bool presented = false;
+    while (!atomic_load_explicit(&thread.done, memory_order_acquire))
+    {
+        handle_input(sdl, config, &hotkeys);
+
+        // Keys before their time stamp, the emulation thread takes them the other way round
+        const unsigned input = hotkeys.keys | (hotkeys.rewind ? EMU_INPUT_REWIND : 0);
+        if (input != lastInput)
+        {
+            atomic_store_explicit(&thread.input, input, memory_order_release);
+            lastInput = input;
+        }
+        if (hotkeys.keyTicks != 0)
+        {
+            // An older change the emulation hasn't taken yet keeps its time stamp
+            unsigned none = 0;
+            atomic_compare_exchange_strong_explicit(&thread.keyTicks, &none, hotkeys.keyTicks,
+                memory_order_release, memory_order_relaxed);
+            hotkeys.keyTicks = 0;
+        }
+
+        const unsigned commands = (hotkeys.saveState ? EMU_CMD_SAVE_STATE : 0) |
+            (hotkeys.loadState ? EMU_CMD_LOAD_STATE : 0) | (hotkeys.debugBreak ? EMU_CMD_DEBUG_BREAK : 0) |
+            (hotkeys.pause ? EMU_CMD_PAUSE : 0) | (hotkeys.quit ? EMU_CMD_QUIT : 0);
+        if (commands != 0)
+            atomic_fetch_or_explicit(&thread.commands, commands, memory_order_release);
+        hotkeys.saveState = hotkeys.loadState = hotkeys.debugBreak = hotkeys.pause = hotkeys.quit = false;
+
+        // Present the newest frame, or the last one again when the window lost it
+        const frame_t *frame = &thread.frames[thread.front];
+        if (take_frame(&thread))
+        {
+            frame = &thread.frames[thread.front];
+            present_frame(sdl, config, frame);
+            thread.framesPresented++;
+            presented = true;
+            if (frame->keyTicks != 0)
+                record_latency(latency, frame->keyTicks);
+        }
+        else if (hotkeys.redraw && presented)
+        {
+            present_frame(sdl, config, frame);
+        }
+        hotkeys.redraw = false;
+
+        SDL_Delay(1);
+    }
+
+    pthread_join(thread.thread, NULL);
+
+    Log_Info("Stopped the emulation thread");
+    Log_Detail("Frames:           %llu published, %llu presented",
+        (unsigned long long)thread.framesPublished, (unsigned long long)thread.framesPresented);
+
+    for (int f=0; f<3; f++)
+        free(thread.frames[f].display);
+    return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef EMUTHREAD_H_IRISH
+#define EMUTHREAD_H_IRISH
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "main.h"
+#include "chip8.h"
+
+// Emulation thread, --threaded
+//
+// The CPU, timers, scheduler and everything else emulate_frame() does run on a
+// thread of their own, paced at 60Hz, while the main thread polls SDL events
+// and presents frames every millisecond. A stall in SDL_RenderPresent() or the
+// event queue no longer holds up the emulation. Neither thread ever waits on
+// the other:
+//
+//      keypad      the main thread stores the keys held in one atomic word, the
+//                  emulation thread loads it at the start of every frame
+//      hotkeys     presses are ORed into an atomic word and taken with an exchange
+//      frames      triple buffered, the emulation thread copies a finished frame
+//                  into its back buffer and swaps it with the middle one, the main
+//                  thread swaps the middle one with its front buffer when there is
+//                  a new frame, so it always presents the newest complete frame
+
+// Bits of the input word besides the 16 keypad keys
+#define EMU_INPUT_REWIND    (1u << 16)
+
+// Bits of the command word, one per hotkey press
+#define EMU_CMD_SAVE_STATE  0x01
+#define EMU_CMD_LOAD_STATE  0x02
+#define EMU_CMD_DEBUG_BREAK 0x04
+#define EMU_CMD_PAUSE       0x08
+#define EMU_CMD_QUIT        0x10
+
+// Flag of the middle buffer index, set while the main thread hasn't taken it
+#define EMU_FRAME_FRESH     0x04
+
+typedef struct
+{
+    emulator_t *emu;
+    pthread_t thread;
+
+    // Main thread -> emulation thread
+    _Alignas(CACHE_LINE) atomic_uint input;     // keypad keys held and EMU_INPUT_REWIND
+    atomic_uint commands;                       // EMU_CMD_* pressed since the emulation last took them
+    atomic_uint keyTicks;                       // SDL_GetTicks() of the oldest keypad change not emulated yet, 0 -> none
+
+    // Emulation thread -> main thread
+    _Alignas(CACHE_LINE) atomic_uint middle;    // index of the middle frame | EMU_FRAME_FRESH
+    atomic_bool done;                           // the emulation thread has ended
+    frame_t frames[3];
+    uint32_t back;                              // only the emulation thread touches it
+    uint32_t front;                             // only the main thread touches it
+
+    uint64_t framesPublished;
+    uint64_t framesPresented;
+} emu_thread_t;
+
+// Run the window with the emulation on a thread of its own until the machine
+// quits, keypad latency is recorded into latency
+//
+// Returns
+//      0           -> success
+//      *           -> anything else on failure
+int run_emulation_thread(emulator_t *emu, sdl_t sdl, const config_t config, latency_t *latency);
+
+#endif
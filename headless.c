@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "headless.h"
+#include "main.h"
+#include "chip8.h"
+#include "scheduler.h"
+#include "movie.h"
+#include "helpers/logging.h"
+#include "helpers/timing.h"
+
+int run_headless(chip8_t *chip8, const config_t config, movie_t *movie, headless_result_t *result)
+{
+    *result = (headless_result_t) {0};
+
+    scheduler_t sched;
+    init_scheduler(&sched, config.cpu_hz);
+
+    // A replay stops on the instruction its recording stopped on, which can be
+    // part way through a frame
+    uint64_t max_cycles = config.max_cycles;
+    if (movie != NULL && !movie->recording && (max_cycles == 0 || movie->cycles < max_cycles))
+        max_cycles = movie->cycles;
+
+    const uint64_t max_ns = (uint64_t)(config.max_seconds * NS_PER_SECOND);
+    const uint64_t start = Time_Now_NS();
+    int status = 0;
+
+    // Emulate frame by frame, exactly as the windowed loop does but without
+    // pacing, so the wall-clock budget is only checked once per frame
+    while (chip8->state != QUIT)
+    {
+        if (movie != NULL && !movie->recording && sched.cycles >= movie->cycles)
+            break;
+        if (movie != NULL && movie_frame(movie, chip8, sched.frames) != 0)
+        {
+            status = 1;
+            break;
+        }
+
+        uint64_t maxCycles = 0;
+        if (max_cycles != 0)
+            maxCycles = max_cycles - sched.cycles;
+
+        if (run_frame(chip8, &sched, maxCycles) != 0)
+        {
+            // on fatal instruction emulation error stop the run
+            chip8->state = QUIT;
+            status = 1;
+        }
+
+        result->elapsed_ns = Time_Now_NS() - start;
+        if (max_cycles != 0 && sched.cycles >= max_cycles)
+            break;
+        if (max_ns != 0 && result->elapsed_ns >= max_ns)
+            break;
+    }
+
+    result->cycles = sched.cycles;
+    result->frames = sched.frames;
+    result->displayHash = hash_display(chip8);
+    result->ramHash = hash_ram(chip8);
+    return status;
+}
+
+void print_headless_result(const headless_result_t *result)
+{
+    const double seconds = NS_TO_SECONDS(result->elapsed_ns);
+
+    printf("\n");
+    Log_Info("Headless run finished");
+    Log_Detail("Instructions:     %llu", (unsigned long long)result->cycles);
+    Log_Detail("Frames:           %llu", (unsigned long long)result->frames);
+    Log_Detail("Elapsed:          %.6f [s]", seconds);
+    if (seconds > 0)
+    {
+        Log_Detail("Instructions/sec: %.0f", result->cycles / seconds);
+        Log_Detail("Frames/sec:       %.1f", result->frames / seconds);
+    }
+    Log_Detail("Display hash:     0x%016llX", (unsigned long long)result->displayHash);
+    Log_Detail("RAM hash:         0x%016llX", (unsigned long long)result->ramHash);
+}
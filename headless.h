@@ -0,0 +1,26 @@
+#ifndef HEADLESS_H_IRISH
+#define HEADLESS_H_IRISH
+
+#include <stdint.h>
+
+#include "main.h"
+#include "chip8.h"
+#include "movie.h"
+
+// Results of a headless run
+typedef struct
+{
+    uint64_t cycles;        // instructions emulated
+    uint64_t frames;        // complete 60Hz frames emulated
+    uint64_t elapsed_ns;    // host wall-clock time spent emulating
+    uint64_t displayHash;   // hash of the display after the last instruction
+    uint64_t ramHash;       // hash of RAM after the last instruction
+} headless_result_t;
+
+// Run the Chip-8 machine with no SDL window, renderer or frame delay until
+// config.max_cycles instructions or config.max_seconds of wall-clock time.
+// A movie being replayed also ends the run where its recording ended, NULL -> no movie.
+int run_headless(chip8_t *chip8, const config_t config, movie_t *movie, headless_result_t *result);
+void print_headless_result(const headless_result_t *result);
+
+#endif
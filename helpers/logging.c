@@ -1,51 +1,296 @@
+// flockfile(), nanosleep() and pthreads are POSIX, not part of -std=c17
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "logging.h"
 
-int Log_Info(const char *format, ...)
+atomic_int logLevel = LOG_LEVEL_INFO;
+
+static const char *const levelNames[] = {
+    [LOG_LEVEL_DEBUG] = "debug",
+    [LOG_LEVEL_INFO] = "info",
+    [LOG_LEVEL_WARN] = "warn",
+    [LOG_LEVEL_ERR] = "err",
+    [LOG_LEVEL_NONE] = "none",
+};
+
+// Log symbol and its color per kind
+static const char *const symbols[] = {
+    [LOG_LEVEL_DEBUG] = COLOR_CYAN "[.] " COLOR_RESET,
+    [LOG_LEVEL_INFO] = COLOR_GREEN "[+] " COLOR_RESET,
+    [LOG_LEVEL_WARN] = COLOR_YELLOW "[!] " COLOR_RESET,
+    [LOG_LEVEL_ERR] = COLOR_RED "[-] " COLOR_RESET,
+    [LOG_DETAIL] = "\t\\_ ",
+    [LOG_ERR_DETAIL] = "\t\\_ ",
+};
+
+typedef struct
 {
-    Print_Color(stdout, "[+] ", COLOR_GREEN);
+    atomic_size_t sequence;         // position it can be written at, or that position + 1 once written
+    int kind;
+    char text[LOG_MESSAGE_SIZE];
+} log_slot_t;
 
-    va_list args;
-    va_start(args, format);
-    vfprintf(stdout, format, args);
-    va_end(args);
-    fprintf(stdout, "\n");
+// Bounded queue after Dmitry Vyukov's: producers claim a position with a CAS
+// and publish the slot through its sequence number, the writer thread frees it
+// by moving the sequence number a lap ahead
+static struct
+{
+    log_slot_t slots[LOG_QUEUE_SIZE];
+    _Alignas(64) atomic_size_t enqueue;         // next position claimed, producers only
+    _Alignas(64) atomic_size_t written;         // positions written and flushed, writer thread only
+    atomic_bool running;
+    atomic_bool sleeping;                       // the writer thread waits on wake
+    atomic_ullong dropped;                      // debug messages the full queue had no room for
+    size_t dequeue;                             // next position written, writer thread only
 
-    return 0;
+    pthread_t thread;
+    pthread_mutex_t lock;                       // only taken to wake the writer thread
+    pthread_cond_t wake;
+} queue;
+
+static FILE *stream_of(int kind)
+{
+    return kind == LOG_LEVEL_ERR || kind == LOG_ERR_DETAIL ? stderr : stdout;
+}
+
+static void write_message(int kind, const char *text)
+{
+    FILE *stream = stream_of(kind);
+    fputs(symbols[kind], stream);
+    fputs(text, stream);
+    fputc('\n', stream);
 }
 
-int Log_Warn(const char *format, ...)
+static bool slot_ready(size_t position)
 {
-    Print_Color(stdout, "[!] ", COLOR_YELLOW);
+    const log_slot_t *slot = &queue.slots[position & (LOG_QUEUE_SIZE - 1)];
+    return atomic_load(&slot->sequence) == position + 1;
+}
+
+// Write every slot published so far, in order, then flush once
+//
+// Returns
+//      number of messages written
+static size_t write_batch(void)
+{
+    size_t count = 0;
+    while (slot_ready(queue.dequeue))
+    {
+        log_slot_t *slot = &queue.slots[queue.dequeue & (LOG_QUEUE_SIZE - 1)];
+        write_message(slot->kind, slot->text);
+        atomic_store_explicit(&slot->sequence, queue.dequeue + LOG_QUEUE_SIZE, memory_order_release);
+        queue.dequeue++;
+        count++;
+    }
+    if (count != 0)
+    {
+        fflush(stdout);
+        fflush(stderr);
+        atomic_store_explicit(&queue.written, queue.dequeue, memory_order_release);
+    }
+    return count;
+}
+
+static void *writer_thread(void *arg)
+{
+    (void)arg;
+
+    while (true)
+    {
+        if (write_batch() != 0)
+            continue;
+
+        // Sleep until a producer finds sleeping set, the queue is checked again
+        // after setting it so a message published meanwhile isn't missed
+        pthread_mutex_lock(&queue.lock);
+        atomic_store(&queue.sleeping, true);
+        const bool running = atomic_load(&queue.running);
+        if (running && !slot_ready(queue.dequeue))
+            pthread_cond_wait(&queue.wake, &queue.lock);
+        atomic_store(&queue.sleeping, false);
+        pthread_mutex_unlock(&queue.lock);
+
+        // Stopping, the last batch went out above
+        if (!running)
+            break;
+    }
+    return NULL;
+}
+
+static void wake_writer(void)
+{
+    pthread_mutex_lock(&queue.lock);
+    pthread_cond_signal(&queue.wake);
+    pthread_mutex_unlock(&queue.lock);
+}
 
+static void pause_briefly(void)
+{
+    const struct timespec wait = { .tv_sec = 0, .tv_nsec = 100000 };
+    nanosleep(&wait, NULL);
+}
+
+// Format a message into a queue slot
+//
+// Returns
+//      true        -> queued, or dropped
+//      false       -> the queue isn't running, write it directly
+static bool queue_message(int kind, const char *format, va_list args)
+{
+    log_slot_t *slot;
+    size_t position = atomic_load_explicit(&queue.enqueue, memory_order_relaxed);
+    while (true)
+    {
+        if (!atomic_load_explicit(&queue.running, memory_order_acquire))
+            return false;
+
+        slot = &queue.slots[position & (LOG_QUEUE_SIZE - 1)];
+        const size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        const intptr_t lap = (intptr_t)sequence - (intptr_t)position;
+
+        if (lap == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&queue.enqueue, &position, position + 1,
+                memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (lap < 0)
+        {
+            // Full, the writer thread is a whole queue behind
+            if (kind == LOG_LEVEL_DEBUG)
+            {
+                atomic_fetch_add_explicit(&queue.dropped, 1, memory_order_relaxed);
+                return true;
+            }
+            pause_briefly();
+            position = atomic_load_explicit(&queue.enqueue, memory_order_relaxed);
+        }
+        else
+        {
+            // Another producer claimed it first
+            position = atomic_load_explicit(&queue.enqueue, memory_order_relaxed);
+        }
+    }
+
+    slot->kind = kind;
+    const int length = vsnprintf(slot->text, LOG_MESSAGE_SIZE, format, args);
+    if (length >= LOG_MESSAGE_SIZE)
+        memcpy(slot->text + LOG_MESSAGE_SIZE - 4, "...", 4);
+
+    // Publish, then wake the writer thread if it sleeps. Both sides store their
+    // flag before loading the other's, so one of them always sees the other.
+    atomic_store(&slot->sequence, position + 1);
+    if (atomic_load(&queue.sleeping))
+        wake_writer();
+    return true;
+}
+
+int Log_Write(int kind, const char *format, ...)
+{
     va_list args;
     va_start(args, format);
-    vfprintf(stdout, format, args);
+    if (!queue_message(kind, format, args))
+    {
+        // One lock for the whole line, so lines from other threads don't cut in
+        FILE *stream = stream_of(kind);
+        flockfile(stream);
+        fputs(symbols[kind], stream);
+        vfprintf(stream, format, args);
+        fputc('\n', stream);
+        funlockfile(stream);
+    }
     va_end(args);
-    fprintf(stdout, "\n");
 
+    return kind == LOG_LEVEL_ERR;
+}
+
+int set_log_level(const char *name)
+{
+    for (int level=LOG_LEVEL_DEBUG; level<=LOG_LEVEL_NONE; level++)
+    {
+        if (strcasecmp(name, levelNames[level]) == 0)
+        {
+            atomic_store(&logLevel, level);
+            return 0;
+        }
+    }
+    return Log_Err("Unknown log level '%s', expected debug, info, warn, err or none", name);
+}
+
+int start_logging(void)
+{
+    for (size_t i=0; i<LOG_QUEUE_SIZE; i++)
+        atomic_init(&queue.slots[i].sequence, i);
+    atomic_init(&queue.enqueue, 0);
+    atomic_init(&queue.written, 0);
+    atomic_init(&queue.sleeping, false);
+    atomic_init(&queue.dropped, 0);
+    queue.dequeue = 0;
+
+    if (pthread_mutex_init(&queue.lock, NULL) != 0)
+        return Log_Err("Unable to create the log queue's lock");
+    if (pthread_cond_init(&queue.wake, NULL) != 0)
+    {
+        pthread_mutex_destroy(&queue.lock);
+        return Log_Err("Unable to create the log queue's condition variable");
+    }
+
+    // Whatever was written directly goes out before anything queued
+    fflush(stdout);
+    fflush(stderr);
+
+    atomic_store(&queue.running, true);
+    if (pthread_create(&queue.thread, NULL, writer_thread, NULL) != 0)
+    {
+        atomic_store(&queue.running, false);
+        pthread_cond_destroy(&queue.wake);
+        pthread_mutex_destroy(&queue.lock);
+        return Log_Err("Unable to start the log writer thread");
+    }
     return 0;
 }
 
-int Log_Err(const char *format, ...)
+void stop_logging(void)
 {
-    Print_Color(stderr, "[-] ", COLOR_RED);
+    if (!atomic_load(&queue.running))
+        return;
 
-    va_list args;
-    va_start(args, format);
-    vfprintf(stderr, format, args);
-    va_end(args);
-    fprintf(stderr, "\n");
+    // Wait for producers that already claimed a slot, then let the writer thread
+    // finish the queue and return
+    flush_logging();
+    pthread_mutex_lock(&queue.lock);
+    atomic_store(&queue.running, false);
+    pthread_cond_signal(&queue.wake);
+    pthread_mutex_unlock(&queue.lock);
+    pthread_join(queue.thread, NULL);
 
-    return 1;
+    // A message published while the writer thread was returning
+    write_batch();
+
+    pthread_cond_destroy(&queue.wake);
+    pthread_mutex_destroy(&queue.lock);
+
+    const unsigned long long dropped = atomic_load(&queue.dropped);
+    if (dropped != 0)
+        Log_Warn("Dropped %llu debug messages on a full log queue", dropped);
 }
 
-static void Print_Color(FILE *stream, const char *msg, const char *colorCode)
+void flush_logging(void)
 {
-    fprintf(stream, "%s", colorCode);
-    fprintf(stream, "%s", msg);
-    fprintf(stream, "%s", COLOR_RESET); 
+    if (!atomic_load(&queue.running))
+        return;
+
+    const size_t target = atomic_load(&queue.enqueue);
+    while (atomic_load_explicit(&queue.written, memory_order_acquire) < target)
+        pause_briefly();
 }
-#define Print_Color cannot_call_Print_Color_outside_logging
@@ -3,6 +3,8 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 
 // Terminal colors via escape codes
 #define COLOR_BLACK "\033[0;30m"
@@ -16,19 +18,81 @@
 
 #define COLOR_RESET "\033[0m"
 
-// These prepend a colored log symbol to our log msg 
-int Log_Info( const char* format, ... );
-int Log_Warn( const char* format, ... );
-int Log_Err( const char* format, ... );
+// Log levels, only messages at or above both the compiled in and the runtime
+// level are written
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERR   3
+#define LOG_LEVEL_NONE  4
 
+// Lowest level compiled in, make LOG_LEVEL=N. Calls below it are removed by
+// the compiler, arguments and all.
+#ifndef CHIP8_LOG_LEVEL
+#define CHIP8_LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
 
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wunused-function"
+// Kinds of a message besides its level: a "\t\\_ " line under the message
+// before it, on stdout filtered like LOG_LEVEL_INFO, or on stderr under an
+// error and filtered like LOG_LEVEL_ERR
+#define LOG_DETAIL 5
+#define LOG_ERR_DETAIL 6
 
-// Used to write 'msg' with the specified 'colorCode'
-static void Print_Color(FILE *stream, const char *msg, const char *colorCode);
+// Runtime level, LOG_LEVEL_INFO unless set_log_level() says otherwise
+extern atomic_int logLevel;
 
-#pragma clang diagnostic pop
+static inline bool log_enabled(int level)
+{
+    return level >= CHIP8_LOG_LEVEL && level >= atomic_load_explicit(&logLevel, memory_order_relaxed);
+}
 
+// These prepend a colored log symbol to our log msg. A filtered call costs a
+// compare, its arguments aren't even evaluated. Log_Err returns 1 either way.
+#define Log_Debug(...)  (log_enabled(LOG_LEVEL_DEBUG) ? Log_Write(LOG_LEVEL_DEBUG, __VA_ARGS__) : 0)
+#define Log_Info(...)   (log_enabled(LOG_LEVEL_INFO) ? Log_Write(LOG_LEVEL_INFO, __VA_ARGS__) : 0)
+#define Log_Detail(...) (log_enabled(LOG_LEVEL_INFO) ? Log_Write(LOG_DETAIL, __VA_ARGS__) : 0)
+#define Log_Warn(...)   (log_enabled(LOG_LEVEL_WARN) ? Log_Write(LOG_LEVEL_WARN, __VA_ARGS__) : 0)
+#define Log_Err(...)    (log_enabled(LOG_LEVEL_ERR) ? Log_Write(LOG_LEVEL_ERR, __VA_ARGS__) : 1)
+#define Log_Err_Detail(...) (log_enabled(LOG_LEVEL_ERR) ? Log_Write(LOG_ERR_DETAIL, __VA_ARGS__) : 0)
 
-#endif
\ No newline at end of file
+// Write a message of a LOG_LEVEL_* or LOG_*DETAIL kind, errors and their
+// details to stderr and everything else to stdout
+//
+// Returns
+//      1           -> kind is LOG_LEVEL_ERR
+//      0           -> anything else
+int Log_Write(int kind, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// Set the runtime level from a name: debug, info, warn, err or none
+//
+// Returns
+//      0           -> success
+//      *           -> anything else on an unknown name
+int set_log_level(const char *name);
+
+// Asynchronous logging
+//
+// Between start_logging() and stop_logging() the caller only formats its
+// message into a slot of a bounded, lock-free multiple producer, single
+// consumer queue. A background thread writes the slots in batches, one flush
+// per batch, so a burst of messages doesn't hold up the emulation or the
+// window. Messages keep their order, per thread and across threads, and are
+// cut at LOG_MESSAGE_SIZE. On a full queue debug messages are dropped and
+// counted, anything else waits for room. Outside of it messages are written
+// on the caller's thread as before.
+#define LOG_QUEUE_SIZE 1024         // slots, a power of 2
+#define LOG_MESSAGE_SIZE 248        // bytes per message, terminator included
+
+// Returns
+//      0           -> success
+//      *           -> anything else on failure, messages stay synchronous
+int start_logging(void);
+
+// Write everything queued and stop the background thread
+void stop_logging(void);
+
+// Wait until every message queued so far is written, before printing to the
+// terminal directly
+void flush_logging(void);
+
+#endif
@@ -0,0 +1,15 @@
+// clock_gettime() is POSIX, not part of -std=c17
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <time.h>
+
+#include "timing.h"
+
+uint64_t Time_Now_NS(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * NS_PER_SECOND) + (uint64_t)ts.tv_nsec;
+}
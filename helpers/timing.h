@@ -0,0 +1,13 @@
+#ifndef TIMING_H_IRISH
+#define TIMING_H_IRISH
+
+#include <stdint.h>
+
+// Monotonic host time in nanoseconds, only useful for measuring elapsed time
+uint64_t Time_Now_NS(void);
+
+// Convert between nanoseconds and seconds
+#define NS_PER_SECOND 1000000000ULL
+#define NS_TO_SECONDS(ns) ((double)(ns) / (double)NS_PER_SECOND)
+
+#endif
@@ -0,0 +1,205 @@
+// pthreads, pipe() and poll() are POSIX, not part of -std=c17
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "hotreload.h"
+#include "chip8.h"
+#include "helpers/logging.h"
+#include "helpers/timing.h"
+
+#ifdef __linux__
+
+#include <poll.h>
+#include <sys/inotify.h>
+
+// Read the ROM into the image and flag it for the main loop
+static void read_image(hot_reload_t *reload, uint8_t *scratch)
+{
+    const uint64_t changedAt = Time_Now_NS();
+
+    // Read outside the lock, the main loop never waits on the disk
+    FILE *fp = fopen(reload->path, "rb");
+    if (fp == NULL)
+        return;                                     // renamed away, the rename over it follows
+    const size_t size = fread(scratch, 1, reload->capacity + 1, fp);
+    fclose(fp);
+
+    if (size == 0 || size > reload->capacity)
+    {
+        Log_Warn("ROM '%s' changed but is %zu [bytes], not reloaded", reload->path, size);
+        return;
+    }
+
+    pthread_mutex_lock(&reload->lock);
+    memcpy(reload->image, scratch, size);
+    reload->size = size;
+    reload->changedAt = changedAt;
+    atomic_store_explicit(&reload->pending, true, memory_order_release);
+    pthread_mutex_unlock(&reload->lock);
+}
+
+static void *watch_rom(void *arg)
+{
+    hot_reload_t *reload = (hot_reload_t*)arg;
+
+    uint8_t *scratch = (uint8_t*) malloc(reload->capacity + 1);
+    if (scratch == NULL)
+    {
+        Log_Err("Unable to allocate dynamic memory for hot reloading");
+        return NULL;
+    }
+
+    // Room for at least one event with the longest name
+    char events[sizeof(struct inotify_event) + 256 + 1] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd fds[2] = {
+        { .fd = reload->inotifyFd, .events = POLLIN },
+        { .fd = reload->stopPipe[0], .events = POLLIN },
+    };
+
+    while (true)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            Log_Err("Hot reload stopped, poll() failed");
+            Log_Err_Detail("Error: %i -> %s", errno, strerror(errno));
+            break;
+        }
+        if (fds[1].revents != 0)
+            break;
+
+        const ssize_t length = read(reload->inotifyFd, events, sizeof(events));
+        if (length <= 0)
+            continue;
+
+        // The directory is watched, editors often save by renaming a new file over the old
+        bool changed = false;
+        for (ssize_t offset = 0; offset < length; )
+        {
+            const struct inotify_event *event = (const struct inotify_event*)&events[offset];
+            if (event->len != 0 && strcmp(event->name, reload->fileName) == 0)
+                changed = true;
+            offset += sizeof(struct inotify_event) + event->len;
+        }
+        if (changed)
+            read_image(reload, scratch);
+    }
+
+    free(scratch);
+    return NULL;
+}
+
+int start_hot_reload(hot_reload_t *reload, const chip8_t *chip8)
+{
+    *reload = (hot_reload_t) {0};
+    reload->inotifyFd = -1;
+    reload->stopPipe[0] = reload->stopPipe[1] = -1;
+    reload->capacity = chip8->ramSize - chip8->entrypoint;
+
+    // inotify watches the directory, split the path into it and the file name
+    reload->path = chip8->romPath;
+    const char *slash = strrchr(chip8->romPath, '/');
+    reload->fileName = slash != NULL ? slash + 1 : chip8->romPath;
+    char dir[1024] = ".";
+    if (slash != NULL)
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - chip8->romPath), chip8->romPath);
+
+    reload->image = (uint8_t*) malloc(reload->capacity);
+    if (reload->image == NULL)
+        return Log_Err("Unable to allocate dynamic memory for hot reloading");
+
+    reload->inotifyFd = inotify_init1(IN_CLOEXEC);
+    if (reload->inotifyFd < 0 || inotify_add_watch(reload->inotifyFd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0 ||
+        pipe(reload->stopPipe) != 0)
+    {
+        Log_Err("Unable to watch '%s' for changes", dir);
+        Log_Err_Detail("Error: %i -> %s", errno, strerror(errno));
+        stop_hot_reload(reload);
+        return 1;
+    }
+
+    pthread_mutex_init(&reload->lock, NULL);
+    if (pthread_create(&reload->thread, NULL, watch_rom, reload) != 0)
+    {
+        pthread_mutex_destroy(&reload->lock);
+        stop_hot_reload(reload);
+        return Log_Err("Unable to start the hot reload thread");
+    }
+    reload->running = true;
+
+    Log_Info("Watching ROM '%s' for changes", chip8->romPath);
+    return 0;
+}
+
+void stop_hot_reload(hot_reload_t *reload)
+{
+    if (reload->running)
+    {
+        const char stop = 0;
+        if (write(reload->stopPipe[1], &stop, 1) == 1)
+            pthread_join(reload->thread, NULL);
+        pthread_mutex_destroy(&reload->lock);
+        Log_Info("Reloaded the ROM %llu times", (unsigned long long)reload->reloads);
+    }
+
+    for (int i=0; i<2; i++)
+        if (reload->stopPipe[i] >= 0)
+            close(reload->stopPipe[i]);
+    if (reload->inotifyFd >= 0)
+        close(reload->inotifyFd);
+    free(reload->image);
+    *reload = (hot_reload_t) {0};
+}
+
+int apply_hot_reload(hot_reload_t *reload, chip8_t *chip8)
+{
+    pthread_mutex_lock(&reload->lock);
+    atomic_store_explicit(&reload->pending, false, memory_order_relaxed);
+    const uint32_t size = reload->size;
+    const uint64_t changedAt = reload->changedAt;
+    const int status = copy_program(chip8, reload->image, size);
+    pthread_mutex_unlock(&reload->lock);
+    if (status != 0)
+        return 1;
+
+    restart_machine(chip8);
+    reload->reloads++;
+
+    Log_Info("Reloaded ROM '%s', %u [bytes]", chip8->romName, size);
+    Log_Detail("%.3f [ms] after it changed", NS_TO_SECONDS(Time_Now_NS() - changedAt) * 1000);
+    return 0;
+}
+
+#else
+
+// inotify is Linux only, --hot-reload is refused at startup
+
+int start_hot_reload(hot_reload_t *reload, const chip8_t *chip8)
+{
+    (void)chip8;
+    *reload = (hot_reload_t) {0};
+    return Log_Err("ROM hot reloading needs inotify, only Linux builds have it");
+}
+
+void stop_hot_reload(hot_reload_t *reload)
+{
+    (void)reload;
+}
+
+int apply_hot_reload(hot_reload_t *reload, chip8_t *chip8)
+{
+    (void)reload;
+    (void)chip8;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef HOTRELOAD_H_IRISH
+#define HOTRELOAD_H_IRISH
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "chip8.h"
+
+// ROM hot reloading, Linux only
+//
+// A background thread waits on inotify for the ROM file to be written or
+// replaced, reads the new image and hands it to the main loop. The main loop
+// swaps it into RAM at the entrypoint at the start of its next frame and
+// restarts the machine, the window, renderer and everything else stay as they
+// are. Only whole writes are picked up (closed after writing, or renamed over
+// the ROM), so a half saved ROM is never loaded.
+
+typedef struct
+{
+    pthread_t thread;
+    bool running;
+    int inotifyFd;
+    int stopPipe[2];                // written once to wake the thread up to exit
+    const char *path;               // the machine's romPath
+    const char *fileName;           // the ROM's name in its directory, inotify watches the directory
+
+    // Newest image, written by the thread and taken by the main loop under lock
+    pthread_mutex_t lock;
+    uint8_t *image;
+    uint32_t size;
+    uint32_t capacity;              // bytes after the entrypoint, bigger ROMs are refused
+    uint64_t changedAt;             // Time_Now_NS() the change was seen at
+    atomic_bool pending;            // image holds a ROM the main loop hasn't taken yet
+
+    uint64_t reloads;
+} hot_reload_t;
+
+// Watch chip8's ROM file, chip8 must be initialized
+//
+// Returns
+//      0           -> success
+//      *           -> anything else on failure
+int start_hot_reload(hot_reload_t *reload, const chip8_t *chip8);
+void stop_hot_reload(hot_reload_t *reload);
+
+// Whether the ROM changed since it was last loaded, one atomic load so it can
+// be polled every frame
+static inline bool hot_reload_pending(hot_reload_t *reload)
+{
+    return atomic_load_explicit(&reload->pending, memory_order_acquire);
+}
+
+// Copy the changed ROM into RAM and restart the machine, like a power cycle
+// with the new ROM inserted. The flag registers and the random number generator
+// are kept.
+//
+// Returns
+//      0           -> success
+//      *           -> anything else when the new ROM doesn't fit, the machine is unchanged
+int apply_hot_reload(hot_reload_t *reload, chip8_t *chip8);
+
+#endif
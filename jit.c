@@ -0,0 +1,633 @@
+// mmap() and MAP_ANONYMOUS are not part of -std=c17
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "jit.h"
+#include "cpu.h"
+#include "chip8.h"
+#include "helpers/logging.h"
+
+#if CHIP8_JIT
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Translation scheme
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+// A block is the straight-line run of instructions starting at some PC, up to and
+// including the first one that changes PC (JP, CALL, RET, JP V0, skips, LD Vx K),
+// draws (DRW) or writes RAM (LD B, LD [I]). It is emitted as a System V function
+// int block(chip8_t *chip8) that keeps the machine pointer in rbx.
+//
+// Chip-8 registers are used directly as [rbx + offset] memory operands rather than
+// being loaded into host registers: blocks are short, the machine is hot in L1,
+// and the interpreter helpers called in the middle of a block see the registers
+// without any spilling. ALU, load, timer and skip instructions are emitted
+// natively; everything that needs the display, stack, keypad wait or the random
+// number generator calls back into the interpreter's handler.
+//
+// Blocks end with PC set to the next instruction, so between blocks the machine
+// is in exactly the state the interpreter would leave it in.
+
+// Room for the longest instruction sequence emitted for one Chip-8 instruction
+#define MAX_INSTRUCTION_BYTES 48
+#define MAX_BLOCK_BYTES ((JIT_MAX_BLOCK * MAX_INSTRUCTION_BYTES) + 32)
+
+// x86-64 register numbers
+#define REG_EAX 0
+#define REG_ECX 1
+#define REG_EDX 2
+
+// Offsets of the machine state from the chip8_t pointer in rbx
+#define OFF_V(x)    ((uint32_t)(offsetof(chip8_t, reg.Vx) + (x)))
+#define OFF_VF      OFF_V(0xF)
+#define OFF_I       ((uint32_t)offsetof(chip8_t, reg.I))
+#define OFF_DT      ((uint32_t)offsetof(chip8_t, reg.DT))
+#define OFF_ST      ((uint32_t)offsetof(chip8_t, reg.ST))
+#define OFF_PC      ((uint32_t)offsetof(chip8_t, reg.PC))
+#define OFF_KEYPAD  ((uint32_t)offsetof(chip8_t, keypad))
+
+typedef struct
+{
+    uint8_t *pos;           // next byte of the arena to write
+} emitter_t;
+
+static inline void emit8(emitter_t *e, uint8_t byte)
+{
+    *e->pos++ = byte;
+}
+
+static inline void emit16(emitter_t *e, uint16_t value)
+{
+    memcpy(e->pos, &value, sizeof(value));
+    e->pos += sizeof(value);
+}
+
+static inline void emit32(emitter_t *e, uint32_t value)
+{
+    memcpy(e->pos, &value, sizeof(value));
+    e->pos += sizeof(value);
+}
+
+static inline void emit64(emitter_t *e, uint64_t value)
+{
+    memcpy(e->pos, &value, sizeof(value));
+    e->pos += sizeof(value);
+}
+
+// ModRM + disp32 addressing [rbx + offset]
+static inline void emit_mem(emitter_t *e, uint8_t reg, uint32_t offset)
+{
+    emit8(e, 0x80 | (reg << 3) | 0x03);
+    emit32(e, offset);
+}
+
+// movzx reg32, byte [rbx + offset]
+static void emit_load8(emitter_t *e, uint8_t reg, uint32_t offset)
+{
+    emit8(e, 0x0F); emit8(e, 0xB6); emit_mem(e, reg, offset);
+}
+
+// mov byte [rbx + offset], reg8
+static void emit_store8(emitter_t *e, uint8_t reg, uint32_t offset)
+{
+    emit8(e, 0x88); emit_mem(e, reg, offset);
+}
+
+// mov byte [rbx + offset], imm8
+static void emit_store8_imm(emitter_t *e, uint32_t offset, uint8_t value)
+{
+    emit8(e, 0xC6); emit_mem(e, 0, offset); emit8(e, value);
+}
+
+// mov word [rbx + offset], reg16
+static void emit_store16(emitter_t *e, uint8_t reg, uint32_t offset)
+{
+    emit8(e, 0x66); emit8(e, 0x89); emit_mem(e, reg, offset);
+}
+
+// mov word [rbx + offset], imm16
+static void emit_store16_imm(emitter_t *e, uint32_t offset, uint16_t value)
+{
+    emit8(e, 0x66); emit8(e, 0xC7); emit_mem(e, 0, offset); emit16(e, value);
+}
+
+// mov reg32, imm32
+static void emit_mov_imm(emitter_t *e, uint8_t reg, uint32_t value)
+{
+    emit8(e, 0xB8 + reg); emit32(e, value);
+}
+
+// Vx = Vx <op> Vy for the 8-bit ALU opcodes (08 or, 20 and, 30 xor)
+static void emit_alu(emitter_t *e, uint8_t aluOpcode, uint8_t x, uint8_t y)
+{
+    emit_load8(e, REG_EAX, OFF_V(x));
+    emit_load8(e, REG_ECX, OFF_V(y));
+    emit8(e, aluOpcode); emit8(e, 0xC8);            // <op> al, cl
+    emit_store8(e, REG_EAX, OFF_V(x));
+}
+
+// Store al into Vx then dl into VF, VF is written last like the interpreter
+static void emit_store_flag(emitter_t *e, uint8_t x)
+{
+    emit_store8(e, REG_EAX, OFF_V(x));
+    emit_store8(e, REG_EDX, OFF_VF);
+}
+
+// PC = condition ? pc + 4 : pc + 2, condition is the cmovcc opcode (44 e, 45 ne)
+// applied to the flags of the preceding compare
+static void emit_skip(emitter_t *e, uint8_t cmovcc, uint16_t pc)
+{
+    emit_mov_imm(e, REG_EDX, pc + 2);
+    emit_mov_imm(e, REG_ECX, pc + 4);
+    emit8(e, 0x0F); emit8(e, cmovcc); emit8(e, 0xD1);     // cmovcc edx, ecx
+    emit_store16(e, REG_EDX, OFF_PC);
+}
+
+// cmp byte [rbx + keypad + (Vx & 0xF)], 0
+static void emit_test_key(emitter_t *e, uint8_t x)
+{
+    emit_load8(e, REG_EAX, OFF_V(x));
+    emit8(e, 0x83); emit8(e, 0xE0); emit8(e, 0x0F);       // and eax, 0xF
+    emit8(e, 0x80); emit8(e, 0xBC); emit8(e, 0x03);       // cmp byte [rbx + rax + disp32], imm8
+    emit32(e, OFF_KEYPAD);
+    emit8(e, 0x00);
+}
+
+// Run one instruction with the interpreter's handler, PC is set past it first
+// as the interpreter would have. Returns out of the block on a fatal error.
+static void emit_interpret(emitter_t *e, uint16_t pc, uint16_t opcode)
+{
+    emit_store16_imm(e, OFF_PC, pc + 2);
+    emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xDF);       // mov rdi, rbx
+    emit_mov_imm(e, 6, opcode);                           // mov esi, opcode
+    emit8(e, 0x48); emit8(e, 0xB8);                       // mov rax, execute_instruction
+    emit64(e, (uint64_t)(uintptr_t)&execute_instruction);
+    emit8(e, 0xFF); emit8(e, 0xD0);                       // call rax
+    emit8(e, 0x85); emit8(e, 0xC0);                       // test eax, eax
+    emit8(e, 0x74); emit8(e, 0x02);                       // jz +2
+    emit8(e, 0x5B);                                       // pop rbx
+    emit8(e, 0xC3);                                       // ret
+}
+
+static void emit_prologue(emitter_t *e)
+{
+    emit8(e, 0x53);                                       // push rbx, also aligns the stack
+    emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xFB);       // mov rbx, rdi
+}
+
+static void emit_epilogue(emitter_t *e)
+{
+    emit8(e, 0x31); emit8(e, 0xC0);                       // xor eax, eax
+    emit8(e, 0x5B);                                       // pop rbx
+    emit8(e, 0xC3);                                       // ret
+}
+
+// Emit one instruction, returns true when it ends the block
+static bool translate_instruction(emitter_t *e, uint16_t pc, uint16_t opcode)
+{
+    const uint8_t x = (opcode >> 8) & 0x0F;
+    const uint8_t y = (opcode >> 4) & 0x0F;
+    const uint8_t kk = opcode & 0xFF;
+    const uint16_t nnn = opcode & 0x0FFF;
+
+    switch (decode_opcode(opcode, MODE_CHIP8))
+    {
+        case OP_JP:
+            emit_store16_imm(e, OFF_PC, nnn);
+            return true;
+
+        case OP_SE_VX_KK:
+        case OP_SNE_VX_KK:
+            emit8(e, 0x80); emit_mem(e, 7, OFF_V(x)); emit8(e, kk);     // cmp byte [Vx], kk
+            emit_skip(e, decode_opcode(opcode, MODE_CHIP8) == OP_SE_VX_KK ? 0x44 : 0x45, pc);
+            return true;
+
+        case OP_SE_VX_VY:
+        case OP_SNE_VX_VY:
+            emit_load8(e, REG_EAX, OFF_V(x));
+            emit8(e, 0x3A); emit_mem(e, REG_EAX, OFF_V(y));             // cmp al, byte [Vy]
+            emit_skip(e, decode_opcode(opcode, MODE_CHIP8) == OP_SE_VX_VY ? 0x44 : 0x45, pc);
+            return true;
+
+        case OP_SKP:
+        case OP_SKNP:
+            emit_test_key(e, x);
+            emit_skip(e, decode_opcode(opcode, MODE_CHIP8) == OP_SKP ? 0x45 : 0x44, pc);
+            return true;
+
+        case OP_LD_VX_KK:
+            emit_store8_imm(e, OFF_V(x), kk);
+            return false;
+
+        case OP_ADD_VX_KK:
+            emit8(e, 0x80); emit_mem(e, 0, OFF_V(x)); emit8(e, kk);     // add byte [Vx], kk
+            return false;
+
+        case OP_LD_VX_VY:
+            emit_load8(e, REG_EAX, OFF_V(y));
+            emit_store8(e, REG_EAX, OFF_V(x));
+            return false;
+
+        case OP_OR:  emit_alu(e, 0x08, x, y); return false;
+        case OP_AND: emit_alu(e, 0x20, x, y); return false;
+        case OP_XOR: emit_alu(e, 0x30, x, y); return false;
+
+        case OP_ADD_VX_VY:
+            emit_load8(e, REG_EAX, OFF_V(x));
+            emit_load8(e, REG_ECX, OFF_V(y));
+            emit8(e, 0x00); emit8(e, 0xC8);                 // add al, cl
+            emit8(e, 0x0F); emit8(e, 0x92); emit8(e, 0xC2); // setc dl
+            emit_store_flag(e, x);
+            return false;
+
+        case OP_SUB:
+        case OP_SUBN:
+            // SUB is Vx - Vy, SUBN is Vy - Vx, both store into Vx
+            emit_load8(e, REG_EAX, OFF_V(decode_opcode(opcode, MODE_CHIP8) == OP_SUB ? x : y));
+            emit_load8(e, REG_ECX, OFF_V(decode_opcode(opcode, MODE_CHIP8) == OP_SUB ? y : x));
+            emit8(e, 0x28); emit8(e, 0xC8);                 // sub al, cl
+            emit8(e, 0x0F); emit8(e, 0x93); emit8(e, 0xC2); // setnc dl
+            emit_store_flag(e, x);
+            return false;
+
+        case OP_SHR:
+        case OP_SHL:
+            emit_load8(e, REG_EAX, OFF_V(x));
+            emit8(e, 0xD0); emit8(e, decode_opcode(opcode, MODE_CHIP8) == OP_SHR ? 0xE8 : 0xE0);   // shr/shl al, 1
+            emit8(e, 0x0F); emit8(e, 0x92); emit8(e, 0xC2); // setc dl
+            emit_store_flag(e, x);
+            return false;
+
+        case OP_LD_I:
+            emit_store16_imm(e, OFF_I, nnn);
+            return false;
+
+        case OP_ADD_I_VX:
+            emit_load8(e, REG_EAX, OFF_V(x));
+            emit8(e, 0x66); emit8(e, 0x01); emit_mem(e, REG_EAX, OFF_I);  // add word [I], ax
+            return false;
+
+        case OP_LD_F_VX:
+            emit_load8(e, REG_EAX, OFF_V(x));
+            emit8(e, 0x83); emit8(e, 0xE0); emit8(e, 0x0F);               // and eax, 0xF
+            emit8(e, 0x6B); emit8(e, 0xC0); emit8(e, 5);                  // imul eax, eax, 5
+            emit8(e, 0x05); emit32(e, FONT_ADDRESS);                      // add eax, FONT_ADDRESS
+            emit_store16(e, REG_EAX, OFF_I);
+            return false;
+
+        case OP_LD_VX_DT:
+            emit_load8(e, REG_EAX, OFF_DT);
+            emit_store8(e, REG_EAX, OFF_V(x));
+            return false;
+
+        case OP_LD_DT_VX:
+        case OP_LD_ST_VX:
+            emit_load8(e, REG_EAX, OFF_V(x));
+            emit_store8(e, REG_EAX, decode_opcode(opcode, MODE_CHIP8) == OP_LD_DT_VX ? OFF_DT : OFF_ST);
+            return false;
+
+        // Interpreted, the block goes on after these
+        case OP_CLS:
+        case OP_RND:
+        case OP_LD_VX_I:
+        case OP_INVALID:
+        case OP_UNDECODED:
+            emit_interpret(e, pc, opcode);
+            return false;
+
+        // Interpreted and end the block, they change PC, draw or write RAM
+        // (possibly the RAM of this very block)
+        case OP_RET:
+        case OP_CALL:
+        case OP_JP_V0:
+        case OP_DRW:
+        case OP_LD_VX_K:
+        case OP_LD_B_VX:
+        case OP_LD_I_VX:
+        default:
+            emit_interpret(e, pc, opcode);
+            return true;
+    }
+}
+
+// Throw away every translated block
+static void flush_jit(jit_t *jit)
+{
+    jit->used = 0;
+    memset(jit->blocks, 0, sizeof(jit->blocks));
+    memset(jit->translated, 0, sizeof(jit->translated));
+    jit->flushes++;
+}
+
+// Change the protection of the arena pages holding [code, code + size)
+static int protect_arena(uint8_t *code, size_t size, int prot)
+{
+    const uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+    const uintptr_t first = (uintptr_t)code & ~(pageSize - 1);
+    const uintptr_t last = ((uintptr_t)code + size + pageSize - 1) & ~(pageSize - 1);
+    return mprotect((void*)first, last - first, prot);
+}
+
+// Translate the block starting at PC, which must be a valid instruction address
+//
+// Returns
+//      NULL        -> the arena's protection couldn't be changed
+static jit_block_t *translate_block(jit_t *jit, const chip8_t *chip8, uint16_t start)
+{
+    if (jit->used + MAX_BLOCK_BYTES > JIT_ARENA_SIZE)
+        flush_jit(jit);
+
+    // The pages the block goes into are only writable while it is emitted,
+    // code is never writable and executable at the same time
+    uint8_t *code = jit->arena + jit->used;
+    if (protect_arena(code, MAX_BLOCK_BYTES, PROT_READ | PROT_WRITE) != 0)
+    {
+        Log_Err("Unable to make the JIT arena writable");
+        return NULL;
+    }
+    emitter_t e = { .pos = code };
+    emit_prologue(&e);
+
+    uint16_t pc = start;
+    uint16_t count = 0;
+    bool ended = false;
+    while (!ended && count < JIT_MAX_BLOCK && pc < CODE_SIZE - 1)
+    {
+        uint16_t opcode = chip8->ram[pc] << 8 | chip8->ram[pc + 1];
+        ended = translate_instruction(&e, pc, opcode);
+        pc += 2;
+        count++;
+    }
+
+    // Fell through the end of the block, continue with the next instruction
+    if (!ended)
+        emit_store16_imm(&e, OFF_PC, pc);
+    emit_epilogue(&e);
+
+    if (protect_arena(code, MAX_BLOCK_BYTES, PROT_READ | PROT_EXEC) != 0)
+    {
+        Log_Err("Unable to make the JIT arena executable");
+        return NULL;
+    }
+
+    jit->used += (uint32_t)(e.pos - code);
+    memset(&jit->translated[start], 1, pc - start);
+    jit->blocksTranslated++;
+
+    jit_block_t *block = &jit->blocks[start >> 1];
+    block->code = (jit_code_t)(void*)code;
+    block->cycles = count;
+    return block;
+}
+
+// Describe the first difference between two machines, NULL when they match
+static const char *compare_machines(const chip8_t *a, const chip8_t *b, char *buf, size_t size)
+{
+    for (int i=0; i<16; i++)
+    {
+        if (a->reg.Vx[i] != b->reg.Vx[i])
+        {
+            snprintf(buf, size, "V%1X: jit 0x%02X, interpreter 0x%02X", i, a->reg.Vx[i], b->reg.Vx[i]);
+            return buf;
+        }
+    }
+    if (a->reg.I != b->reg.I)
+        snprintf(buf, size, "I: jit 0x%04X, interpreter 0x%04X", a->reg.I, b->reg.I);
+    else if (a->reg.PC != b->reg.PC)
+        snprintf(buf, size, "PC: jit 0x%04X, interpreter 0x%04X", a->reg.PC, b->reg.PC);
+    else if (a->reg.SP != b->reg.SP)
+        snprintf(buf, size, "SP: jit %i, interpreter %i", a->reg.SP, b->reg.SP);
+    else if (a->reg.DT != b->reg.DT || a->reg.ST != b->reg.ST)
+        snprintf(buf, size, "DT/ST: jit 0x%02X/0x%02X, interpreter 0x%02X/0x%02X", a->reg.DT, a->reg.ST, b->reg.DT, b->reg.ST);
+    else if (memcmp(a->stack, b->stack, sizeof(a->stack)) != 0)
+        snprintf(buf, size, "stack contents");
+    else if (a->rngState != b->rngState)
+        snprintf(buf, size, "random number generator state");
+    else if (memcmp(a->display, b->display, a->displaySize) != 0)
+        snprintf(buf, size, "display contents");
+    else if (memcmp(a->ram, b->ram, sizeof(a->ram)) != 0)
+    {
+        uint32_t address = 0;
+        while (a->ram[address] == b->ram[address])
+            address++;
+        snprintf(buf, size, "RAM[0x%04X]: jit 0x%02X, interpreter 0x%02X", address, a->ram[address], b->ram[address]);
+    }
+    else
+        return NULL;
+
+    return buf;
+}
+
+// Run the same instructions on the shadow machine with the interpreter and
+// compare the results
+static int verify_step(jit_t *jit, const chip8_t *chip8, uint16_t pc, uint32_t cycles, int status)
+{
+    int shadowStatus = run_cycles_interpreter(jit->shadow, cycles);
+
+    char buf[96];
+    const char *difference = compare_machines(chip8, jit->shadow, buf, sizeof(buf));
+    if (difference == NULL && status == shadowStatus)
+        return 0;
+
+    Log_Err("JIT and interpreter disagree after %u instructions from: 0x%04X", cycles, pc);
+    if (difference != NULL)
+        Log_Err_Detail("%s", difference);
+    else
+        Log_Err_Detail("Status: jit %i, interpreter %i", status, shadowStatus);
+    return 1;
+}
+
+int init_jit(jit_t *jit, const chip8_t *chip8, bool verify)
+{
+    *jit = (jit_t) {0};
+
+    // translate_instruction() decodes CHIP-8 opcodes with the modern quirks
+    if (chip8->mode != MODE_CHIP8 || chip8->quirks != QUIRKS_MODERN)
+        return Log_Err("The JIT only supports '--mode chip8 --quirks modern'");
+
+    // Mapped read/write, translate_block() turns the pages of each block
+    // read/execute once it is emitted
+    jit->arena = mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->arena == MAP_FAILED)
+    {
+        jit->arena = NULL;
+        return Log_Err("Unable to map %i [bytes] of memory for the JIT", JIT_ARENA_SIZE);
+    }
+    Log_Info("Mapped %i [bytes] of executable memory for the JIT", JIT_ARENA_SIZE);
+
+    if (!verify)
+        return 0;
+
+    // The shadow starts as an exact copy, with its own display and without the JIT
+    jit->shadow = (chip8_t*) aligned_alloc(_Alignof(chip8_t), sizeof(chip8_t));
+    if (jit->shadow == NULL)
+        return Log_Err("Unable to allocate dynamic memory for the lockstep interpreter");
+
+    *jit->shadow = *chip8;
+    jit->shadow->jit = NULL;
+    jit->shadow->trace = NULL;
+    jit->shadow->display = (uint64_t*) malloc(chip8->displayCapacity);
+    if (jit->shadow->display == NULL)
+        return Log_Err("Unable to allocate dynamic memory for the lockstep interpreter display");
+    memcpy(jit->shadow->display, chip8->display, chip8->displayCapacity);
+
+    Log_Info("JIT verification enabled, the interpreter runs in lockstep");
+    return 0;
+}
+
+void destroy_jit(jit_t *jit)
+{
+    if (jit->arena != NULL)
+        munmap(jit->arena, JIT_ARENA_SIZE);
+    jit->arena = NULL;
+
+    if (jit->shadow != NULL)
+    {
+        free(jit->shadow->display);
+        free(jit->shadow);
+        jit->shadow = NULL;
+    }
+}
+
+void jit_resync(jit_t *jit, const chip8_t *chip8)
+{
+    if (jit->shadow == NULL)
+        return;
+
+    uint64_t *display = jit->shadow->display;
+    *jit->shadow = *chip8;
+    jit->shadow->jit = NULL;
+    jit->shadow->trace = NULL;
+    jit->shadow->display = display;
+    memcpy(jit->shadow->display, chip8->display, chip8->displayCapacity);
+}
+
+void jit_invalidate(jit_t *jit, uint16_t address, uint16_t length)
+{
+    uint32_t end = (uint32_t)address + length;
+    if (end > sizeof(jit->translated))
+        end = sizeof(jit->translated);
+
+    // Writes to data are common, writes to translated code are not. Blocks do
+    // not know which blocks overlap them, so a hit throws all of them away.
+    for (uint32_t i=address; i<end; i++)
+    {
+        if (jit->translated[i])
+        {
+            flush_jit(jit);
+            return;
+        }
+    }
+}
+
+int run_cycles_jit(chip8_t *chip8, uint32_t cycles)
+{
+    jit_t *jit = chip8->jit;
+
+    while (cycles > 0)
+    {
+        const uint16_t pc = chip8->reg.PC;
+
+        // Timers and keypad change between calls, the shadow gets them from here
+        if (jit->shadow != NULL)
+        {
+            memcpy(jit->shadow->keypad, chip8->keypad, sizeof(chip8->keypad));
+            jit->shadow->reg.DT = chip8->reg.DT;
+            jit->shadow->reg.ST = chip8->reg.ST;
+        }
+
+        // Invalid PCs are left to the interpreter to report, traced runs are
+        // interpreted so every instruction is recorded
+        jit_block_t *block = NULL;
+        if (chip8->trace == NULL && pc < CODE_SIZE - 1 && pc % 2 == 0)
+        {
+            block = &jit->blocks[pc >> 1];
+            if (block->code == NULL && (block = translate_block(jit, chip8, pc)) == NULL)
+                return 1;
+
+            // The block doesn't fit what is left of the budget, interpret the rest
+            if (block->cycles > cycles)
+                block = NULL;
+        }
+
+        uint32_t ran;
+        int status;
+        if (block != NULL)
+        {
+            ran = block->cycles;
+            status = block->code(chip8);
+            jit->blocksRun++;
+        }
+        else
+        {
+            ran = cycles;
+            status = run_cycles_interpreter(chip8, cycles);
+        }
+
+        if (jit->shadow != NULL && verify_step(jit, chip8, pc, ran, status) != 0)
+            return 1;
+        if (status != 0)
+            return status;
+
+        cycles -= ran;
+    }
+    return 0;
+}
+
+void print_jit_stats(const jit_t *jit)
+{
+    Log_Info("JIT statistics");
+    Log_Detail("Blocks translated: %llu", (unsigned long long)jit->blocksTranslated);
+    Log_Detail("Blocks run:        %llu", (unsigned long long)jit->blocksRun);
+    Log_Detail("Arena flushes:     %llu", (unsigned long long)jit->flushes);
+    Log_Detail("Arena in use:      %u [bytes]", jit->used);
+}
+
+#else
+
+// Built without the recompiler, --jit is refused at startup
+
+int init_jit(jit_t *jit, const chip8_t *chip8, bool verify)
+{
+    (void)chip8;
+    (void)verify;
+    *jit = (jit_t) {0};
+    return Log_Err("This build has no JIT, rebuild on an x86-64 host without -DCHIP8_JIT=0");
+}
+
+void destroy_jit(jit_t *jit)
+{
+    (void)jit;
+}
+
+void jit_resync(jit_t *jit, const chip8_t *chip8)
+{
+    (void)jit;
+    (void)chip8;
+}
+
+void print_jit_stats(const jit_t *jit)
+{
+    (void)jit;
+}
+
+void jit_invalidate(jit_t *jit, uint16_t address, uint16_t length)
+{
+    (void)jit;
+    (void)address;
+    (void)length;
+}
+
+int run_cycles_jit(chip8_t *chip8, uint32_t cycles)
+{
+    return run_cycles_interpreter(chip8, cycles);
+}
+
+#endif
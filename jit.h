@@ -0,0 +1,77 @@
+#ifndef JIT_H_IRISH
+#define JIT_H_IRISH
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+
+// x86-64 basic block recompiler, build with -DCHIP8_JIT=0 to compile it out.
+// Only available on x86-64 System V hosts (Linux, BSD, macOS).
+#ifndef CHIP8_JIT
+#   if defined(__x86_64__) && !defined(_WIN32)
+#       define CHIP8_JIT 1
+#   else
+#       define CHIP8_JIT 0
+#   endif
+#endif
+
+#if CHIP8_JIT && (!defined(__x86_64__) || defined(_WIN32))
+#   error "CHIP8_JIT needs an x86-64 System V host"
+#endif
+
+// Executable memory for translated blocks, flushed as a whole when full
+#define JIT_ARENA_SIZE (1 << 20)
+
+// Longest run of Chip-8 instructions translated into one block
+#define JIT_MAX_BLOCK 64
+
+// Translated block, called with the machine it belongs to
+//
+// Returns
+//      0           -> success
+//      *           -> anything else on fatal emulation error
+typedef int (*jit_code_t)(chip8_t *chip8);
+
+// One entry per even RAM address a block can start at
+typedef struct
+{
+    jit_code_t code;            // NULL -> not translated yet
+    uint16_t cycles;            // Chip-8 instructions the block executes
+} jit_block_t;
+
+typedef struct jit
+{
+    uint8_t *arena;                     // mmap'd memory, read/execute where it holds code
+    uint32_t used;                      // bytes of the arena holding code
+    jit_block_t blocks[4096/2];         // translated block per even RAM address
+    uint8_t translated[4096];           // 1 -> RAM byte is part of a translated block
+
+    chip8_t *shadow;                    // interpreter run in lockstep, NULL -> not verifying
+
+    uint64_t blocksRun;                 // blocks executed natively
+    uint64_t blocksTranslated;          // blocks translated, including re-translations
+    uint64_t flushes;                   // times the whole arena was thrown away
+} jit_t;
+
+// Set up the recompiler for chip8, with verify the interpreter runs a copy of
+// the machine in lockstep and every block's results are compared with it
+int init_jit(jit_t *jit, const chip8_t *chip8, bool verify);
+void destroy_jit(jit_t *jit);
+void print_jit_stats(const jit_t *jit);
+
+// Copy the machine into the lockstep interpreter again, for when the machine was
+// changed outside of run_cycles_jit(), e.g. a save state was loaded
+void jit_resync(jit_t *jit, const chip8_t *chip8);
+
+// Called by invalidate_decoded() whenever RAM is written
+void jit_invalidate(jit_t *jit, uint16_t address, uint16_t length);
+
+// Run the given number of instructions, translating blocks as they are reached
+//
+// Returns
+//      0           -> success
+//      *           -> anything else on fatal emulation error or a lockstep mismatch
+int run_cycles_jit(chip8_t *chip8, uint32_t cycles);
+
+#endif
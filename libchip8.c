@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libchip8.h"
+#include "chip8.h"
+#include "cpu.h"
+#include "scheduler.h"
+#include "helpers/logging.h"
+
+// The front end loads the text sprites from configs/textSprites.bin, the library
+// has the same ones built in
+static const uint8_t defaultFont[16][5] = {
+    { 0xF0, 0x90, 0x90, 0x90, 0xF0 }, { 0x20, 0x60, 0x20, 0x20, 0x70 },
+    { 0xF0, 0x10, 0xF0, 0x80, 0xF0 }, { 0xF0, 0x10, 0xF0, 0x10, 0xF0 },
+    { 0x90, 0x90, 0xF0, 0x10, 0x10 }, { 0xF0, 0x80, 0xF0, 0x10, 0xF0 },
+    { 0xF0, 0x80, 0xF0, 0x90, 0xF0 }, { 0xF0, 0x10, 0x20, 0x40, 0x40 },
+    { 0xF0, 0x90, 0xF0, 0x90, 0xF0 }, { 0xF0, 0x90, 0xF0, 0x10, 0xF0 },
+    { 0xF0, 0x90, 0xF0, 0x90, 0x90 }, { 0xE0, 0x90, 0xE0, 0x90, 0xE0 },
+    { 0xF0, 0x80, 0x80, 0x80, 0xF0 }, { 0xE0, 0x90, 0x90, 0x90, 0xE0 },
+    { 0xF0, 0x80, 0xF0, 0x80, 0xF0 }, { 0xF0, 0x80, 0xF0, 0x80, 0x80 },
+};
+
+struct libchip8
+{
+    chip8_t chip8;              // first, it is cache line aligned
+    scheduler_t sched;
+    uint32_t seed;              // rngState after a load or reset
+    uint8_t *rom;               // copy of the loaded ROM, NULL -> nothing loaded
+    size_t romSize;
+};
+
+libchip8_t *libchip8_create(const libchip8_options_t *options)
+{
+    const libchip8_options_t defaults = {0};
+    if (options == NULL)
+        options = &defaults;
+
+    if (options->mode >= MODE_COUNT || options->quirks >= QUIRKS_COUNT)
+    {
+        Log_Err("Invalid instruction set %i or quirk profile %i", options->mode, options->quirks);
+        return NULL;
+    }
+
+    // chip8_t is cache line aligned, which calloc() doesn't promise
+    libchip8_t *machine = (libchip8_t*) aligned_alloc(_Alignof(libchip8_t), sizeof(libchip8_t));
+    if (machine == NULL)
+    {
+        Log_Err("Unable to allocate dynamic memory for a libchip8 machine");
+        return NULL;
+    }
+    memset(machine, 0, sizeof(libchip8_t));
+
+    const uint16_t width = options->width != 0 ? options->width : 64;
+    const uint16_t height = options->height != 0 ? options->height : 32;
+    if (setup_machine(&machine->chip8, options->mode, options->quirks, width, height) != 0)
+    {
+        free(machine->chip8.display);
+        free(machine);
+        return NULL;
+    }
+
+    memcpy(machine->chip8.textSprites, defaultFont, sizeof(defaultFont));
+    memcpy(&machine->chip8.ram[FONT_ADDRESS], defaultFont, sizeof(defaultFont));
+    machine->chip8.entrypoint = 0x200;
+    machine->chip8.state = QUIT;            // nothing to run until a ROM is loaded
+
+    // xorshift never leaves a 0 state
+    machine->seed = options->seed != 0 ? options->seed : 1;
+    init_scheduler(&machine->sched, options->cpu_hz != 0 ? options->cpu_hz : LIBCHIP8_DEFAULT_HZ);
+
+    init_dispatch();
+    return machine;
+}
+
+void libchip8_destroy(libchip8_t *machine)
+{
+    if (machine == NULL)
+        return;
+
+    free(machine->chip8.display);
+    free(machine->rom);
+    free(machine);
+}
+
+int libchip8_load_rom(libchip8_t *machine, const uint8_t *rom, size_t size)
+{
+    if (size > machine->chip8.ramSize - machine->chip8.entrypoint)
+        return Log_Err("ROM of %zu [bytes] doesn't fit in RAM", size);
+
+    uint8_t *copy = (uint8_t*) malloc(size != 0 ? size : 1);
+    if (copy == NULL)
+        return Log_Err("Unable to allocate dynamic memory for a copy of the ROM");
+    memcpy(copy, rom, size);
+
+    free(machine->rom);
+    machine->rom = copy;
+    machine->romSize = size;
+    libchip8_reset(machine);
+    return 0;
+}
+
+void libchip8_reset(libchip8_t *machine)
+{
+    if (machine->rom == NULL)
+        return;
+
+    chip8_t *chip8 = &machine->chip8;
+    memcpy(&chip8->ram[FONT_ADDRESS], chip8->textSprites, sizeof(chip8->textSprites));
+    copy_program(chip8, machine->rom, machine->romSize);
+    restart_machine(chip8);
+    chip8->rngState = machine->seed;
+    init_scheduler(&machine->sched, machine->sched.cpu_hz);
+}
+
+// Once the ROM exits, 00FD runs again for the rest of the budget. Only the
+// first one was an instruction of the ROM, the count drops the others.
+static void uncount_exits(libchip8_t *machine, uint32_t exits)
+{
+    const uint32_t repeated = machine->chip8.exits - exits;
+    if (repeated > 1)
+        machine->sched.cycles -= repeated - 1;
+}
+
+int libchip8_run_cycles(libchip8_t *machine, uint32_t cycles)
+{
+    if (machine->chip8.state == QUIT)
+        return 0;
+
+    const uint32_t exits = machine->chip8.exits;
+    if (run_cycles(&machine->chip8, cycles) != 0)
+    {
+        machine->chip8.state = QUIT;
+        return 1;
+    }
+    machine->sched.cycles += cycles;
+    uncount_exits(machine, exits);
+    return 0;
+}
+
+int libchip8_run_frame(libchip8_t *machine)
+{
+    if (machine->chip8.state == QUIT)
+        return 0;
+
+    const uint32_t exits = machine->chip8.exits;
+    if (run_frame(&machine->chip8, &machine->sched, 0) != 0)
+    {
+        machine->chip8.state = QUIT;
+        return 1;
+    }
+    uncount_exits(machine, exits);
+    return 0;
+}
+
+bool libchip8_running(const libchip8_t *machine)
+{
+    return machine->chip8.state != QUIT;
+}
+
+void libchip8_set_key(libchip8_t *machine, uint8_t key, bool down)
+{
+    machine->chip8.keypad[key & 0x0F] = down;
+}
+
+void libchip8_set_keypad(libchip8_t *machine, uint16_t keys)
+{
+    for (uint8_t key=0; key<16; key++)
+        machine->chip8.keypad[key] = (keys >> key) & 0x01;
+}
+
+uint8_t libchip8_sound_timer(const libchip8_t *machine)
+{
+    return machine->chip8.reg.ST;
+}
+
+libchip8_framebuffer_t libchip8_framebuffer(libchip8_t *machine)
+{
+    chip8_t *chip8 = &machine->chip8;
+    const libchip8_framebuffer_t framebuffer = {
+        .planes = chip8->display,
+        .planeWords = chip8->planeWords,
+        .rowWords = chip8->displayWords,
+        .width = chip8->displayX,
+        .height = chip8->displayY,
+        .planeCount = chip8->displayPlanes,
+        .dirty = chip8->displayDirty
+    };
+    chip8->displayDirty = false;
+    return framebuffer;
+}
+
+const chip8_t *libchip8_machine(const libchip8_t *machine)
+{
+    return &machine->chip8;
+}
+
+uint64_t libchip8_cycles(const libchip8_t *machine)
+{
+    return machine->sched.cycles;
+}
+
+uint64_t libchip8_frames(const libchip8_t *machine)
+{
+    return machine->sched.frames;
+}
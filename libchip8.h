@@ -0,0 +1,97 @@
+#ifndef LIBCHIP8_H_IRISH
+#define LIBCHIP8_H_IRISH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+
+// Embeddable Chip-8 core, libchip8.a and libchip8.so
+//
+// Drives a machine without SDL, files or a front end: create it, load a ROM
+// from memory, step it and read its display. Only libchip8_create() and
+// libchip8_load_rom() allocate, stepping, resetting, keys and the framebuffer
+// never do, so a machine can be run for millions of steps at a steady cost.
+// A machine is not thread safe, but separate machines can run on separate threads.
+//
+// Link with -lpthread, the library's logging queue (helpers/logging.h) uses it.
+
+// Instructions per second run by libchip8_run_frame() when none are given
+#define LIBCHIP8_DEFAULT_HZ 700
+
+typedef struct libchip8 libchip8_t;
+
+// Machine options, zero initialized options are a 64x32 modern CHIP-8 at 700Hz
+typedef struct
+{
+    machine_mode_t mode;            // instruction set
+    quirk_profile_t quirks;         // quirk profile, decides the interpreter core
+    uint32_t cpu_hz;                // instructions per libchip8_run_frame() * 60, 0 -> LIBCHIP8_DEFAULT_HZ
+    uint32_t seed;                  // seed of the random number generator, 0 -> 1
+    uint16_t width;                 // low resolution display width, a multiple of 64, 0 -> 64
+    uint16_t height;                // low resolution display height, 0 -> 32
+} libchip8_options_t;
+
+// Read only view of the display, valid until the next step of the machine
+typedef struct
+{
+    const uint64_t *planes;         // planes one after the other, rows packed 1 bit per pixel, leftmost pixel is the MSB
+    uint32_t planeWords;            // 64-bit words per plane
+    uint16_t rowWords;              // 64-bit words per row
+    uint16_t width;                 // pixels per row, twice the low resolution width in high resolution
+    uint16_t height;                // rows
+    uint8_t planeCount;             // 1, or 2 for XO-CHIP
+    bool dirty;                     // changed since the last libchip8_framebuffer()
+} libchip8_framebuffer_t;
+
+// Create a machine with nothing loaded, NULL options -> defaults
+//
+// Returns
+//      machine     -> success, free it with libchip8_destroy()
+//      NULL        -> on failure
+libchip8_t *libchip8_create(const libchip8_options_t *options);
+void libchip8_destroy(libchip8_t *machine);
+
+// Load a ROM from memory and reset the machine to run it, the ROM is copied so
+// the buffer can be freed afterwards
+//
+// Returns
+//      0           -> success
+//      *           -> anything else when the ROM doesn't fit in RAM
+int libchip8_load_rom(libchip8_t *machine, const uint8_t *rom, size_t size);
+
+// Reset the machine to the state libchip8_load_rom() left it in, including the
+// random number generator
+void libchip8_reset(libchip8_t *machine);
+
+// Run instructions without ticking the timers, or one 60Hz frame: the frame's
+// share of cpu_hz followed by one timer tick
+//
+// Returns
+//      0           -> success, also once the ROM has exited, see libchip8_running()
+//      *           -> anything else on fatal emulation error
+int libchip8_run_cycles(libchip8_t *machine, uint32_t cycles);
+int libchip8_run_frame(libchip8_t *machine);
+
+// false once the ROM exited (SUPER-CHIP 00FD) or after a fatal emulation error
+bool libchip8_running(const libchip8_t *machine);
+
+// Press or release key 0x0-0xF, or set all 16 at once from a bit mask, bit n -> key n
+void libchip8_set_key(libchip8_t *machine, uint8_t key, bool down);
+void libchip8_set_keypad(libchip8_t *machine, uint16_t keys);
+
+// Timers for an embedder that plays its own sound while ST > 0
+uint8_t libchip8_sound_timer(const libchip8_t *machine);
+
+libchip8_framebuffer_t libchip8_framebuffer(libchip8_t *machine);
+
+// The whole machine, read only, e.g. for hash_display() and hash_ram()
+const chip8_t *libchip8_machine(const libchip8_t *machine);
+
+// Instructions and complete frames run since the last load or reset, counted
+// up to and including the 00FD the ROM exited with
+uint64_t libchip8_cycles(const libchip8_t *machine);
+uint64_t libchip8_frames(const libchip8_t *machine);
+
+#endif
@@ -0,0 +1,753 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lockstep.h"
+#include "chip8.h"
+#include "cpu.h"
+#include "helpers/logging.h"
+
+// GCC on x86-64 also builds the step loop for AVX2 and picks the copy for the
+// host when the program loads, elsewhere the baseline vectors are used (SSE2, NEON)
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#   define LOCKSTEP_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#   define LOCKSTEP_CLONES
+#endif
+
+// Lane RAMs are a cache line more than 4KB apart, so the same address in
+// different lanes doesn't land in the same cache set
+#define LOCKSTEP_RAM_STRIDE (RAM_SIZE + LOCKSTEP_ALIGN)
+
+// Lanes run on their own for this many instructions when they have diverged
+#define LOCKSTEP_BURST 64
+
+// Register x, stack entry n and display row y of a lane
+#define LANE_V(g, x, l)     ((g)->V[(x) * (g)->stride + (l)])
+#define LANE_STACK(g, n, l) ((g)->stack[(n) * (g)->stride + (l)])
+#define LANE_ROW(g, y, l)   ((g)->display[(y) * (g)->stride + (l)])
+#define LANE_RAM(g, l)      (&(g)->ram[(size_t)(l) * LOCKSTEP_RAM_STRIDE])
+
+// Lane array of arrays, registers V0-VF and stack entries
+#define LANES(g, array, n)  (&(g)->array[(n) * (g)->stride])
+
+// Zeroed lane arrays, the padding lanes stay zero and so never run
+static void *alloc_lanes(size_t bytes)
+{
+    void *lanes = aligned_alloc(LOCKSTEP_ALIGN, bytes);
+    if (lanes != NULL)
+        memset(lanes, 0, bytes);
+    return lanes;
+}
+
+int init_lockstep(lockstep_t *group, const chip8_t *image, uint32_t lanes)
+{
+    memset(group, 0, sizeof(lockstep_t));
+
+    if (image->mode != MODE_CHIP8 || image->displayWords != 1)
+        return Log_Err("The lockstep core only runs the CHIP-8 instruction set on a 64 pixel wide display");
+    if (lanes == 0)
+        return Log_Err("The lockstep core needs at least one lane");
+
+    group->lanes = lanes;
+    group->stride = (lanes + LOCKSTEP_ALIGN - 1) / LOCKSTEP_ALIGN * LOCKSTEP_ALIGN;
+    group->quirkBits = quirk_bits(image->quirks);
+    group->entrypoint = image->entrypoint;
+    group->height = image->displayY;
+
+    const size_t stride = group->stride;
+    group->V = alloc_lanes(16 * stride);
+    group->I = alloc_lanes(stride * sizeof(uint16_t));
+    group->PC = alloc_lanes(stride * sizeof(uint16_t));
+    group->DT = alloc_lanes(stride);
+    group->ST = alloc_lanes(stride);
+    group->SP = alloc_lanes(stride);
+    group->stack = alloc_lanes(16 * stride * sizeof(uint16_t));
+    group->keys = alloc_lanes(stride * sizeof(uint16_t));
+    group->rng = alloc_lanes(stride * sizeof(uint32_t));
+    group->remaining = alloc_lanes(stride * sizeof(uint32_t));
+    group->running = alloc_lanes(stride);
+    group->active = alloc_lanes(stride);
+    group->display = alloc_lanes(group->height * stride * sizeof(uint64_t));
+    group->ram = alloc_lanes(stride * LOCKSTEP_RAM_STRIDE);
+    group->activeList = alloc_lanes(stride * sizeof(uint32_t));
+    if (group->V == NULL || group->I == NULL || group->PC == NULL || group->DT == NULL || group->ST == NULL ||
+        group->SP == NULL || group->stack == NULL || group->keys == NULL || group->rng == NULL ||
+        group->remaining == NULL || group->running == NULL || group->active == NULL || group->display == NULL ||
+        group->ram == NULL || group->activeList == NULL)
+    {
+        destroy_lockstep(group);
+        return Log_Err("Unable to allocate dynamic memory for %u lockstep lanes", lanes);
+    }
+
+    memcpy(group->image, image->ram, RAM_SIZE);
+    for (uint32_t addr=0; addr<RAM_SIZE; addr+=2)
+        group->ops[addr / 2] = decode_opcode(group->image[addr] << 8 | group->image[addr + 1], MODE_CHIP8);
+
+    uint16_t keys = 0;
+    for (uint8_t key=0; key<16; key++)
+        keys |= (uint16_t)image->keypad[key] << key;
+
+    for (uint32_t l=0; l<lanes; l++)
+    {
+        for (uint8_t x=0; x<16; x++)
+            LANE_V(group, x, l) = image->reg.Vx[x];
+        for (uint8_t n=0; n<16; n++)
+            LANE_STACK(group, n, l) = image->stack[n];
+        for (uint16_t y=0; y<group->height; y++)
+            LANE_ROW(group, y, l) = image->display[y];
+
+        group->I[l] = image->reg.I;
+        group->PC[l] = image->reg.PC;
+        group->DT[l] = image->reg.DT;
+        group->ST[l] = image->reg.ST;
+        group->SP[l] = image->reg.SP;
+        group->keys[l] = keys;
+        group->rng[l] = image->rngState + l != 0 ? image->rngState + l : 1;
+        group->running[l] = image->state != QUIT;
+        memcpy(LANE_RAM(group, l), image->ram, RAM_SIZE);
+    }
+
+    return 0;
+}
+
+void destroy_lockstep(lockstep_t *group)
+{
+    free(group->V);
+    free(group->I);
+    free(group->PC);
+    free(group->DT);
+    free(group->ST);
+    free(group->SP);
+    free(group->stack);
+    free(group->keys);
+    free(group->rng);
+    free(group->remaining);
+    free(group->running);
+    free(group->active);
+    free(group->display);
+    free(group->ram);
+    free(group->activeList);
+    memset(group, 0, sizeof(lockstep_t));
+}
+
+void set_lockstep_keys(lockstep_t *group, uint32_t lane, uint16_t keys)
+{
+    if (lane < group->lanes)
+        group->keys[lane] = keys;
+}
+
+bool lockstep_running(const lockstep_t *group, uint32_t lane)
+{
+    return lane < group->lanes && group->running[lane];
+}
+
+void tick_lockstep_timers(lockstep_t *group)
+{
+    uint8_t *restrict DT = group->DT;
+    uint8_t *restrict ST = group->ST;
+    for (uint32_t l=0; l<group->stride; l++)
+    {
+        DT[l] -= DT[l] != 0;
+        ST[l] -= ST[l] != 0;
+    }
+}
+
+void export_lockstep_lane(const lockstep_t *group, uint32_t lane, chip8_t *chip8)
+{
+    for (uint8_t x=0; x<16; x++)
+        chip8->reg.Vx[x] = LANE_V(group, x, lane);
+    for (uint8_t n=0; n<16; n++)
+        chip8->stack[n] = LANE_STACK(group, n, lane);
+    for (uint16_t y=0; y<group->height; y++)
+        chip8->display[y] = LANE_ROW(group, y, lane);
+    for (uint8_t key=0; key<16; key++)
+        chip8->keypad[key] = (group->keys[lane] >> key) & 0x01;
+
+    chip8->reg.I = group->I[lane];
+    chip8->reg.PC = group->PC[lane];
+    chip8->reg.DT = group->DT[lane];
+    chip8->reg.ST = group->ST[lane];
+    chip8->reg.SP = group->SP[lane];
+    chip8->rngState = group->rng[lane];
+    chip8->state = group->running[lane] ? RUNNING : QUIT;
+    chip8->displayDirty = true;
+    memcpy(chip8->ram, LANE_RAM(group, lane), RAM_SIZE);
+    invalidate_decoded(chip8, 0, CODE_SIZE);
+}
+
+void print_lockstep_stats(const lockstep_t *group)
+{
+    const uint64_t groupSteps = group->vectorLaneSteps + group->sharedLaneSteps;
+    const uint64_t laneSteps = groupSteps + group->scalarLaneSteps;
+    const double percent = laneSteps != 0 ? 100.0 / laneSteps : 0.0;
+    Log_Info("Lockstep core, %u lanes", group->lanes);
+    Log_Detail("Group steps:      %llu, %.1f lanes per step", (unsigned long long)group->steps,
+        group->steps != 0 ? (double)groupSteps / group->steps : 0.0);
+    Log_Detail("In lockstep:      %llu (%.1f%%)", (unsigned long long)group->vectorLaneSteps,
+        percent * group->vectorLaneSteps);
+    Log_Detail("Lane by lane:     %llu (%.1f%%)", (unsigned long long)group->sharedLaneSteps,
+        percent * group->sharedLaneSteps);
+    Log_Detail("Diverged:         %llu (%.1f%%)", (unsigned long long)group->scalarLaneSteps,
+        percent * group->scalarLaneSteps);
+}
+
+
+// Lane instructions
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+// One instruction of one lane, the same behavior as the handlers in cpu.c
+
+// Stop a lane on a fatal error, the other lanes carry on
+static void fail_lane(lockstep_t *group, uint32_t lane)
+{
+    group->running[lane] = 0;
+    group->remaining[lane] = 0;
+    Log_Err("Lane %u stopped at 0x%04X", lane, group->PC[lane]);
+}
+
+// Note RAM a lane stored to, opcodes there are no longer the image's
+static inline void mark_written(lockstep_t *group, uint16_t address, uint16_t length)
+{
+    for (uint16_t a=address; a<address+length; a++)
+        group->written[a / 64] |= 1ull << (a % 64);
+}
+
+static inline bool is_written(const lockstep_t *group, uint16_t address)
+{
+    return (group->written[address / 64] >> (address % 64)) & 0x01;
+}
+
+static inline bool range_written(const lockstep_t *group, uint16_t address, uint16_t length)
+{
+    for (uint16_t a=address; a<address+length; a++)
+        if (is_written(group, a & (RAM_SIZE - 1)))
+            return true;
+    return false;
+}
+
+static inline uint64_t rotr64(uint64_t value, unsigned shift)
+{
+    shift &= 63;
+    return (value >> shift) | (value << ((64 - shift) & 63));
+}
+
+static inline uint8_t next_random(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (uint8_t)(x >> 24);
+}
+
+// 0xDxyn for one lane, the display is 64 pixels wide so a row is one word
+static void draw_lane(lockstep_t *group, uint32_t l, uint8_t x, uint8_t y, uint8_t n)
+{
+    // Sprites no lane stored to are read from the image, one copy for every lane
+    const uint8_t *ram = range_written(group, group->I[l], n) ? LANE_RAM(group, l) : group->image;
+    const uint16_t height = group->height;
+    const bool wrap = !(group->quirkBits & QUIRK_CLIP);
+    const unsigned start_x = LANE_V(group, x, l) % 64;
+    const unsigned start_y = LANE_V(group, y, l) % height;
+    bool collision = false;
+
+    for (unsigned row=0; row<n; row++)
+    {
+        unsigned disp_y = start_y + row;
+        if (disp_y >= height)
+        {
+            if (!wrap)
+                break;
+            disp_y -= height;
+        }
+
+        const uint64_t pixels = (uint64_t)ram[(group->I[l] + row) & (RAM_SIZE - 1)] << 56;
+        const uint64_t shifted = wrap ? rotr64(pixels, start_x) : pixels >> start_x;
+        uint64_t *line = &LANE_ROW(group, disp_y, l);
+        collision |= (*line & shifted) != 0;
+        *line ^= shifted;
+    }
+    LANE_V(group, 0xF, l) = collision;
+}
+
+static void execute_lane(lockstep_t *group, uint32_t l, uint16_t opcode, opcode_id_t op)
+{
+    const uint8_t x = (opcode >> 8) & 0x0F;
+    const uint8_t y = (opcode >> 4) & 0x0F;
+    const uint8_t n = opcode & 0x0F;
+    const uint8_t kk = opcode & 0xFF;
+    const uint16_t nnn = opcode & 0x0FFF;
+    const uint32_t quirks = group->quirkBits;
+    uint8_t *ram = LANE_RAM(group, l);
+    uint8_t *vf = &LANE_V(group, 0xF, l);
+    uint8_t *vx = &LANE_V(group, x, l);
+    const uint8_t vy = LANE_V(group, y, l);
+    uint16_t *pc = &group->PC[l];
+
+    *pc += 2;
+    switch (op)
+    {
+        case OP_CLS:
+            for (uint16_t row=0; row<group->height; row++)
+                LANE_ROW(group, row, l) = 0;
+            break;
+        case OP_RET:
+            if (group->SP[l] == 0)
+            {
+                Log_Err("Stack underflow, return with empty stack at: 0x%04X", *pc - 2);
+                fail_lane(group, l);
+                return;
+            }
+            *pc = LANE_STACK(group, group->SP[l], l);
+            group->SP[l]--;
+            break;
+        case OP_JP:         *pc = nnn; break;
+        case OP_CALL:
+            if (group->SP[l] >= 15)
+            {
+                Log_Err("Stack overflow, call to 0x%04X at: 0x%04X", nnn, *pc - 2);
+                fail_lane(group, l);
+                return;
+            }
+            group->SP[l]++;
+            LANE_STACK(group, group->SP[l], l) = *pc;
+            *pc = nnn;
+            break;
+        case OP_SE_VX_KK:   *pc += (*vx == kk) ? 2 : 0; break;
+        case OP_SNE_VX_KK:  *pc += (*vx != kk) ? 2 : 0; break;
+        case OP_SE_VX_VY:   *pc += (*vx == vy) ? 2 : 0; break;
+        case OP_SNE_VX_VY:  *pc += (*vx != vy) ? 2 : 0; break;
+        case OP_LD_VX_KK:   *vx = kk; break;
+        case OP_ADD_VX_KK:  *vx += kk; break;
+        case OP_LD_VX_VY:   *vx = vy; break;
+        case OP_OR:         *vx |= vy; if (quirks & QUIRK_VF_RESET) *vf = 0; break;
+        case OP_AND:        *vx &= vy; if (quirks & QUIRK_VF_RESET) *vf = 0; break;
+        case OP_XOR:        *vx ^= vy; if (quirks & QUIRK_VF_RESET) *vf = 0; break;
+        case OP_ADD_VX_VY:
+        {
+            const uint16_t sum = *vx + vy;
+            *vx = (uint8_t)sum;
+            *vf = sum > 0xFF;
+            break;
+        }
+        case OP_SUB:
+        {
+            const uint8_t notBorrow = *vx >= vy;
+            *vx -= vy;
+            *vf = notBorrow;
+            break;
+        }
+        case OP_SUBN:
+        {
+            const uint8_t notBorrow = vy >= *vx;
+            *vx = vy - *vx;
+            *vf = notBorrow;
+            break;
+        }
+        case OP_SHR:
+        {
+            const uint8_t value = (quirks & QUIRK_SHIFT_VY) ? vy : *vx;
+            *vx = value >> 1;
+            *vf = value & 0x01;
+            break;
+        }
+        case OP_SHL:
+        {
+            const uint8_t value = (quirks & QUIRK_SHIFT_VY) ? vy : *vx;
+            *vx = value << 1;
+            *vf = (value >> 7) & 0x01;
+            break;
+        }
+        case OP_LD_I:       group->I[l] = nnn; break;
+        case OP_JP_V0:      *pc = nnn + ((quirks & QUIRK_JUMP_VX) ? *vx : LANE_V(group, 0, l)); break;
+        case OP_RND:        *vx = next_random(&group->rng[l]) & kk; break;
+        case OP_DRW:        draw_lane(group, l, x, y, n); break;
+        case OP_SKP:        *pc += ((group->keys[l] >> (*vx & 0x0F)) & 0x01) ? 2 : 0; break;
+        case OP_SKNP:       *pc += ((group->keys[l] >> (*vx & 0x0F)) & 0x01) ? 0 : 2; break;
+        case OP_LD_VX_DT:   *vx = group->DT[l]; break;
+        case OP_LD_VX_K:
+            if (group->keys[l] == 0)
+                *pc -= 2;                       // wait, execute this instruction again
+            else
+                *vx = __builtin_ctz(group->keys[l]);
+            break;
+        case OP_LD_DT_VX:   group->DT[l] = *vx; break;
+        case OP_LD_ST_VX:   group->ST[l] = *vx; break;
+        case OP_ADD_I_VX:   group->I[l] += *vx; break;
+        case OP_LD_F_VX:    group->I[l] = FONT_ADDRESS + (*vx & 0x0F) * 5; break;
+        case OP_LD_B_VX:
+        {
+            const uint16_t i = group->I[l];
+            if (i + 2 >= RAM_SIZE)
+            {
+                Log_Err("BCD store to 0x%04X is outside of RAM", i);
+                fail_lane(group, l);
+                return;
+            }
+            ram[i] = *vx / 100;
+            ram[i + 1] = (*vx / 10) % 10;
+            ram[i + 2] = *vx % 10;
+            mark_written(group, i, 3);
+            break;
+        }
+        case OP_LD_I_VX:
+        case OP_LD_VX_I:
+        {
+            const uint16_t i = group->I[l];
+            if (i + x >= RAM_SIZE)
+            {
+                Log_Err("Register %s 0x%04X is outside of RAM", op == OP_LD_I_VX ? "store to" : "load from", i);
+                fail_lane(group, l);
+                return;
+            }
+            const uint8_t *from = range_written(group, i, x + 1) ? ram : group->image;
+            for (uint8_t r=0; r<=x; r++)
+            {
+                if (op == OP_LD_I_VX)
+                    ram[i + r] = LANE_V(group, r, l);
+                else
+                    LANE_V(group, r, l) = from[i + r];
+            }
+            if (op == OP_LD_I_VX)
+                mark_written(group, i, x + 1);
+            if (quirks & QUIRK_MEMORY_X1)
+                group->I[l] += x + 1;
+            else if (quirks & QUIRK_MEMORY_X)
+                group->I[l] += x;
+            break;
+        }
+        default:
+            bad_instruction(*pc - 2, opcode);
+            break;
+    }
+}
+
+// Run one lane by itself, for at most cycles instructions
+static void run_lane(lockstep_t *group, uint32_t l, uint32_t cycles)
+{
+    for (; cycles != 0 && group->remaining[l] != 0; cycles--)
+    {
+        const uint16_t pc = group->PC[l];
+        if (pc >= CODE_SIZE - 1 || pc % 2 == 1)
+        {
+            Log_Err("Chip-8 is trying to execute invalid RAM address: 0x%04X", pc);
+            fail_lane(group, l);
+            return;
+        }
+
+        group->remaining[l]--;
+        if (is_written(group, pc) || is_written(group, pc + 1))
+        {
+            const uint8_t *ram = LANE_RAM(group, l);
+            const uint16_t opcode = ram[pc] << 8 | ram[pc + 1];
+            execute_lane(group, l, opcode, decode_opcode(opcode, MODE_CHIP8));
+        }
+        else
+        {
+            execute_lane(group, l, group->image[pc] << 8 | group->image[pc + 1], group->ops[pc / 2]);
+        }
+        group->scalarLaneSteps++;
+        if (!group->running[l])
+            return;
+    }
+}
+
+
+// Vector instructions
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+// One instruction for every active lane at once. Every lane is computed and
+// the active ones keep the result, no branches per lane so the loops vectorize.
+
+// Skip the next instruction in the lanes where skip is true
+#define VECTOR_SKIP(cond)                                                       \
+    for (uint32_t l=0; l<stride; l++)                                           \
+    {                                                                           \
+        const uint16_t target = next + 2 * (uint16_t)((cond) != 0);             \
+        PC[l] = act[l] ? target : PC[l];                                        \
+    }
+
+// Vx = result, then VF = flag when flag isn't NULL, so a flag in VF wins
+#define VECTOR_ALU(result, flag)                                                \
+    for (uint32_t l=0; l<stride; l++)                                           \
+    {                                                                           \
+        const uint8_t a = VX[l], b = VY[l];                                     \
+        const uint8_t r = (result), f = (flag);                                 \
+        (void)b;                                                                \
+        VX[l] = act[l] ? r : a;                                                 \
+        VF[l] = act[l] && writeFlag ? f : VF[l];                                \
+    }
+
+// Returns
+//      true        -> the instruction ran for every active lane
+//      false       -> it wasn't run, the lanes need to run it one by one
+static inline bool execute_vector(lockstep_t *group, uint16_t pc, uint16_t opcode, opcode_id_t op)
+{
+    const uint32_t stride = group->stride;
+    const uint8_t x = (opcode >> 8) & 0x0F;
+    const uint8_t y = (opcode >> 4) & 0x0F;
+    const uint8_t kk = opcode & 0xFF;
+    const uint16_t nnn = opcode & 0x0FFF;
+    const uint16_t next = pc + 2;
+    const uint32_t quirks = group->quirkBits;
+
+    const uint8_t *restrict act = group->active;
+    uint16_t *restrict PC = group->PC;
+    uint16_t *restrict I = group->I;
+    uint8_t *restrict DT = group->DT;
+    uint8_t *restrict ST = group->ST;
+    uint32_t *restrict rng = group->rng;
+    const uint16_t *restrict keys = group->keys;
+    uint8_t *VX = LANES(group, V, x);
+    uint8_t *VY = LANES(group, V, y);
+    uint8_t *VF = LANES(group, V, 0xF);
+    bool writeFlag = true;
+
+    switch (op)
+    {
+        case OP_JP:
+            for (uint32_t l=0; l<stride; l++)
+                PC[l] = act[l] ? nnn : PC[l];
+            return true;
+        case OP_SE_VX_KK:   VECTOR_SKIP(VX[l] == kk); return true;
+        case OP_SNE_VX_KK:  VECTOR_SKIP(VX[l] != kk); return true;
+        case OP_SE_VX_VY:   VECTOR_SKIP(VX[l] == VY[l]); return true;
+        case OP_SNE_VX_VY:  VECTOR_SKIP(VX[l] != VY[l]); return true;
+        case OP_SKP:        VECTOR_SKIP((keys[l] >> (VX[l] & 0x0F)) & 0x01); return true;
+        case OP_SKNP:       VECTOR_SKIP(!((keys[l] >> (VX[l] & 0x0F)) & 0x01)); return true;
+        default:
+            break;
+    }
+
+    // Everything else continues at the next instruction
+    for (uint32_t l=0; l<stride; l++)
+        PC[l] = act[l] ? next : PC[l];
+
+    switch (op)
+    {
+        case OP_LD_VX_KK:
+            for (uint32_t l=0; l<stride; l++)
+                VX[l] = act[l] ? kk : VX[l];
+            return true;
+        case OP_ADD_VX_KK:
+            for (uint32_t l=0; l<stride; l++)
+                VX[l] += act[l] ? kk : 0;
+            return true;
+        case OP_LD_VX_VY:
+            writeFlag = false;
+            VECTOR_ALU(b, 0);
+            return true;
+        case OP_OR:
+            writeFlag = quirks & QUIRK_VF_RESET;
+            VECTOR_ALU(a | b, 0);
+            return true;
+        case OP_AND:
+            writeFlag = quirks & QUIRK_VF_RESET;
+            VECTOR_ALU(a & b, 0);
+            return true;
+        case OP_XOR:
+            writeFlag = quirks & QUIRK_VF_RESET;
+            VECTOR_ALU(a ^ b, 0);
+            return true;
+        case OP_ADD_VX_VY:  VECTOR_ALU(a + b, a + b > 0xFF); return true;
+        case OP_SUB:        VECTOR_ALU(a - b, a >= b); return true;
+        case OP_SUBN:       VECTOR_ALU(b - a, b >= a); return true;
+        case OP_SHR:
+            if (quirks & QUIRK_SHIFT_VY)
+                VECTOR_ALU(b >> 1, b & 0x01)
+            else
+                VECTOR_ALU(a >> 1, a & 0x01)
+            return true;
+        case OP_SHL:
+            if (quirks & QUIRK_SHIFT_VY)
+                VECTOR_ALU(b << 1, (b >> 7) & 0x01)
+            else
+                VECTOR_ALU(a << 1, (a >> 7) & 0x01)
+            return true;
+        case OP_LD_I:
+            for (uint32_t l=0; l<stride; l++)
+                I[l] = act[l] ? nnn : I[l];
+            return true;
+        case OP_ADD_I_VX:
+            for (uint32_t l=0; l<stride; l++)
+            {
+                const uint8_t vx = VX[l];
+                I[l] += act[l] ? vx : 0;
+            }
+            return true;
+        case OP_LD_F_VX:
+            for (uint32_t l=0; l<stride; l++)
+            {
+                const uint16_t digit = FONT_ADDRESS + (VX[l] & 0x0F) * 5;
+                I[l] = act[l] ? digit : I[l];
+            }
+            return true;
+        case OP_LD_VX_DT:
+            for (uint32_t l=0; l<stride; l++)
+            {
+                const uint8_t dt = DT[l];
+                VX[l] = act[l] ? dt : VX[l];
+            }
+            return true;
+        case OP_LD_DT_VX:
+            for (uint32_t l=0; l<stride; l++)
+            {
+                const uint8_t vx = VX[l];
+                DT[l] = act[l] ? vx : DT[l];
+            }
+            return true;
+        case OP_LD_ST_VX:
+            for (uint32_t l=0; l<stride; l++)
+            {
+                const uint8_t vx = VX[l];
+                ST[l] = act[l] ? vx : ST[l];
+            }
+            return true;
+        case OP_RND:
+            for (uint32_t l=0; l<stride; l++)
+            {
+                uint32_t state = rng[l];
+                const uint8_t value = next_random(&state) & kk;
+                rng[l] = act[l] ? state : rng[l];
+                VX[l] = act[l] ? value : VX[l];
+            }
+            return true;
+        case OP_LD_VX_K:
+        {
+            // Lanes without a key down execute this instruction again
+            uint32_t pressed = 0;
+            for (uint32_t l=0; l<stride; l++)
+            {
+                const uint8_t down = keys[l] != 0;
+                PC[l] = act[l] & !down ? pc : PC[l];
+                pressed += act[l] & down;
+            }
+            if (pressed != 0)
+                for (uint32_t l=0; l<stride; l++)
+                    if (act[l] && keys[l] != 0)
+                        VX[l] = __builtin_ctz(keys[l]);
+            return true;
+        }
+        case OP_CLS:
+            for (uint16_t row=0; row<group->height; row++)
+            {
+                uint64_t *restrict line = LANES(group, display, row);
+                for (uint32_t l=0; l<stride; l++)
+                    line[l] &= (uint64_t)act[l] - 1;
+            }
+            return true;
+        case OP_INVALID:
+            bad_instruction(pc, opcode);
+            return true;
+        default:
+            break;
+    }
+
+    // Draws, stack and RAM accesses run per lane, with the PC back at the instruction
+    for (uint32_t l=0; l<stride; l++)
+        PC[l] = act[l] ? pc : PC[l];
+    return false;
+}
+
+#undef VECTOR_ALU
+#undef VECTOR_SKIP
+
+
+// Group steps
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+
+// Mark the lanes at the lowest PC of the lanes with instructions left, returns
+// how many there are and how many lanes have instructions left
+static inline uint32_t gather_active(lockstep_t *group, uint16_t *lowestPC, uint32_t *live)
+{
+    const uint32_t stride = group->stride;
+    const uint16_t *restrict PC = group->PC;
+    const uint32_t *restrict remaining = group->remaining;
+    uint8_t *restrict act = group->active;
+
+    uint16_t lowest = UINT16_MAX;
+    uint32_t liveCount = 0;
+    for (uint32_t l=0; l<stride; l++)
+    {
+        // Lanes without instructions left are at PC 0xFFFF, above any valid PC
+        const uint16_t live = remaining[l] != 0;
+        const uint16_t pc = PC[l] | (uint16_t)(live - 1);
+        lowest = pc < lowest ? pc : lowest;
+        liveCount += live;
+    }
+
+    uint32_t count = 0;
+    for (uint32_t l=0; l<stride; l++)
+    {
+        act[l] = (remaining[l] != 0) & (PC[l] == lowest);
+        count += act[l];
+    }
+
+    *lowestPC = lowest;
+    *live = liveCount;
+    return count;
+}
+
+LOCKSTEP_CLONES
+static void step_lockstep(lockstep_t *group)
+{
+    const uint32_t stride = group->stride;
+    for (;;)
+    {
+        uint16_t pc;
+        uint32_t live;
+        const uint32_t count = gather_active(group, &pc, &live);
+        if (count == 0)
+            return;
+        group->steps++;
+
+        // Diverged, every lane carries on by itself for a while
+        const bool shared = pc < CODE_SIZE - 1 && !is_written(group, pc) && !is_written(group, pc + 1);
+        if (!shared || pc % 2 == 1 || count * LOCKSTEP_SPARSE < live)
+        {
+            for (uint32_t l=0; l<stride; l++)
+                if (group->remaining[l] != 0)
+                    run_lane(group, l, LOCKSTEP_BURST);
+            continue;
+        }
+
+        const uint16_t opcode = group->image[pc] << 8 | group->image[pc + 1];
+        const opcode_id_t op = group->ops[pc / 2];
+        const uint8_t *restrict act = group->active;
+        uint32_t *restrict remaining = group->remaining;
+        for (uint32_t l=0; l<stride; l++)
+            remaining[l] -= act[l];
+
+        if (execute_vector(group, pc, opcode, op))
+        {
+            group->vectorLaneSteps += count;
+            continue;
+        }
+
+        // Same instruction, run lane by lane
+        uint32_t listed = 0;
+        for (uint32_t l=0; l<stride; l++)
+            if (act[l])
+                group->activeList[listed++] = l;
+        for (uint32_t i=0; i<listed; i++)
+            execute_lane(group, group->activeList[i], opcode, op);
+        group->sharedLaneSteps += count;
+    }
+}
+
+int run_lockstep(lockstep_t *group, uint32_t cycles)
+{
+    uint32_t running = 0;
+    for (uint32_t l=0; l<group->stride; l++)
+    {
+        group->remaining[l] = group->running[l] ? cycles : 0;
+        running += group->running[l];
+    }
+    if (running == 0)
+        return Log_Err("Every lockstep lane has stopped");
+
+    step_lockstep(group);
+    return 0;
+}
@@ -0,0 +1,97 @@
+#ifndef LOCKSTEP_H_IRISH
+#define LOCKSTEP_H_IRISH
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+
+// Lockstep core, many CHIP-8 machines running the same ROM side by side
+//
+// The machines (lanes) are kept as structure of arrays: every register, the
+// stack and every display row is an array with one element per lane. Each step
+// runs the lanes whose PC is the lowest PC of the group, so lanes that skipped
+// ahead wait for the rest to catch up. Their shared opcode is decoded once and
+// executed for all of them by loops over the lane arrays the compiler
+// vectorizes, draws and opcodes that go through I run lane by lane. When fewer
+// than 1/LOCKSTEP_SPARSE of the lanes are at that PC the lanes have diverged,
+// and every lane runs on its own for a while before they are tried together again.
+//
+// Only the CHIP-8 instruction set, on a display 64 pixels wide, like --jit.
+// Every lane ends up exactly where a chip8_t run with the same seed and keys
+// would.
+
+// Lane arrays are padded to a multiple of this, so the vector loops need no tail
+#define LOCKSTEP_ALIGN 64
+
+// Steps with fewer than 1/LOCKSTEP_SPARSE of the lanes at the PC run every lane on its own
+#define LOCKSTEP_SPARSE 8
+
+typedef struct lockstep
+{
+    uint32_t lanes;                 // machines in the group
+    uint32_t stride;                // lanes rounded up to LOCKSTEP_ALIGN, the length of every lane array
+    uint32_t quirkBits;             // QUIRK_* of the group's quirk profile
+    uint16_t entrypoint;            // PC of every lane after init_lockstep()
+    uint16_t height;                // display rows
+
+    // Lane arrays, x * stride + lane for the arrays of arrays
+    uint8_t *V;                     // V0-VF, [16][stride]
+    uint16_t *I;
+    uint16_t *PC;
+    uint8_t *DT;
+    uint8_t *ST;
+    uint8_t *SP;
+    uint16_t *stack;                // [16][stride], stack[0] is never used like chip8_t's
+    uint16_t *keys;                 // keys down, bit n -> key n
+    uint32_t *rng;                  // xorshift32 state, never 0
+    uint32_t *remaining;            // instructions left in the current run_lockstep()
+    uint8_t *running;               // 0 -> lane failed or stopped
+    uint8_t *active;                // 1 -> lane runs this step
+    uint64_t *display;              // [height][stride], one 64-bit row per lane
+
+    uint8_t *ram;                   // RAM per lane, every access is at a lane's own I
+    uint32_t *activeList;           // lanes of a step that runs lane by lane
+
+    uint8_t image[RAM_SIZE];        // RAM every lane started with, opcodes are read from here
+    uint8_t ops[RAM_SIZE/2];        // opcode_id_t of the image's instruction per even address
+    uint64_t written[RAM_SIZE/64];  // addresses any lane stored to, bit per byte, opcodes there are read per lane
+
+    uint64_t vectorLaneSteps;       // lane instructions run by steps of the group over every lane at once
+    uint64_t sharedLaneSteps;       // lane instructions of steps of the group that ran lane by lane (draws, stack, I)
+    uint64_t scalarLaneSteps;       // lane instructions run by diverged lanes on their own
+    uint64_t steps;                 // steps of the whole group
+} lockstep_t;
+
+// Set up a group of lanes that all start as copies of image, a set up CHIP-8
+// machine with its ROM loaded. Lane n's random number generator is seeded with
+// image->rngState + n, or 1 when that is 0.
+//
+// Returns
+//      0           -> success
+//      *           -> anything else on failure
+int init_lockstep(lockstep_t *group, const chip8_t *image, uint32_t lanes);
+void destroy_lockstep(lockstep_t *group);
+
+// Set the keys down in a lane, bit n -> key n
+void set_lockstep_keys(lockstep_t *group, uint32_t lane, uint16_t keys);
+
+// Run every running lane for the given number of instructions
+//
+// Returns
+//      0           -> success, lanes that failed are stopped, see lockstep_running()
+//      *           -> anything else when every lane has failed
+int run_lockstep(lockstep_t *group, uint32_t cycles);
+
+// Count every lane's delay and sound timers down, called at 60Hz
+void tick_lockstep_timers(lockstep_t *group);
+
+bool lockstep_running(const lockstep_t *group, uint32_t lane);
+
+// Copy a lane into chip8, a machine set up like the group's image, e.g. to hash
+// its display and RAM or to continue it with the normal engines
+void export_lockstep_lane(const lockstep_t *group, uint32_t lane, chip8_t *chip8);
+
+void print_lockstep_stats(const lockstep_t *group);
+
+#endif
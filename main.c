@@ -3,11 +3,26 @@
 #include <errno.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include <SDL2/SDL.h>
 
 #include "main.h"
 #include "chip8.h"
+#include "cpu.h"
+#include "headless.h"
+#include "trace.h"
+#include "scheduler.h"
+#include "jit.h"
+#include "batch.h"
+#include "savestate.h"
+#include "movie.h"
+#include "profile.h"
+#include "debug.h"
+#include "romlib.h"
+#include "hotreload.h"
+#include "audio.h"
+#include "emuthread.h"
 #include "helpers/logging.h"
 
 
@@ -16,10 +31,29 @@
 #define DISPLAY_WIDTH 64
 #define DISPLAY_HEIGHT 32
 
+// Default CPU clock, instructions per second
+#define CPU_HZ 700
+#define CPU_HZ_MIN FRAME_HZ
+#define CPU_HZ_MAX 100000000
+
+// Frames the main loop may fall behind before giving up on catching up
+#define MAX_FRAME_LAG 4
+
+// Instructions kept by --trace when no size is given on the cli
+#define TRACE_DEFAULT_RECORDS (1 << 20)
+
+// Memory budget of the rewind buffer when none is given on the cli, minutes of
+// rewind for most ROMs
+#define REWIND_DEFAULT_KB 4096
+
+// Beeper volume in percent when none is given on the cli
+#define VOLUME_DEFAULT 25
+
+// Instruction budget for headless runs when no budget is given on the cli
+#define HEADLESS_DEFAULT_CYCLES 1000000
+
 int main(int argc, char *argv[])
 {
-    // TODO: Add default usage statement...
-
     // initialize emulator configurations/options
     config_t config = (config_t) {
         .window_scale = DISPLAY_SCALE,
@@ -31,148 +65,887 @@ int main(int argc, char *argv[])
         .config_path = "./configs/",
         .text_rom_name = "textSprites.bin",
         .entrypoint = 0x200,
-        .screenWrap = true
+        .quirks = QUIRKS_MODERN,
+        .mode = MODE_CHIP8,
+        .plane_colors = { 0xFF6600FF, 0x662200FF },
+        .cpu_hz = CPU_HZ,
+        .rng_seed = 0,
+        .trace_path = NULL,
+        .trace_records = TRACE_DEFAULT_RECORDS,
+        .decode_trace_path = NULL,
+        .headless = false,
+        .max_cycles = 0,
+        .max_seconds = 0,
+        .jit = false,
+        .jit_verify = false,
+        .batch_path = NULL,
+        .threads = 0,
+        .tolerance = 0,
+        .golden_path = NULL,
+        .state_path = NULL,
+        .load_state_path = NULL,
+        .rewind_kb = REWIND_DEFAULT_KB,
+        .volume = VOLUME_DEFAULT,
+        .profile_path = NULL,
+        .record_path = NULL,
+        .replay_path = NULL,
+        .debug = false,
+        .breakpoints = NULL,
+        .rom_index = false,
+        .hot_reload = false,
+        .threaded = false
     };
 
+    // Get ROM name and options from cli args
+    char *romName = "test/IBM Logo.ch8";
+    if (parse_args(argc, argv, &config, &romName) != 0)
+        return 1;
+    // Log_Info("Loading ROM: %s", romName);
+
+    // Offline trace decoding, no emulation at all
+    if (config.decode_trace_path != NULL)
+        return decode_trace(config.decode_trace_path, stdout);
+
+    // ROM library index rebuilt and listed, no emulation at all
+    if (config.rom_index)
+    {
+        rom_library_t library;
+        if (open_rom_library(&library, config.rom_path, true) != 0)
+            return 1;
+        print_rom_library(&library);
+        close_rom_library(&library);
+        return 0;
+    }
+
+    // Batch of headless jobs, the ROM and trace options don't apply
+    if (config.batch_path != NULL)
+        return run_batch(config);
+
+    // A ROM named by content hash is looked up in the ROM library and mapped
+    // from there, the library stays open until exit. It runs on the platform
+    // the library detected for it unless --mode or --quirks say otherwise.
+    rom_library_t library = {0};
+    const uint8_t *rom = NULL;
+    size_t romSize = 0;
+    if (romName[0] == '@')
+    {
+        if (open_rom_library(&library, config.rom_path, false) != 0)
+            return 1;
+        rom_entry_t *entry = find_rom(&library, romName);
+        if (entry == NULL)
+            return Log_Err("No ROM with hash '%s' in the ROM library of '%s', rebuild it with --rom-index", &romName[1], config.rom_path);
+        if (use_detected_platform(&config, romName, entry->mode, entry->quirks) != 0)
+            return 1;
+
+        // A ROM that changed since it was indexed is read from its file
+        romName = entry->path;
+        if ((rom = map_rom(&library, entry)) != NULL)
+            romSize = entry->size;
+    }
+
+    // Instruction trace, recorded into memory and written out at exit
+    trace_buffer_t trace = {0};
+    if (config.trace_path != NULL && init_trace(&trace, config.trace_records) != 0)
+        return 1;
+
+    // Execution profile, written out at exit
+    profile_t profile;
+    if (config.profile_path != NULL)
+        init_profile(&profile);
+
+    // Debugger, a windowed machine always has one so F10 can break in
+    debugger_t debug;
+    if (init_debugger(&debug, config.breakpoints, config.debug) != 0)
+        return 1;
+
+    // Input movie, a replay also decides the seed, CPU clock, instruction set
+    // and quirk profile of the machine
+    movie_t movie = {0};
+    const bool moviePlaying = config.record_path != NULL || config.replay_path != NULL;
+    if (config.replay_path != NULL)
+    {
+        if (load_movie(&movie, config.replay_path) != 0)
+            return 1;
+        config.rng_seed = movie.rngSeed;
+        config.cpu_hz = movie.cpu_hz;
+        config.mode = movie.mode;
+        config.quirks = movie.quirks;
+        if (config.jit && (config.mode != MODE_CHIP8 || config.quirks != QUIRKS_MODERN))
+            return Log_Err("Movie '%s' was recorded with '--mode %s --quirks %s', '--jit' only supports chip8 and modern",
+                config.replay_path, mode_name(config.mode), quirks_name(config.quirks));
+    }
+
+    // Headless mode, emulate as fast as possible without ever touching SDL
+    if (config.headless)
+    {
+        chip8_t chip8 = {0};
+        if (initialize_chip8(&chip8, config, romName, rom, romSize))
+            return 1;
+        if (config.trace_path != NULL)
+            chip8.trace = &trace;
+        if (config.profile_path != NULL)
+            chip8.profile = &profile;
+        if (config.debug || config.breakpoints != NULL)
+            chip8.debug = &debug;
+        if (start_movie(&movie, &chip8, config) != 0)
+            return 1;
+
+        jit_t jit;
+        if (config.jit)
+        {
+            if (init_jit(&jit, &chip8, config.jit_verify) != 0)
+                return 1;
+            chip8.jit = &jit;
+        }
+
+        if (config.load_state_path != NULL)
+        {
+            if (load_state(&chip8, config.load_state_path) != 0)
+                return 1;
+            if (config.jit)
+                jit_resync(&jit, &chip8);
+        }
+
+        headless_result_t result;
+        int status = run_headless(&chip8, config, moviePlaying ? &movie : NULL, &result);
+        print_headless_result(&result);
+
+        // A replay cut short by --cycles or --seconds has nothing to compare with
+        if (config.replay_path != NULL && result.cycles == movie.cycles)
+            status |= check_replay(&movie, &chip8, result.cycles);
+        if (config.record_path != NULL)
+            status |= stop_recording(&movie, &chip8, result.frames, result.cycles);
+        destroy_movie(&movie);
+
+        if (config.jit)
+        {
+            print_jit_stats(&jit);
+            destroy_jit(&jit);
+        }
+
+        if (config.trace_path != NULL)
+        {
+            status |= write_trace(&trace, config.trace_path);
+            destroy_trace(&trace);
+        }
+
+        if (config.profile_path != NULL)
+            status |= write_profile(&profile, &chip8, config.profile_path);
+
+        destroy_chip8(&chip8);
+        close_rom_library(&library);
+        return status;
+    }
+
     // Initialize SDL
     sdl_t sdl = {0};
     if (initialize_sdl(&sdl, config))
         return 1;
     
-    // Get ROM name from cli args
-    char *romName = "test/IBM Logo.ch8";
-    if (argc > 1)
-        romName = argv[1];
-    // Log_Info("Loading ROM: %s", romName);
-    
     // Initialize Chip-8 machine
     chip8_t chip8 = {0};
-    if (initialize_chip8(&chip8, config, romName))
+    if (initialize_chip8(&chip8, config, romName, rom, romSize))
+        return 1;
+    if (config.trace_path != NULL)
+        chip8.trace = &trace;
+    if (config.profile_path != NULL)
+        chip8.profile = &profile;
+    chip8.debug = &debug;
+    if (start_movie(&movie, &chip8, config) != 0)
         return 1;
 
-    // TODO:
-    // Get loop start time
+    jit_t jit;
+    if (config.jit)
+    {
+        if (init_jit(&jit, &chip8, config.jit_verify) != 0)
+            return 1;
+        chip8.jit = &jit;
+    }
+
+    if (config.load_state_path != NULL)
+    {
+        if (load_state(&chip8, config.load_state_path) != 0)
+            return 1;
+        if (config.jit)
+            jit_resync(&jit, &chip8);
+    }
+
+    // Save states, F5 saves and F9 loads, next to the ROM unless --state is given
+    char defaultStatePath[1024];
+    const char *statePath = config.state_path;
+    if (statePath == NULL)
+    {
+        snprintf(defaultStatePath, sizeof(defaultStatePath), "%s.state", chip8.romPath);
+        statePath = defaultStatePath;
+    }
+
+    // Going back in time would desync a movie from its frame numbers
+    if (moviePlaying && config.rewind_kb != 0)
+    {
+        Log_Warn("Rewind and loading save states are disabled while recording or replaying");
+        config.rewind_kb = 0;
+    }
 
-    // Main Loop
-    while (chip8.state != QUIT)
+    // Rewind, one delta compressed snapshot per frame while backspace isn't held
+    rewind_t rewind;
+    if (config.rewind_kb != 0)
     {
-        // Handle User Input
-        handle_input(sdl, config, &chip8);
+        if (init_rewind(&rewind, &chip8, config.rewind_kb * 1024) != 0)
+            return 1;
+        rewind_record(&rewind, &chip8);
+    }
+
+    // ROM hot reloading, a thread watches the ROM file and the loop swaps it in
+    hot_reload_t hotReload;
+    if (config.hot_reload && start_hot_reload(&hotReload, &chip8) != 0)
+        return 1;
 
-        // TODO:
-        // Check chip-8 state
-        // if paused: skip/do something else???...
-        // FIXME: need to pause audio during this as well...
-        if (chip8.state == PAUSED || chip8.state == QUIT) continue;
+    // Sound timer audio, the callback plays what the frames run
+    audio_t audio;
+    open_audio(&audio, config.volume);
 
-        // Emulate Chip-8 instructions
-        if (emulate_instruction(&chip8) != 0)
+    // CPU clock and 60Hz frame pacing
+    emulator_t emu = {
+        .chip8 = &chip8,
+        .config = &config,
+        .movie = &movie,
+        .moviePlaying = moviePlaying,
+        .rewind = &rewind,
+        .jit = &jit,
+        .debug = &debug,
+        .hotReload = &hotReload,
+        .audio = &audio,
+        .statePath = statePath,
+        .status = 0
+    };
+    init_scheduler(&emu.sched, config.cpu_hz);
+    init_frame_timer(&emu.frameTimer);
+
+    // Messages from here on are written by a background thread, so a burst of
+    // them doesn't hold up the frame
+    start_logging();
+
+    latency_t latency = {0};
+    if (config.threaded)
+    {
+        // Emulation on its own thread, this one only handles the window
+        if (run_emulation_thread(&emu, sdl, config, &latency) != 0)
+            emu.status = 1;
+    }
+    else
+    {
+        // Main Loop, one iteration per 60Hz frame
+        hotkeys_t hotkeys = {0};
+        while (chip8.state != QUIT)
         {
-            // on fatal instruction emulation error shutdown
-            chip8.state = QUIT;
-            continue;
-        }
-        
-        // Update window with changes
-        update_screen(sdl, config, chip8.display);
+            // Handle User Input
+            handle_input(sdl, config, &hotkeys);
+
+            emulate_frame(&emu, &hotkeys);
+            if (chip8.state == QUIT)
+                break;
+
+            // Update window with changes, a keypad change reaches the screen
+            // here, drawn or not, like with --threaded
+            if (hotkeys.keyTicks != 0)
+                chip8.displayDirty = true;
+            update_screen(sdl, config, &chip8);
+            if (hotkeys.keyTicks != 0)
+            {
+                record_latency(&latency, hotkeys.keyTicks);
+                hotkeys.keyTicks = 0;
+            }
+
+            // Sleep off the rest of the frame
+            wait_for_next_frame(&emu.frameTimer);
+
+        } // ~Main Loop
+    }
+    print_latency(&latency);
+    int status = emu.status;
 
-        // TODO:
-        // Get elapsed time and
-        // Delay for 60hz/60fps
-        SDL_Delay(16);
+    close_audio(&audio);
 
-    } // ~Main Loop
+    if (config.hot_reload)
+        stop_hot_reload(&hotReload);
+
+    // Everything the threads logged is out, the rest of the shutdown and the
+    // reports after it are written directly
+    stop_logging();
+
+    if (config.trace_path != NULL)
+    {
+        write_trace(&trace, config.trace_path);
+        destroy_trace(&trace);
+    }
+
+    if (config.profile_path != NULL)
+        status |= write_profile(&profile, &chip8, config.profile_path);
+
+    if (config.jit)
+    {
+        print_jit_stats(&jit);
+        destroy_jit(&jit);
+    }
+
+    if (config.rewind_kb != 0)
+    {
+        print_rewind_stats(&rewind);
+        destroy_rewind(&rewind);
+    }
+
+    if (config.record_path != NULL)
+        status |= stop_recording(&movie, &chip8, emu.sched.frames, emu.sched.cycles);
+    destroy_movie(&movie);
 
     destroy_chip8(&chip8);
+    close_rom_library(&library);
     cleanup_sdl(&sdl);
-    return 0;
+    return status;
 }
 
-void update_screen(sdl_t sdl, const config_t config, bool *display)
+// Emulate one frame of the window: take the keypad and hotkeys, then run the
+// frame's instructions or rewind one. The hotkeys handled are cleared, the
+// machine is left in QUIT when the window should close.
+void emulate_frame(emulator_t *emu, hotkeys_t *hotkeys)
 {
-        sdl_clear_screen(sdl, config);
-        SDL_SetRenderDrawColor(sdl.renderer, config.fg_color.r, config.fg_color.g, config.fg_color.b, config.fg_color.a);
+    chip8_t *chip8 = emu->chip8;
+    const config_t *config = emu->config;
+
+    for (int k=0; k<16; k++)
+        chip8->keypad[k] = (hotkeys->keys >> k) & 1;
+
+    if (hotkeys->quit)
+    {
+        chip8->state = QUIT;
+        return;
+    }
+    if (hotkeys->redraw)
+        chip8->displayDirty = true;
+    if (hotkeys->pause)
+    {
+        chip8->state = chip8->state == RUNNING ? PAUSED : RUNNING;
+        Log_Info("Chip-8 is now: %s", chip8->state == PAUSED ? "PAUSED" : "RUNNING");
+    }
+
+    if (emu->moviePlaying)
+        hotkeys->loadState = false;
+
+    if (hotkeys->saveState)
+        save_state(chip8, emu->statePath);
+    if (hotkeys->loadState && load_state(chip8, emu->statePath) == 0)
+    {
+        if (config->jit)
+            jit_resync(emu->jit, chip8);
+        // Loading is recorded like any other frame, so it can be rewound
+        if (config->rewind_kb != 0)
+            rewind_record(emu->rewind, chip8);
+    }
+
+    // A changed ROM is swapped in between frames, the window stays as it is
+    if (config->hot_reload && hot_reload_pending(emu->hotReload) && apply_hot_reload(emu->hotReload, chip8) == 0)
+    {
+        if (config->jit)
+            jit_resync(emu->jit, chip8);
+        // Rewinding past the reload goes back to the old ROM
+        if (config->rewind_kb != 0)
+            rewind_record(emu->rewind, chip8);
+    }
+
+    // The prompt comes up before the next instruction, in the terminal
+    if (hotkeys->debugBreak)
+    {
+        debug_break(emu->debug);
+        if (chip8->state == PAUSED)
+            chip8->state = RUNNING;
+    }
+    hotkeys->saveState = hotkeys->loadState = hotkeys->debugBreak = false;
+    hotkeys->pause = hotkeys->redraw = false;
+
+    // Rewinding runs no frames, so audio falls silent like when paused
+    if (hotkeys->rewind && config->rewind_kb != 0)
+    {
+        // Step back one frame per frame, until the oldest one held
+        if (rewind_step(emu->rewind, chip8) == 0 && config->jit)
+            jit_resync(emu->jit, chip8);
+    }
+    else if (chip8->state == RUNNING || chip8->state == STEPPING)
+    {
+        // A replay ends on the frame its recording ended
+        if (config->replay_path != NULL && movie_finished(emu->movie, emu->sched.frames))
+        {
+            emu->status = check_replay(emu->movie, chip8, emu->sched.cycles);
+            chip8->state = QUIT;
+            return;
+        }
 
-        // Draw display
-        for(uint32_t i=0; i<config.window_height; i++)
+        // Record or replay this frame's keypad
+        if (emu->moviePlaying && movie_frame(emu->movie, chip8, emu->sched.frames) != 0)
         {
-            for(uint32_t j=0; j<config.window_width; j++)
-            {
-                // Draw pixel if it's on
-                int index = (i*config.window_width) + j;
-                if (*(display + index) == true)
-                {
-                    SDL_FRect rect = {j*config.window_scale, i*config.window_scale, 1*config.window_scale, 1*config.window_scale};
-                    SDL_RenderFillRectF(sdl.renderer, &rect); 
-                }
-            }
+            emu->status = 1;
+            chip8->state = QUIT;
+            return;
+        }
+
+        // Emulate this frame's instructions and tick the timers
+        if (run_audio_frame(emu->audio, chip8, &emu->sched) != 0)
+        {
+            // on fatal instruction emulation error shutdown
+            chip8->state = QUIT;
+            return;
         }
 
-        // Display renderer to window
-        SDL_RenderPresent(sdl.renderer);
+        if (config->rewind_kb != 0)
+            rewind_record(emu->rewind, chip8);
+    }
+}
+
+// Start recording, or check a replay's movie was recorded on this ROM, once the
+// machine is initialized
+//
+// Returns
+//      0           -> success
+//      *           -> anything else on failure
+int start_movie(movie_t *movie, const chip8_t *chip8, const config_t config)
+{
+    if (config.record_path != NULL)
+        return start_recording(movie, chip8, config.record_path, config.cpu_hz);
+
+    if (config.replay_path != NULL && movie->romHash != hash_ram(chip8))
+        return Log_Err("Movie '%s' was recorded with a different ROM", config.replay_path);
+
+    return 0;
 }
 
-void sdl_clear_screen(sdl_t sdl, const config_t config)
+void print_usage(const char *appName)
 {
-    // Clear screen to background color
-    SDL_SetRenderDrawColor(sdl.renderer, config.bg_color.r, config.bg_color.g, config.bg_color.b, config.bg_color.a);
-    SDL_RenderClear(sdl.renderer);
+    printf("Usage: %s [options] [ROM]\n", appName);
+    printf("\n");
+    printf("  ROM                 path to ROM, relative to ./roms/ (default: test/IBM Logo.ch8)\n");
+    printf("                      or @HASH of a ROM in the --rom-index\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  -h, --help          show this message and exit\n");
+    printf("  --cpu-hz N          CPU clock in instructions per second (default: %d)\n", CPU_HZ);
+    printf("  --mode MODE         instruction set: chip8, schip or xochip (default: chip8, @HASH: detected)\n");
+    printf("  --quirks PROFILE    quirk profile: modern, vip, chip48 or schip (default: modern, @HASH: detected)\n");
+    printf("  --seed N            seed of the random number generator (default: time based)\n");
+    printf("  --trace FILE        record executed instructions, written to FILE at exit\n");
+    printf("  --trace-records N   instructions kept by --trace, oldest are dropped (default: %d)\n", TRACE_DEFAULT_RECORDS);
+    printf("  --decode-trace FILE print a --trace FILE as text and exit\n");
+    printf("  --profile FILE      count executions per opcode and address, report written to FILE\n");
+    printf("                      and a heatmap of every address to FILE.heatmap.csv at exit\n");
+    printf("  --debug             stop in the debugger before the first instruction\n");
+    printf("  --break ADDR[,ADDR] stop in the debugger before executing ADDR, hex\n");
+    printf("  --headless          run without a window or frame delay and report throughput\n");
+    printf("  --cycles N          headless: stop after N instructions\n");
+    printf("  --seconds S         headless: stop after S seconds of wall-clock time\n");
+    printf("  --jit               translate ROM code to x86-64 instead of interpreting it\n");
+    printf("  --jit-verify        --jit, checked against the interpreter after every block\n");
+    printf("  --state FILE        save state file of F5/F9 (default: ROM path + .state)\n");
+    printf("  --load-state FILE   load a save state before starting\n");
+    printf("  --volume PCT        beeper volume in percent, 0 disables audio (default: %d)\n", VOLUME_DEFAULT);
+    printf("  --rewind-kb N       memory for rewinding with backspace, 0 disables (default: %d)\n", REWIND_DEFAULT_KB);
+    printf("  --record FILE       record the seed and keypad into a movie, written to FILE at exit\n");
+    printf("  --replay FILE       replay a --record movie instead of live input, checked at the end\n");
+    printf("  --threaded          emulate on a thread of its own, the main thread only handles the window\n");
+    printf("  --log-level LEVEL   lowest level logged: debug, info, warn, err or none (default: info)\n");
+    printf("  --hot-reload        restart with the ROM whenever its file changes (Linux only)\n");
+    printf("  --rom-index         index every ROM under ./roms/ for @HASH lookups, list them and exit\n");
+    printf("  --batch FILE        run the headless jobs listed in FILE in parallel, see batch.h\n");
+    printf("  --threads N         batch: worker threads (default: one per core)\n");
+    printf("  --tolerance PCT     batch: fail jobs more than PCT%% below their --baseline-ips\n");
+    printf("  --write-golden FILE batch: write the job file to FILE with this run's golden results\n");
+    printf("\n");
+    printf("  Headless runs default to %d instructions when no budget is given\n", HEADLESS_DEFAULT_CYCLES);
 }
 
-int initialize_sdl(sdl_t *sdl, const config_t config)
+// Returns
+//      0           -> success
+//      *           -> anything else on failure, or when usage was requested
+int parse_args(int argc, char *argv[], config_t *config, char **romName)
 {
-    // Initialize sub-systems
-    if (SDL_InitSubSystem(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) != 0)
+    for (int i=1; i<argc; i++)
     {
-        Log_Err("Could not initialize video subsystem: %s", SDL_GetError());
-        return 1;
+        const char *arg = argv[i];
+
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+        else if (strcmp(arg, "--headless") == 0)
+        {
+            config->headless = true;
+        }
+        else if (strcmp(arg, "--batch") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+            config->batch_path = argv[++i];
+        }
+        else if (strcmp(arg, "--threads") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+
+            char *end = NULL;
+            const char *value = argv[++i];
+            errno = 0;
+            unsigned long threads = strtoul(value, &end, 10);
+            if (errno != 0 || end == value || *end != '\0' || threads > BATCH_MAX_JOBS)
+                return Log_Err("Invalid value '%s' for option '%s', must be 0-%d", value, arg, BATCH_MAX_JOBS);
+            config->threads = (uint32_t)threads;
+        }
+        else if (strcmp(arg, "--write-golden") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+            config->golden_path = argv[++i];
+        }
+        else if (strcmp(arg, "--tolerance") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+
+            char *end = NULL;
+            const char *value = argv[++i];
+            errno = 0;
+            config->tolerance = strtod(value, &end);
+            if (errno != 0 || end == value || *end != '\0' || config->tolerance < 0 || config->tolerance > 100)
+                return Log_Err("Invalid value '%s' for option '%s', must be 0-100", value, arg);
+        }
+        else if (strcmp(arg, "--state") == 0 || strcmp(arg, "--load-state") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+
+            if (strcmp(arg, "--state") == 0)
+                config->state_path = argv[++i];
+            else
+                config->load_state_path = argv[++i];
+        }
+        else if (strcmp(arg, "--record") == 0 || strcmp(arg, "--replay") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+
+            if (strcmp(arg, "--record") == 0)
+                config->record_path = argv[++i];
+            else
+                config->replay_path = argv[++i];
+        }
+        else if (strcmp(arg, "--rewind-kb") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+
+            char *end = NULL;
+            const char *value = argv[++i];
+            errno = 0;
+            unsigned long kb = strtoul(value, &end, 10);
+            if (errno != 0 || end == value || *end != '\0' || kb > UINT32_MAX / 1024)
+                return Log_Err("Invalid value '%s' for option '%s', must be 0-%u", value, arg, UINT32_MAX / 1024);
+            config->rewind_kb = (uint32_t)kb;
+        }
+        else if (strcmp(arg, "--volume") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+
+            char *end = NULL;
+            const char *value = argv[++i];
+            errno = 0;
+            unsigned long volume = strtoul(value, &end, 10);
+            if (errno != 0 || end == value || *end != '\0' || volume > 100)
+                return Log_Err("Invalid value '%s' for option '%s', must be 0-100", value, arg);
+            config->volume = (uint8_t)volume;
+        }
+        else if (strcmp(arg, "--jit") == 0)
+        {
+            config->jit = true;
+        }
+        else if (strcmp(arg, "--jit-verify") == 0)
+        {
+            config->jit = true;
+            config->jit_verify = true;
+        }
+        else if (strcmp(arg, "--cpu-hz") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+
+            char *end = NULL;
+            const char *value = argv[++i];
+            errno = 0;
+            unsigned long hz = strtoul(value, &end, 10);
+            if (errno != 0 || end == value || *end != '\0' || hz < CPU_HZ_MIN || hz > CPU_HZ_MAX)
+                return Log_Err("Invalid value '%s' for option '%s', must be %d-%d", value, arg, CPU_HZ_MIN, CPU_HZ_MAX);
+            config->cpu_hz = (uint32_t)hz;
+        }
+        else if (strcmp(arg, "--seed") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+
+            char *end = NULL;
+            const char *value = argv[++i];
+            errno = 0;
+            unsigned long seed = strtoul(value, &end, 0);
+            if (errno != 0 || end == value || *end != '\0' || seed == 0 || seed > UINT32_MAX)
+                return Log_Err("Invalid value '%s' for option '%s', must be 1-%u", value, arg, UINT32_MAX);
+            config->rng_seed = (uint32_t)seed;
+        }
+        else if (strcmp(arg, "--trace") == 0 || strcmp(arg, "--decode-trace") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+
+            if (strcmp(arg, "--trace") == 0)
+                config->trace_path = argv[++i];
+            else
+                config->decode_trace_path = argv[++i];
+        }
+        else if (strcmp(arg, "--mode") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+
+            const char *value = argv[++i];
+            int mode = 0;
+            while (mode < MODE_COUNT && strcmp(value, mode_name((machine_mode_t)mode)) != 0)
+                mode++;
+            if (mode == MODE_COUNT)
+                return Log_Err("Invalid value '%s' for option '%s', must be chip8, schip or xochip", value, arg);
+            config->mode = (machine_mode_t)mode;
+            config->mode_given = true;
+        }
+        else if (strcmp(arg, "--quirks") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+
+            const char *value = argv[++i];
+            int quirks = 0;
+            while (quirks < QUIRKS_COUNT && strcmp(value, quirks_name((quirk_profile_t)quirks)) != 0)
+                quirks++;
+            if (quirks == QUIRKS_COUNT)
+                return Log_Err("Invalid value '%s' for option '%s', must be modern, vip, chip48 or schip", value, arg);
+            config->quirks = (quirk_profile_t)quirks;
+            config->quirks_given = true;
+        }
+        else if (strcmp(arg, "--rom-index") == 0)
+        {
+            config->rom_index = true;
+        }
+        else if (strcmp(arg, "--hot-reload") == 0)
+        {
+            config->hot_reload = true;
+        }
+        else if (strcmp(arg, "--threaded") == 0)
+        {
+            config->threaded = true;
+        }
+        else if (strcmp(arg, "--log-level") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+            if (set_log_level(argv[++i]) != 0)
+                return 1;
+        }
+        else if (strcmp(arg, "--debug") == 0)
+        {
+            config->debug = true;
+        }
+        else if (strcmp(arg, "--break") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+            config->breakpoints = argv[++i];
+        }
+        else if (strcmp(arg, "--profile") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+            config->profile_path = argv[++i];
+        }
+        else if (strcmp(arg, "--trace-records") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+
+            char *end = NULL;
+            const char *value = argv[++i];
+            errno = 0;
+            unsigned long records = strtoul(value, &end, 10);
+            if (errno != 0 || end == value || *end != '\0' || records == 0 || records > 0x80000000ul)
+                return Log_Err("Invalid value '%s' for option '%s'", value, arg);
+            config->trace_records = (uint32_t)records;
+        }
+        else if (strcmp(arg, "--cycles") == 0 || strcmp(arg, "--seconds") == 0)
+        {
+            if (i+1 >= argc)
+                return Log_Err("Option '%s' requires a value", arg);
+
+            char *end = NULL;
+            const char *value = argv[++i];
+            errno = 0;
+            if (strcmp(arg, "--cycles") == 0)
+                config->max_cycles = strtoull(value, &end, 10);
+            else
+                config->max_seconds = strtod(value, &end);
+
+            if (errno != 0 || end == value || *end != '\0' || config->max_seconds < 0)
+                return Log_Err("Invalid value '%s' for option '%s'", value, arg);
+        }
+        else if (arg[0] == '-')
+        {
+            Log_Err("Unknown option: '%s'", arg);
+            print_usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            *romName = argv[i];
+        }
     }
-    Log_Info("Initialized: VIDEO, EVENT, AUDIO, and TIMER modules");
-
-    // Create window
-    sdl->window = SDL_CreateWindow(
-        "Chip-8 Interpreter",
-        SDL_WINDOWPOS_CENTERED,
-        SDL_WINDOWPOS_CENTERED,
-        config.window_width * config.window_scale,
-        config.window_height * config.window_scale,
-        SDL_WINDOW_SHOWN
-    );
-    if (sdl->window == NULL)
+
+    // The recompiler only knows the CHIP-8 instruction set
+    if (config->jit && config->mode != MODE_CHIP8)
+        return Log_Err("Option '--jit' only supports '--mode chip8'");
+    if (config->jit && config->quirks != QUIRKS_MODERN)
+        return Log_Err("Option '--jit' only supports '--quirks modern'");
+
+    // Translated blocks can't be counted per instruction
+    if (config->profile_path != NULL && config->jit)
+        return Log_Err("Option '--profile' profiles the interpreter, it can't be used with '--jit'");
+
+    // A movie starts from the ROM's first instruction
+    if (config->record_path != NULL && config->replay_path != NULL)
+        return Log_Err("Options '--record' and '--replay' can't be used together");
+    if (config->load_state_path != NULL && (config->record_path != NULL || config->replay_path != NULL))
+        return Log_Err("Option '--load-state' can't be used with '--record' or '--replay'");
+    if (config->hot_reload && (config->record_path != NULL || config->replay_path != NULL))
+        return Log_Err("Option '--hot-reload' can't be used with '--record' or '--replay'");
+
+    // Reloads are picked up between frames of the window
+    if (config->hot_reload && config->headless)
+        return Log_Err("Option '--hot-reload' can't be used with '--headless'");
+    if (config->threaded && config->headless)
+        return Log_Err("Option '--threaded' can't be used with '--headless'");
+
+    // Headless runs always need a budget, otherwise they would never end, a
+    // replay ends where its recording did
+    if (config->headless && config->replay_path == NULL && config->max_cycles == 0 && config->max_seconds == 0)
+        config->max_cycles = HEADLESS_DEFAULT_CYCLES;
+
+    return 0;
+}
+
+// Run the ROM with the instruction set and quirk profile the ROM library
+// detected for it, where --mode and --quirks didn't choose
+//
+// Returns
+//      0           -> success
+//      *           -> anything else when --jit can't run the detected platform
+int use_detected_platform(config_t *config, const char *romName, machine_mode_t mode, quirk_profile_t quirks)
+{
+    if (!config->mode_given)
+        config->mode = mode;
+    if (!config->quirks_given)
+        config->quirks = quirks;
+
+    if (config->jit && (config->mode != MODE_CHIP8 || config->quirks != QUIRKS_MODERN))
+        return Log_Err("ROM '%s' runs with '--mode %s --quirks %s', '--jit' only supports chip8 and modern",
+            romName, mode_name(config->mode), quirks_name(config->quirks));
+    return 0;
+}
+
+void init_frame_timer(frame_timer_t *timer)
+{
+    timer->frequency = SDL_GetPerformanceFrequency();
+    timer->period = timer->frequency / FRAME_HZ;
+    timer->deadline = SDL_GetPerformanceCounter() + timer->period;
+}
+
+// Wait until the end of the current frame. Deadlines are advanced by exactly one
+// period from the previous deadline, not from "now", so oversleeping one frame
+// is made up in the next one and the loop does not drift off 60Hz.
+void wait_for_next_frame(frame_timer_t *timer)
+{
+    uint64_t now = SDL_GetPerformanceCounter();
+
+    if (now < timer->deadline)
     {
-        Log_Err("Could not create window: %s", SDL_GetError());
-        return 1;
+        // SDL_Delay() can oversleep by a millisecond or so, sleep for all
+        // but the last millisecond then spin out the remainder
+        uint64_t remaining_ms = ((timer->deadline - now) * 1000) / timer->frequency;
+        if (remaining_ms > 1)
+            SDL_Delay((uint32_t)(remaining_ms - 1));
+
+        while (SDL_GetPerformanceCounter() < timer->deadline)
+            ;
+
+        timer->deadline += timer->period;
+        return;
     }
-    Log_Info("Created window");
-
-    // Create renderer
-    sdl->renderer = SDL_CreateRenderer(
-        sdl->window,
-        -1,
-        SDL_RENDERER_ACCELERATED
-    );
-    if(sdl->renderer == NULL)
+
+    // Fell far behind (window dragged, debugger, slow host), don't try to
+    // catch up with a burst of frames, restart pacing from now
+    if (now - timer->deadline > MAX_FRAME_LAG * timer->period)
     {
-        Log_Err("Could not create renderer: %s", SDL_GetError());
+        Log_Debug("Fell %.1f [ms] behind, restarting frame pacing", (now - timer->deadline) * 1000.0 / timer->frequency);
+        timer->deadline = now;
     }
-    Log_Info("Created renderer");
 
-    return 0;
+    timer->deadline += timer->period;
 }
 
-void cleanup_sdl(sdl_t *sdl)
+// Map a host key to the Chip-8 hexadecimal keypad, returns -1 for unmapped keys
+//
+//  Chip-8 keypad       Host keyboard
+//  1 2 3 C             1 2 3 4
+//  4 5 6 D     <-      Q W E R
+//  7 8 9 E             A S D F
+//  A 0 B F             Z X C V
+int map_key(SDL_Keycode key)
 {
-    printf("\n");
-    Log_Warn("Shutting down SDL...");
-    SDL_DestroyRenderer(sdl->renderer);
-    Log_Info("Destroyed Renderer");
-    SDL_DestroyWindow(sdl->window);
-    Log_Info("Destroyed Window");
-    SDL_Quit();
-    Log_Info("Shutdown sub-modules and SDL");
+    switch (key)
+    {
+        case SDLK_1: return 0x1;
+        case SDLK_2: return 0x2;
+        case SDLK_3: return 0x3;
+        case SDLK_4: return 0xC;
+        case SDLK_q: return 0x4;
+        case SDLK_w: return 0x5;
+        case SDLK_e: return 0x6;
+        case SDLK_r: return 0xD;
+        case SDLK_a: return 0x7;
+        case SDLK_s: return 0x8;
+        case SDLK_d: return 0x9;
+        case SDLK_f: return 0xE;
+        case SDLK_z: return 0xA;
+        case SDLK_x: return 0x0;
+        case SDLK_c: return 0xB;
+        case SDLK_v: return 0xF;
+        default:     return -1;
+    }
+}
+
+// Press or release a keypad key, timestamp is the key event's
+static void set_key(hotkeys_t *hotkeys, int key, bool down, uint32_t timestamp)
+{
+    const uint16_t keys = down ? hotkeys->keys | 1 << key : hotkeys->keys & ~(1 << key);
+
+    // Key repeats don't change the keypad, 0 means no change so a change at 0 is 1
+    if (keys != hotkeys->keys && hotkeys->keyTicks == 0)
+        hotkeys->keyTicks = timestamp != 0 ? timestamp : 1;
+    if (keys != hotkeys->keys)
+        Log_Debug("Key %X %s", key, down ? "down" : "up");
+    hotkeys->keys = keys;
 }
 
-void handle_input(sdl_t sdl, const config_t config, chip8_t *chip8)
+void handle_input(sdl_t sdl, const config_t config, hotkeys_t *hotkeys)
 {
     SDL_Event e;
     (void)config;
@@ -184,7 +957,13 @@ void handle_input(sdl_t sdl, const config_t config, chip8_t *chip8)
         switch (e.type)
         {
             case SDL_QUIT:
-                chip8->state = QUIT;
+                hotkeys->quit = true;
+                break;
+
+            case SDL_WINDOWEVENT:
+                // Window contents were lost, present the display again
+                if (e.window.event == SDL_WINDOWEVENT_EXPOSED || e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                    hotkeys->redraw = true;
                 break;
             
             case SDL_KEYDOWN:
@@ -192,31 +971,49 @@ void handle_input(sdl_t sdl, const config_t config, chip8_t *chip8)
                 switch(e.key.keysym.sym)
                 {
                     case SDLK_ESCAPE:
-                        chip8->state = QUIT;
+                        hotkeys->quit = true;
                         break;
                     
                     case SDLK_SPACE:
                         // Disable toggling when key held
-                        if (e.key.repeat == 1) continue;
-
-                        if (chip8->state == RUNNING)
-                        {
-                            chip8->state = PAUSED;
-                            Log_Info("Chip-8 is now: PAUSED");
-                            break;
-                        }
-                        chip8->state = RUNNING;
-                        Log_Info("Chip-8 is now: RUNNING");
+                        if (e.key.repeat == 0)
+                            hotkeys->pause = true;
+                        break;
+
+                    case SDLK_BACKSPACE:
+                        hotkeys->rewind = true;
+                        break;
+
+                    case SDLK_F5:
+                        if (e.key.repeat == 0)
+                            hotkeys->saveState = true;
+                        break;
+
+                    case SDLK_F9:
+                        if (e.key.repeat == 0)
+                            hotkeys->loadState = true;
+                        break;
+
+                    case SDLK_F10:
+                        if (e.key.repeat == 0)
+                            hotkeys->debugBreak = true;
                         break;
                     
                     default:
                         // SDL_SetWindowSize(sdl.window, config.window_width*config.window_scale/2, config.window_height*config.window_scale/2);
+                        if (map_key(e.key.keysym.sym) >= 0)
+                            set_key(hotkeys, map_key(e.key.keysym.sym), true, e.key.timestamp);
                         break;
                 }
                 break;
             
             case SDL_KEYUP:
+                if (e.key.keysym.sym == SDLK_BACKSPACE)
+                    hotkeys->rewind = false;
+
                 // SDL_SetWindowSize(sdl.window, config.window_width*config.window_scale, config.window_height*config.window_scale);
+                if (map_key(e.key.keysym.sym) >= 0)
+                    set_key(hotkeys, map_key(e.key.keysym.sym), false, e.key.timestamp);
                 break;
             
             default:
@@ -225,20 +1022,24 @@ void handle_input(sdl_t sdl, const config_t config, chip8_t *chip8)
     } // ~Poll Events
 }
 
-int initialize_chip8(chip8_t *chip8, const config_t config, char *romName)
+int initialize_chip8(chip8_t *chip8, const config_t config, char *romName, const uint8_t *rom, size_t romSize)
 {
     printf("\n");
     Log_Info("Creating Chip-8 object...");
 
-    // Allocate memory for display data
+    // Allocate memory for display data, set up the instruction set
     // +=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=
-    chip8->displaySize = (config.window_height*config.window_width);
-    chip8->display = (bool*) calloc(chip8->displaySize, sizeof(bool));
-    if(chip8->display == NULL)
-        return Log_Err("Unable to allocate dynamic memory for Chip-8 display");
+    if (setup_machine(chip8, config.mode, config.quirks, config.window_width, config.window_height) != 0)
+        return 1;
     
-    Log_Info("Allocated %i [bytes] of display memory", chip8->displaySize*sizeof(bool));
-    printf("\t\\_ For display of %ix%i\n", config.window_width, config.window_height);
+    Log_Info("Allocated %i [bytes] of display memory", chip8->displayCapacity);
+    if (chip8->mode != MODE_CHIP8)
+        Log_Detail("For %i plane display of %ix%i, %ix%i in high resolution", chip8->displayPlanes,
+            config.window_width, config.window_height, config.window_width * 2, config.window_height * 2);
+    else
+        Log_Detail("For %i plane display of %ix%i", chip8->displayPlanes, config.window_width, config.window_height);
+    Log_Detail("Instruction set: %s, %u [bytes] of RAM", mode_name(chip8->mode), chip8->ramSize);
+    Log_Detail("Quirk profile: %s, sprites %s", quirks_name(chip8->quirks), chip8->displayWrap ? "wrap" : "clip");
 
     // Load Font
     // +=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=
@@ -247,7 +1048,7 @@ int initialize_chip8(chip8_t *chip8, const config_t config, char *romName)
     char *textRomPath = (char*) calloc(textRomPathLen, sizeof(char));
     if(textRomPath == NULL)
         return Log_Err("Unable to allocate dynamic memory for Chip-8 textRomPath");
-    Log_Info("Allocated %i [bytes] of textRomPath memory", textRomPathLen*sizeof(char));
+    Log_Info("Allocated %zu [bytes] of textRomPath memory", textRomPathLen*sizeof(char));
 
     strcpy(textRomPath, config.config_path);
     strcat(textRomPath, config.text_rom_name);
@@ -260,6 +1061,10 @@ int initialize_chip8(chip8_t *chip8, const config_t config, char *romName)
     free(textRomPath);
     Log_Info("Freed Chip-8 textRomPath memory");
 
+    // Chip-8 programs address text sprites through I (Fx29), so they must live in RAM
+    memcpy(&chip8->ram[FONT_ADDRESS], chip8->textSprites, sizeof(chip8->textSprites));
+    Log_Info("Copied text sprites into RAM at %#03x", FONT_ADDRESS);
+
     // Load Rom to Chip-8 Memory
     // +=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=
     // Create path to ROM
@@ -270,7 +1075,7 @@ int initialize_chip8(chip8_t *chip8, const config_t config, char *romName)
     chip8->romPath = (char*) calloc(romPathLen, sizeof(char));
     if(chip8->romPath == NULL)
         return Log_Err("Unable to allocate dynamic memory for Chip-8 romPath");
-    Log_Info("Allocated %i [bytes] of romPath memory", (romPathLen*sizeof(char)));
+    Log_Info("Allocated %zu [bytes] of romPath memory", (romPathLen*sizeof(char)));
 
     strcpy(chip8->romPath, config.rom_path);
     strcat(chip8->romPath, chip8->romName);
@@ -279,21 +1084,37 @@ int initialize_chip8(chip8_t *chip8, const config_t config, char *romName)
     chip8->entrypoint = config.entrypoint;
     Log_Info("Setting entrypoint to %#03x", chip8->entrypoint);
 
-    // Read ROM file into RAM
-    void *ramEntry_ptr = &(chip8->ram[chip8->entrypoint]);
-    int programSize = 4096-(chip8->entrypoint);
-    if(load_rom(chip8->romPath, ramEntry_ptr, sizeof(uint8_t), programSize) != 0)
-        return 1;
-    Log_Info("Loaded ROM: '%s', from: '%s', into RAM", chip8->romName, chip8->romPath);
+    // Copy a ROM the library mapped into RAM, or read the ROM file
+    if (rom != NULL)
+    {
+        if (copy_program(chip8, rom, romSize) != 0)
+            return 1;
+        Log_Info("Copied ROM: '%s', mapped from the ROM library, into RAM", chip8->romName);
+    }
+    else
+    {
+        void *ramEntry_ptr = &(chip8->ram[chip8->entrypoint]);
+        int programSize = chip8->ramSize - chip8->entrypoint;
+        if(load_rom(chip8->romPath, ramEntry_ptr, sizeof(uint8_t), programSize) != 0)
+            return 1;
+        Log_Info("Loaded ROM: '%s', from: '%s', into RAM", chip8->romName, chip8->romPath);
+    }
+
+    // Nothing decoded before this load is valid anymore
+    invalidate_decoded(chip8, 0, CODE_SIZE);
 
     // Set chip-8 defaults
     // +=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=
-    chip8->state = RUNNING;                         // Default Chip-8 state to on/running
-    memset(&chip8->reg, '\0', sizeof(Registers_t)); // Zeroize Chip-8 registers
-    chip8->reg.PC = chip8->entrypoint;              // Default PC to RAM entrypoint
-    chip8->displayX = config.window_width;          // Set display width
-    chip8->displayY = config.window_height;         // Set display height
-    chip8->displayWrap = config.screenWrap;         // Should sprite wrap display
+    restart_machine(chip8);                         // Running, registers zeroed, PC at the entrypoint, blank display
+
+    // Seed the random number generator, xorshift never leaves a 0 state so avoid it
+    chip8->rngState = config.rng_seed;
+    if (chip8->rngState == 0)
+        chip8->rngState = (uint32_t)time(NULL) | 1;
+    Log_Info("Seeded random number generator with: %u", chip8->rngState);
+
+    // Build the opcode dispatch tables
+    init_dispatch();
 
     return 0;       // success
 }
@@ -6,6 +6,13 @@
 #include <SDL2/SDL.h>
 
 #include "chip8.h"
+#include "movie.h"
+#include "scheduler.h"
+#include "savestate.h"
+#include "jit.h"
+#include "debug.h"
+#include "hotreload.h"
+#include "audio.h"
 
 // Configuration Specification Structure
 typedef struct
@@ -47,7 +54,62 @@ typedef struct
     const char *text_rom_name;
     
     const uint16_t entrypoint;
-    bool screenWrap;
+    machine_mode_t mode;            // instruction set, SUPER-CHIP and XO-CHIP double the display in hires
+    uint32_t plane_colors[2];       // XO-CHIP colors of pixels set in plane 1 only and in both planes, 0xRRGGBBAA
+    quirk_profile_t quirks;         // behavior of the instructions interpreters disagree on, and sprite wrap/clip
+    bool mode_given;                // --mode was given, the ROM library's detected instruction set isn't used
+    bool quirks_given;              // --quirks was given, the ROM library's detected quirk profile isn't used
+
+    uint32_t cpu_hz;                // instructions emulated per second
+    uint32_t rng_seed;              // seed of the Chip-8 random number generator, 0 -> seed from time
+
+    // Instruction tracing
+    char *trace_path;               // binary trace file written at exit, NULL -> tracing disabled
+    uint32_t trace_records;         // instructions kept in the trace ring buffer
+    char *decode_trace_path;        // print this trace file as text and exit
+
+    // Headless mode, no SDL window/renderer and no frame delay
+    bool headless;
+    uint64_t max_cycles;            // stop after this many instructions, 0 -> no limit
+    double max_seconds;             // stop after this much wall-clock time, 0 -> no limit
+
+    // x86-64 recompiler
+    bool jit;                       // run translated blocks instead of interpreting
+    bool jit_verify;                // also run the interpreter in lockstep and compare
+
+    // Batch mode, headless jobs run on a pool of worker threads
+    char *batch_path;               // job file, NULL -> no batch
+    uint32_t threads;               // worker threads, 0 -> one per core
+    double tolerance;               // percent jobs may run below their --baseline-ips, 0 -> unchecked
+    char *golden_path;              // job file written with this run's golden results, NULL -> none
+
+    // Sound timer audio, see audio.h
+    uint8_t volume;                 // beeper volume in percent, 0 -> no audio
+
+    // Save states and rewind
+    char *state_path;               // file F5/F9 save to and load from, NULL -> ROM path + ".state"
+    char *load_state_path;          // save state loaded before emulation starts, NULL -> none
+    uint32_t rewind_kb;             // memory budget of the rewind buffer, 0 -> rewind disabled
+
+    // Execution profiler, see profile.h
+    char *profile_path;             // report written at exit, NULL -> not profiling
+
+    // Input movies, see movie.h
+    char *record_path;              // movie written at exit, NULL -> not recording
+    char *replay_path;              // movie replayed instead of live input, NULL -> not replaying
+
+    // Debugger, see debug.h
+    bool debug;                     // stop in the debugger before the first instruction
+    char *breakpoints;              // comma separated breakpoint addresses, NULL -> none
+
+    // ROM library, see romlib.h
+    bool rom_index;                 // rebuild the index of rom_path, list it and exit
+
+    // ROM hot reloading, see hotreload.h
+    bool hot_reload;                // restart with the ROM whenever its file changes
+
+    // Emulation thread, see emuthread.h
+    bool threaded;                  // emulate on a thread of its own, the main thread only handles the window
 
 } config_t;
 
@@ -57,19 +119,104 @@ typedef struct
 {
     SDL_Window *window;
     SDL_Renderer *renderer;
+    SDL_Texture *texture;           // streaming texture the size of the Chip-8 display
 } sdl_t;
 
 
+// Keypad and front end actions from the window, handled by emulate_frame()
+typedef struct
+{
+    uint16_t keys;          // keypad keys held down, bit n -> key n
+    uint32_t keyTicks;      // SDL_GetTicks() of the oldest keypad change not emulated yet, 0 -> none
+    bool rewind;            // rewind is held down
+    bool saveState;         // save state was pressed
+    bool loadState;         // load state was pressed
+    bool debugBreak;        // break into the debugger was pressed
+    bool pause;             // pause was pressed, toggles between running and paused
+    bool quit;              // the window was closed
+    bool redraw;            // the window contents were lost
+} hotkeys_t;
+
+
+// Paces the main loop to 60 frames per second
+typedef struct
+{
+    uint64_t frequency;     // performance counter ticks per second
+    uint64_t period;        // performance counter ticks per frame
+    uint64_t deadline;      // performance counter value the current frame ends at
+} frame_timer_t;
+
+
+// One frame of the display for the window, a view of a machine's display or a
+// copy of it made by the emulation thread
+typedef struct
+{
+    uint64_t *display;              // display planes, like chip8_t's
+    uint32_t planeWords;
+    uint16_t displayWords;
+    uint16_t displayX;
+    uint16_t displayY;
+    uint8_t displayPlanes;
+    uint32_t keyTicks;              // SDL_GetTicks() of the oldest keypad change first emulated in this frame, 0 -> none
+} frame_t;
+
+
+// Input to photon latency, from a key event until the first frame emulated
+// with it is presented
+#define LATENCY_BUCKETS 100
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t totalMs;
+    uint32_t maxMs;
+    uint32_t histogram[LATENCY_BUCKETS];    // keypad changes per ms of latency, the last bucket has the rest
+} latency_t;
+
+
+// Everything the windowed front end emulates a frame with, on the main thread
+// or the emulation thread
+typedef struct
+{
+    chip8_t *chip8;
+    config_t *config;
+    scheduler_t sched;
+    frame_timer_t frameTimer;
+    movie_t *movie;
+    bool moviePlaying;              // recording or replaying, no loading states or rewinding
+    rewind_t *rewind;
+    jit_t *jit;
+    debugger_t *debug;
+    hot_reload_t *hotReload;
+    audio_t *audio;
+    const char *statePath;          // file F5 saves to and F9 loads from
+    int status;                     // exit status, set when a replay ends or fails
+} emulator_t;
+
+
 // forward declarations
 // =======================================
-void update_screen(sdl_t sdl, const config_t config, bool *display);
-void sdl_clear_screen(sdl_t sdl, const config_t config);
+void print_usage(const char *appName);
+int parse_args(int argc, char *argv[], config_t *config, char **romName);
+int use_detected_platform(config_t *config, const char *romName, machine_mode_t mode, quirk_profile_t quirks);
+int start_movie(movie_t *movie, const chip8_t *chip8, const config_t config);
+
+void emulate_frame(emulator_t *emu, hotkeys_t *hotkeys);
+
+void update_screen(sdl_t sdl, const config_t config, chip8_t *chip8);
+void present_frame(sdl_t sdl, const config_t config, const frame_t *frame);
+void record_latency(latency_t *latency, uint32_t keyTicks);
+void print_latency(const latency_t *latency);
 int initialize_sdl(sdl_t *sdl, const config_t config);
 void cleanup_sdl(sdl_t *sdl);
 
-void handle_input(sdl_t sdl, const config_t config, chip8_t *chip8);
+void init_frame_timer(frame_timer_t *timer);
+void wait_for_next_frame(frame_timer_t *timer);
+
+int map_key(SDL_Keycode key);
+void handle_input(sdl_t sdl, const config_t config, hotkeys_t *hotkeys);
 
-int initialize_chip8(chip8_t *chip8, const config_t config, char *romName);
+int initialize_chip8(chip8_t *chip8, const config_t config, char *romName, const uint8_t *rom, size_t romSize);
 void destroy_chip8(chip8_t *chip8);
 
 #endif
\ No newline at end of file
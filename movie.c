@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "movie.h"
+#include "chip8.h"
+#include "helpers/logging.h"
+
+// Movie file layout, host byte order
+//      movie_header_t
+//      one event per keypad change, oldest first
+//          varint      frames since the previous event
+//          uint16_t    keypad, bit n -> key n
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t rngSeed;
+    uint32_t cpu_hz;
+    uint64_t romHash;
+    uint64_t frames;
+    uint64_t cycles;
+    uint64_t displayHash;
+    uint64_t ramHash;
+    uint32_t count;             // events that follow
+    uint8_t mode;               // machine_mode_t
+    uint8_t quirks;             // quirk_profile_t
+    uint16_t reserved;
+} movie_header_t;
+
+static uint16_t get_keys(const chip8_t *chip8)
+{
+    uint16_t keys = 0;
+    for (int i=0; i<16; i++)
+        keys |= (uint16_t)chip8->keypad[i] << i;
+    return keys;
+}
+
+static void set_keys(chip8_t *chip8, uint16_t keys)
+{
+    for (int i=0; i<16; i++)
+        chip8->keypad[i] = (keys >> i) & 0x01;
+}
+
+int start_recording(movie_t *movie, const chip8_t *chip8, const char *path, uint32_t cpu_hz)
+{
+    *movie = (movie_t) {
+        .recording = true,
+        .path = path,
+        .rngSeed = chip8->rngState,
+        .cpu_hz = cpu_hz,
+        .mode = chip8->mode,
+        .quirks = chip8->quirks,
+        .romHash = hash_ram(chip8),
+        .keys = get_keys(chip8)
+    };
+
+    Log_Info("Recording input movie to: '%s'", path);
+    return 0;
+}
+
+int movie_frame(movie_t *movie, chip8_t *chip8, uint64_t frame)
+{
+    if (!movie->recording)
+    {
+        // Live key presses are overridden, only the movie's keys count
+        while (movie->next < movie->count && movie->events[movie->next].frame <= frame)
+            movie->keys = movie->events[movie->next++].keys;
+        set_keys(chip8, movie->keys);
+        return 0;
+    }
+
+    const uint16_t keys = get_keys(chip8);
+    if (keys == movie->keys)
+        return 0;
+
+    if (movie->count == movie->capacity)
+    {
+        uint32_t capacity = movie->capacity ? movie->capacity * 2 : 256;
+        movie_event_t *events = (movie_event_t*) realloc(movie->events, capacity * sizeof(movie_event_t));
+        if (events == NULL)
+            return Log_Err("Unable to allocate dynamic memory for %u movie events", capacity);
+        movie->events = events;
+        movie->capacity = capacity;
+    }
+
+    movie->events[movie->count++] = (movie_event_t) { .frame = frame, .keys = keys };
+    movie->keys = keys;
+    return 0;
+}
+
+int stop_recording(movie_t *movie, const chip8_t *chip8, uint64_t frames, uint64_t cycles)
+{
+    movie->frames = frames;
+    movie->cycles = cycles;
+    movie->displayHash = hash_display(chip8);
+    movie->ramHash = hash_ram(chip8);
+
+    FILE *fp = fopen(movie->path, "wb");
+    if (fp == NULL)
+    {
+        Log_Err("Unable to open movie file: %s", movie->path);
+        Log_Err_Detail("Error: %i -> %s", errno, strerror(errno));
+        return 1;
+    }
+
+    movie_header_t header = {
+        .version = MOVIE_VERSION,
+        .rngSeed = movie->rngSeed,
+        .cpu_hz = movie->cpu_hz,
+        .romHash = movie->romHash,
+        .frames = movie->frames,
+        .cycles = movie->cycles,
+        .displayHash = movie->displayHash,
+        .ramHash = movie->ramHash,
+        .count = movie->count,
+        .mode = (uint8_t)movie->mode,
+        .quirks = (uint8_t)movie->quirks
+    };
+    memcpy(header.magic, MOVIE_MAGIC, sizeof(header.magic));
+    int status = fwrite(&header, sizeof(header), 1, fp) != 1;
+
+    uint64_t previous = 0;
+    for (uint32_t i=0; i<movie->count && status == 0; i++)
+    {
+        // varint of the frame delta then the keys, 3 bytes for most events
+        uint8_t buf[16];
+        uint32_t len = 0;
+        uint64_t delta = movie->events[i].frame - previous;
+        while (delta >= 0x80)
+        {
+            buf[len++] = (uint8_t)(delta | 0x80);
+            delta >>= 7;
+        }
+        buf[len++] = (uint8_t)delta;
+        memcpy(&buf[len], &movie->events[i].keys, sizeof(uint16_t));
+        len += sizeof(uint16_t);
+
+        status = fwrite(buf, len, 1, fp) != 1;
+        previous = movie->events[i].frame;
+    }
+
+    if (fclose(fp) != 0 || status != 0)
+        return Log_Err("Error writing movie file: %s", movie->path);
+
+    Log_Info("Wrote input movie to: '%s'", movie->path);
+    Log_Detail("Frames:       %llu", (unsigned long long)movie->frames);
+    Log_Detail("Instructions: %llu", (unsigned long long)movie->cycles);
+    Log_Detail("Key changes:  %u", movie->count);
+    return 0;
+}
+
+int load_movie(movie_t *movie, const char *path)
+{
+    *movie = (movie_t) { .recording = false, .path = path };
+
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        Log_Err("Unable to open movie file: %s", path);
+        Log_Err_Detail("Error: %i -> %s", errno, strerror(errno));
+        return 1;
+    }
+
+    movie_header_t header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, MOVIE_MAGIC, sizeof(header.magic)) != 0)
+    {
+        fclose(fp);
+        return Log_Err("'%s' is not a movie file", path);
+    }
+    if (header.version != MOVIE_VERSION)
+    {
+        fclose(fp);
+        return Log_Err("Unsupported movie version %u", header.version);
+    }
+    if (header.mode >= MODE_COUNT || header.quirks >= QUIRKS_COUNT)
+    {
+        fclose(fp);
+        return Log_Err("Movie '%s' was recorded with an unknown instruction set or quirk profile", path);
+    }
+
+    movie->rngSeed = header.rngSeed;
+    movie->cpu_hz = header.cpu_hz;
+    movie->mode = (machine_mode_t)header.mode;
+    movie->quirks = (quirk_profile_t)header.quirks;
+    movie->romHash = header.romHash;
+    movie->frames = header.frames;
+    movie->cycles = header.cycles;
+    movie->displayHash = header.displayHash;
+    movie->ramHash = header.ramHash;
+
+    movie->events = (movie_event_t*) calloc(header.count ? header.count : 1, sizeof(movie_event_t));
+    if (movie->events == NULL)
+    {
+        fclose(fp);
+        return Log_Err("Unable to allocate dynamic memory for %u movie events", header.count);
+    }
+    movie->capacity = header.count;
+
+    uint64_t frame = 0;
+    for (uint32_t i=0; i<header.count; i++)
+    {
+        uint64_t delta = 0;
+        int shift = 0;
+        int c;
+        do {
+            c = fgetc(fp);
+            if (c == EOF || shift > 63)
+                break;
+            delta |= (uint64_t)(c & 0x7F) << shift;
+            shift += 7;
+        } while (c & 0x80);
+
+        uint16_t keys;
+        if (c == EOF || fread(&keys, sizeof(keys), 1, fp) != 1)
+        {
+            fclose(fp);
+            return Log_Err("Movie file '%s' is truncated, %u of %u events", path, i, header.count);
+        }
+
+        frame += delta;
+        movie->events[i] = (movie_event_t) { .frame = frame, .keys = keys };
+        movie->count++;
+    }
+    fclose(fp);
+
+    Log_Info("Loaded input movie from: '%s'", path);
+    Log_Detail("Machine:      %s, %s quirks", mode_name(movie->mode), quirks_name(movie->quirks));
+    Log_Detail("Frames:       %llu", (unsigned long long)movie->frames);
+    Log_Detail("Key changes:  %u", movie->count);
+    return 0;
+}
+
+void destroy_movie(movie_t *movie)
+{
+    free(movie->events);
+    movie->events = NULL;
+    movie->count = movie->capacity = 0;
+}
+
+bool movie_finished(const movie_t *movie, uint64_t frame)
+{
+    return !movie->recording && frame >= movie->frames;
+}
+
+int check_replay(const movie_t *movie, const chip8_t *chip8, uint64_t cycles)
+{
+    const uint64_t displayHash = hash_display(chip8);
+    const uint64_t ramHash = hash_ram(chip8);
+
+    if (cycles == movie->cycles && displayHash == movie->displayHash && ramHash == movie->ramHash)
+    {
+        Log_Info("Replay of '%s' matches the recording", movie->path);
+        return 0;
+    }
+
+    Log_Err("Replay of '%s' differs from the recording", movie->path);
+    Log_Err_Detail("Instructions: %llu, recorded %llu", (unsigned long long)cycles, (unsigned long long)movie->cycles);
+    Log_Err_Detail("Display hash: 0x%016llX, recorded 0x%016llX", (unsigned long long)displayHash, (unsigned long long)movie->displayHash);
+    Log_Err_Detail("RAM hash:     0x%016llX, recorded 0x%016llX", (unsigned long long)ramHash, (unsigned long long)movie->ramHash);
+    return 1;
+}
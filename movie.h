@@ -0,0 +1,70 @@
+#ifndef MOVIE_H_IRISH
+#define MOVIE_H_IRISH
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+
+#define MOVIE_MAGIC "C8MV"
+#define MOVIE_VERSION 2
+
+// Keypad state as one bit per key, bit n -> key n
+typedef struct
+{
+    uint64_t frame;             // frame the keypad changed at, applied before it runs
+    uint16_t keys;
+} movie_event_t;
+
+// Input movie, everything outside of the ROM that decides how a run goes: the
+// seed of the random number generator, the CPU clock, the instruction set and
+// quirk profile, and every keypad change.
+// Replaying a movie against the same ROM is bit-exact, windowed or headless.
+typedef struct
+{
+    bool recording;             // true -> recording, false -> replaying
+    const char *path;
+
+    uint32_t rngSeed;           // random number generator state at the first frame
+    uint32_t cpu_hz;
+    machine_mode_t mode;        // --mode and --quirks, they change how the ROM runs
+    quirk_profile_t quirks;
+    uint64_t romHash;           // hash of RAM at the first frame, catches replays against another ROM
+
+    // End of the recording, a replay that gets this far must match it
+    uint64_t frames;
+    uint64_t cycles;
+    uint64_t displayHash;
+    uint64_t ramHash;
+
+    movie_event_t *events;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t next;              // replay: next event to apply
+    uint16_t keys;              // keypad of the last event recorded or applied
+} movie_t;
+
+// Start recording a movie of chip8, written to path by stop_recording()
+int start_recording(movie_t *movie, const chip8_t *chip8, const char *path, uint32_t cpu_hz);
+int stop_recording(movie_t *movie, const chip8_t *chip8, uint64_t frames, uint64_t cycles);
+
+// Read a movie for replay, the caller sets up the machine from rngSeed, cpu_hz,
+// mode and quirks
+int load_movie(movie_t *movie, const char *path);
+void destroy_movie(movie_t *movie);
+
+// Call before every frame: records the keypad when recording, sets the keypad
+// when replaying
+int movie_frame(movie_t *movie, chip8_t *chip8, uint64_t frame);
+
+// A replay is finished once it reached the last frame of the recording
+bool movie_finished(const movie_t *movie, uint64_t frame);
+
+// Compare the end of a finished replay with the end of the recording
+//
+// Returns
+//      0           -> bit-exact
+//      *           -> anything else when the replay went differently
+int check_replay(const movie_t *movie, const chip8_t *chip8, uint64_t cycles);
+
+#endif
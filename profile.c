@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "profile.h"
+#include "chip8.h"
+#include "cpu.h"
+#include "trace.h"
+#include "helpers/logging.h"
+#include "helpers/timing.h"
+
+// Hottest addresses listed in the report, the heatmap has all of them
+#define PROFILE_HOT_ADDRESSES 32
+
+// Readings of the host clock averaged for its overhead
+#define PROFILE_TIMER_CALIBRATION 10000
+
+static const char *opcodeNames[OP_COUNT] = {
+    [OP_UNDECODED]  = "undecoded",
+    [OP_INVALID]    = "invalid",
+    [OP_CLS]        = "00E0 CLS",
+    [OP_RET]        = "00EE RET",
+    [OP_JP]         = "1nnn JP addr",
+    [OP_CALL]       = "2nnn CALL addr",
+    [OP_SE_VX_KK]   = "3xkk SE Vx, byte",
+    [OP_SNE_VX_KK]  = "4xkk SNE Vx, byte",
+    [OP_SE_VX_VY]   = "5xy0 SE Vx, Vy",
+    [OP_LD_VX_KK]   = "6xkk LD Vx, byte",
+    [OP_ADD_VX_KK]  = "7xkk ADD Vx, byte",
+    [OP_LD_VX_VY]   = "8xy0 LD Vx, Vy",
+    [OP_OR]         = "8xy1 OR Vx, Vy",
+    [OP_AND]        = "8xy2 AND Vx, Vy",
+    [OP_XOR]        = "8xy3 XOR Vx, Vy",
+    [OP_ADD_VX_VY]  = "8xy4 ADD Vx, Vy",
+    [OP_SUB]        = "8xy5 SUB Vx, Vy",
+    [OP_SHR]        = "8xy6 SHR Vx",
+    [OP_SUBN]       = "8xy7 SUBN Vx, Vy",
+    [OP_SHL]        = "8xyE SHL Vx",
+    [OP_SNE_VX_VY]  = "9xy0 SNE Vx, Vy",
+    [OP_LD_I]       = "Annn LD I, addr",
+    [OP_JP_V0]      = "Bnnn JP V0, addr",
+    [OP_RND]        = "Cxkk RND Vx, byte",
+    [OP_DRW]        = "Dxyn DRW Vx, Vy, n",
+    [OP_SKP]        = "Ex9E SKP Vx",
+    [OP_SKNP]       = "ExA1 SKNP Vx",
+    [OP_LD_VX_DT]   = "Fx07 LD Vx, DT",
+    [OP_LD_VX_K]    = "Fx0A LD Vx, K",
+    [OP_LD_DT_VX]   = "Fx15 LD DT, Vx",
+    [OP_LD_ST_VX]   = "Fx18 LD ST, Vx",
+    [OP_ADD_I_VX]   = "Fx1E ADD I, Vx",
+    [OP_LD_F_VX]    = "Fx29 LD F, Vx",
+    [OP_LD_B_VX]    = "Fx33 LD B, Vx",
+    [OP_LD_I_VX]    = "Fx55 LD [I], Vx",
+    [OP_LD_VX_I]    = "Fx65 LD Vx, [I]",
+    [OP_SCD]        = "00Cn SCD nibble",
+    [OP_SCR]        = "00FB SCR",
+    [OP_SCL]        = "00FC SCL",
+    [OP_EXIT]       = "00FD EXIT",
+    [OP_LOW]        = "00FE LOW",
+    [OP_HIGH]       = "00FF HIGH",
+    [OP_LD_HF_VX]   = "Fx30 LD HF, Vx",
+    [OP_LD_R_VX]    = "Fx75 LD R, Vx",
+    [OP_LD_VX_R]    = "Fx85 LD Vx, R",
+    [OP_SCU]        = "00Dn SCU nibble",
+    [OP_SAVE_VX_VY] = "5xy2 LD [I], Vx-Vy",
+    [OP_LOAD_VX_VY] = "5xy3 LD Vx-Vy, [I]",
+    [OP_LD_I_LONG]  = "F000 LD I, long",
+    [OP_PLANE]      = "Fn01 PLANE n",
+    [OP_AUDIO]      = "F002 AUDIO",
+    [OP_PITCH]      = "Fx3A PITCH Vx",
+};
+
+void init_profile(profile_t *profile)
+{
+    memset(profile, 0, sizeof(profile_t));
+    profile->rngState = 0x9E3779B9;
+    profile->countdown = profile_next_sample(profile);
+
+    // Every sample reads the clock twice, what that costs isn't the instruction's
+    const uint64_t start = Time_Now_NS();
+    for (int i=0; i<PROFILE_TIMER_CALIBRATION; i++)
+        (void)Time_Now_NS();
+    profile->timerNs = (double)(Time_Now_NS() - start) / PROFILE_TIMER_CALIBRATION;
+
+    Log_Info("Profiling every instruction, timing 1 in %d", PROFILE_SAMPLE_PERIOD);
+    Log_Detail("Host clock overhead: %.1f [ns]", profile->timerNs);
+}
+
+// Estimated host time of all executions of an opcode, from its samples
+static double estimated_ns(const profile_t *profile, int op)
+{
+    if (profile->samples[op] == 0)
+        return 0;
+    return (double)profile->sampleNs[op] / profile->samples[op] * profile->opcodes[op];
+}
+
+static const profile_t *sortProfile;
+
+// Most executed first
+static int compare_opcodes(const void *a, const void *b)
+{
+    const uint64_t x = sortProfile->opcodes[*(const int*)a];
+    const uint64_t y = sortProfile->opcodes[*(const int*)b];
+    return (x < y) - (x > y);
+}
+
+static int compare_addresses(const void *a, const void *b)
+{
+    const uint64_t x = sortProfile->addresses[*(const uint16_t*)a];
+    const uint64_t y = sortProfile->addresses[*(const uint16_t*)b];
+    return (x < y) - (x > y);
+}
+
+static int write_heatmap(const profile_t *profile, const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        Log_Err("Unable to open heatmap file: %s", path);
+        Log_Err_Detail("Error: %i -> %s", errno, strerror(errno));
+        return 1;
+    }
+
+    fprintf(fp, "address,executions\n");
+    for (int i=0; i<4096; i++)
+        fprintf(fp, "0x%03X,%llu\n", i, (unsigned long long)profile->addresses[i]);
+
+    if (fclose(fp) != 0)
+        return Log_Err("Error writing heatmap file: %s", path);
+    return 0;
+}
+
+int write_profile(const profile_t *profile, const chip8_t *chip8, const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        Log_Err("Unable to open profile file: %s", path);
+        Log_Err_Detail("Error: %i -> %s", errno, strerror(errno));
+        return 1;
+    }
+
+    // qsort() has no context argument, the profile being sorted is kept here
+    sortProfile = profile;
+    int ops[OP_COUNT];
+    for (int i=0; i<OP_COUNT; i++)
+        ops[i] = i;
+    qsort(ops, OP_COUNT, sizeof(int), compare_opcodes);
+
+    static uint16_t addresses[4096];
+    for (int i=0; i<4096; i++)
+        addresses[i] = (uint16_t)i;
+    qsort(addresses, 4096, sizeof(uint16_t), compare_addresses);
+
+    double totalNs = 0;
+    uint64_t samples = 0, instructions = 0;
+    for (int i=0; i<OP_COUNT; i++)
+    {
+        totalNs += estimated_ns(profile, i);
+        samples += profile->samples[i];
+        instructions += profile->opcodes[i];
+    }
+    const double total = instructions ? (double)instructions : 1;
+
+    fprintf(fp, "Profile of '%s'\n\n", chip8->romName);
+    fprintf(fp, "Instructions:     %llu\n", (unsigned long long)instructions);
+    fprintf(fp, "Timed samples:    %llu, host clock overhead %.1f ns taken off each\n", (unsigned long long)samples, profile->timerNs);
+    fprintf(fp, "Estimated time:   %.3f ms\n", totalNs / 1e6);
+    fprintf(fp, "Draws:            %llu, %llu sprite rows, %.3f ms estimated\n", (unsigned long long)profile->opcodes[OP_DRW],
+        (unsigned long long)profile->drawRows, estimated_ns(profile, OP_DRW) / 1e6);
+
+    fprintf(fp, "\n%-20s %14s %8s %10s %12s %8s\n", "opcode", "executions", "%", "ns/instr", "est. ms", "time %");
+    for (int i=0; i<OP_COUNT; i++)
+    {
+        const int op = ops[i];
+        if (profile->opcodes[op] == 0)
+            break;
+
+        const double ns = estimated_ns(profile, op);
+        fprintf(fp, "%-20s %14llu %8.3f %10.2f %12.3f %8.3f\n", opcodeNames[op], (unsigned long long)profile->opcodes[op],
+            100.0 * profile->opcodes[op] / total, ns / profile->opcodes[op], ns / 1e6, totalNs > 0 ? 100.0 * ns / totalNs : 0);
+    }
+
+    fprintf(fp, "\nHottest addresses, instructions as they are in RAM now\n");
+    fprintf(fp, "%-8s %-8s %-20s %14s %8s\n", "address", "opcode", "instruction", "executions", "%");
+    for (int i=0; i<PROFILE_HOT_ADDRESSES; i++)
+    {
+        const uint16_t address = addresses[i];
+        if (profile->addresses[address] == 0)
+            break;
+
+        const uint16_t opcode = chip8->ram[address] << 8 | chip8->ram[(address + 1) & 0xFFF];
+        char text[32];
+        disassemble(opcode, text, sizeof(text));
+        fprintf(fp, "0x%03X    %04X     %-20s %14llu %8.3f\n", address, opcode, text,
+            (unsigned long long)profile->addresses[address], 100.0 * profile->addresses[address] / total);
+    }
+
+    if (fclose(fp) != 0)
+        return Log_Err("Error writing profile file: %s", path);
+
+    char heatmapPath[1024];
+    snprintf(heatmapPath, sizeof(heatmapPath), "%s.heatmap.csv", path);
+    if (write_heatmap(profile, heatmapPath) != 0)
+        return 1;
+
+    Log_Info("Wrote profile of %llu instructions to: '%s'", (unsigned long long)instructions, path);
+    Log_Detail("Heatmap: '%s'", heatmapPath);
+    return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef PROFILE_H_IRISH
+#define PROFILE_H_IRISH
+
+#include <stdint.h>
+
+#include "chip8.h"
+#include "cpu.h"
+
+// Execution profiler, build with -DCHIP8_PROFILE=0 to compile it out. While a
+// machine has no profile run_cycles() never looks at it again, the profiled
+// engine is only entered when chip8->profile is set, so the normal engines
+// don't pay anything for it.
+#ifndef CHIP8_PROFILE
+#   define CHIP8_PROFILE 1
+#endif
+
+// Mean instructions between two instructions that are timed on the host clock,
+// timing every instruction would cost more than the instructions themselves.
+// A sample reads the clock twice, 50-100 ns on virtualized hosts, which at 256
+// was still a few percent of the run.
+#define PROFILE_SAMPLE_PERIOD 1024
+
+typedef struct profile
+{
+    uint64_t opcodes[OP_COUNT];         // executions per opcode_id_t
+    uint64_t addresses[4096];           // executions per RAM address, the heatmap
+    uint64_t drawRows;                  // sprite rows drawn by DRW
+
+    // Host time of the sampled instructions, per opcode_id_t
+    uint64_t sampleNs[OP_COUNT];
+    uint64_t samples[OP_COUNT];
+    double timerNs;                     // cost of reading the host clock, taken off every sample
+    uint32_t countdown;                 // instructions until the next sample
+    uint32_t rngState;                  // spreads samples out, a fixed period could alias with ROM loops
+} profile_t;
+
+void init_profile(profile_t *profile);
+
+// Instructions until the next timed one, random with a mean of PROFILE_SAMPLE_PERIOD
+static inline uint32_t profile_next_sample(profile_t *profile)
+{
+    uint32_t x = profile->rngState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    profile->rngState = x;
+    return 1 + (x % (2 * PROFILE_SAMPLE_PERIOD - 1));
+}
+
+// Write the sorted text report to path and the per address execution counts of
+// all 4096 RAM addresses to path + ".heatmap.csv"
+int write_profile(const profile_t *profile, const chip8_t *chip8, const char *path);
+
+#endif
@@ -0,0 +1,512 @@
+// mmap(), fstat() and directory scanning are POSIX, not part of -std=c17
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "romlib.h"
+#include "chip8.h"
+#include "cpu.h"
+#include "helpers/logging.h"
+
+// Longest path and line of the index, tags files longer than ROMLIB_MAX_TAGS are left out
+#define ROMLIB_MAX_PATH 1024
+#define ROMLIB_MAX_TAGS 8192
+#define ROMLIB_MAX_LINE (ROMLIB_MAX_PATH + ROMLIB_MAX_TAGS + 128)
+
+static const char *romExtensions[] = { ".ch8", ".c8", ".sc8", ".xo8" };
+
+static bool has_extension(const char *name, const char *extension)
+{
+    const size_t nameLen = strlen(name);
+    const size_t extLen = strlen(extension);
+    return nameLen > extLen && strcmp(&name[nameLen - extLen], extension) == 0;
+}
+
+static bool is_rom_file(const char *name)
+{
+    for (size_t e=0; e<sizeof(romExtensions)/sizeof(romExtensions[0]); e++)
+        if (has_extension(name, romExtensions[e]))
+            return true;
+    return false;
+}
+
+// Instruction set an opcode needs, MODE_CHIP8 for the ones every set has
+static machine_mode_t opcode_platform(uint16_t opcode)
+{
+    const uint8_t kk = opcode & 0xFF;
+    switch (opcode >> 12)
+    {
+        case 0x0:
+            if ((opcode >= 0x00FB && opcode <= 0x00FF) || (opcode & 0xFFF0) == 0x00C0) return MODE_SCHIP;
+            if ((opcode & 0xFFF0) == 0x00D0) return MODE_XOCHIP;
+            break;
+        case 0x5:
+            if ((opcode & 0x0F) == 0x2 || (opcode & 0x0F) == 0x3) return MODE_XOCHIP;
+            break;
+        case 0xD:
+            if ((opcode & 0x0F) == 0x0) return MODE_SCHIP;
+            break;
+        case 0xF:
+            if (opcode == 0xF000 || opcode == 0xF002 || kk == 0x01 || kk == 0x3A) return MODE_XOCHIP;
+            if (kk == 0x30 || kk == 0x75 || kk == 0x85) return MODE_SCHIP;
+            break;
+        default:
+            break;
+    }
+    return MODE_CHIP8;
+}
+
+// Instruction set from the extension, the ROM's size or the opcodes only the
+// extended sets have. The code is followed from the entrypoint, both ways at
+// skips and into calls, so sprite data isn't mistaken for opcodes.
+static void detect_platform(rom_entry_t *entry, const uint8_t *rom)
+{
+    static uint8_t seen[RAM_SIZE_XOCHIP];
+    memset(seen, 0, entry->size);
+
+    machine_mode_t mode = MODE_CHIP8;
+    uint32_t pending[256];
+    uint32_t count = 0;
+    pending[count++] = 0;
+    while (count != 0)
+    {
+        uint32_t offset = pending[--count];
+        while (offset + 1 < entry->size && !seen[offset])
+        {
+            seen[offset] = 1;
+            const uint16_t opcode = rom[offset] << 8 | rom[offset + 1];
+            if (decode_opcode(opcode, MODE_XOCHIP) == OP_INVALID)
+                break;                                  // ran into data
+            const uint32_t target = (opcode & 0x0FFF) - 0x200;
+            const machine_mode_t needs = opcode_platform(opcode);
+            mode = needs > mode ? needs : mode;
+
+            const uint8_t op = opcode >> 12;
+            if (opcode == 0x00EE || opcode == 0x00FD || op == 0xB)
+                break;                                  // return, exit or a jump only known at run time
+            if (op == 0x1)
+            {
+                offset = target;
+                continue;
+            }
+            if ((op == 0x2 || op == 0x3 || op == 0x4 || op == 0x5 || op == 0x9 || op == 0xE) && count < 256)
+                pending[count++] = op == 0x2 ? target : offset + 4;
+            offset += opcode == 0xF000 ? 4 : 2;         // XO-CHIP's F000 nnnn is 4 bytes
+        }
+    }
+
+    if (has_extension(entry->path, ".xo8") || entry->size > RAM_SIZE - 0x200)
+        mode = MODE_XOCHIP;
+    else if (has_extension(entry->path, ".sc8") && mode == MODE_CHIP8)
+        mode = MODE_SCHIP;
+
+    entry->mode = mode;
+    entry->quirks = mode == MODE_SCHIP ? QUIRKS_SCHIP : QUIRKS_MODERN;
+}
+
+// The .tags file next to a ROM on one line, NULL when there is none
+static char *read_tags(const char *romPath)
+{
+    char tagsPath[ROMLIB_MAX_PATH + 8];
+    snprintf(tagsPath, sizeof(tagsPath), "%s.tags", romPath);
+    FILE *fp = fopen(tagsPath, "rb");
+    if (fp == NULL)
+        return NULL;
+
+    char *tags = (char*) malloc(ROMLIB_MAX_TAGS + 1);
+    const size_t length = tags != NULL ? fread(tags, 1, ROMLIB_MAX_TAGS + 1, fp) : 0;
+    fclose(fp);
+    if (length == 0 || length > ROMLIB_MAX_TAGS)
+    {
+        if (length > ROMLIB_MAX_TAGS)
+            Log_Warn("Tags of '%s' are over %d [bytes], not indexed", romPath, ROMLIB_MAX_TAGS);
+        free(tags);
+        return NULL;
+    }
+
+    tags[length] = '\0';
+    for (size_t i=0; i<length; i++)
+        if (tags[i] == '\n' || tags[i] == '\r')
+            tags[i] = ' ';
+    return tags;
+}
+
+static int add_entry(rom_library_t *library, const rom_entry_t *entry)
+{
+    if (library->count == library->capacity)
+    {
+        const uint32_t capacity = library->capacity != 0 ? library->capacity * 2 : 64;
+        rom_entry_t *entries = (rom_entry_t*) realloc(library->entries, capacity * sizeof(rom_entry_t));
+        if (entries == NULL)
+            return Log_Err("Unable to allocate dynamic memory for the ROM library");
+        library->entries = entries;
+        library->capacity = capacity;
+    }
+    library->entries[library->count++] = *entry;
+    return 0;
+}
+
+static uint64_t hash_path(const char *path)
+{
+    return hash_bytes(path, strlen(path));
+}
+
+// Open addressing, the hashes are FNV-1a so their low bits are already mixed
+static int build_tables(rom_library_t *library)
+{
+    uint32_t slots = 16;
+    while (slots < library->count * 2)
+        slots *= 2;
+
+    free(library->byHash);
+    free(library->byPath);
+    library->byHash = (uint32_t*) calloc(slots, sizeof(uint32_t));
+    library->byPath = (uint32_t*) calloc(slots, sizeof(uint32_t));
+    if (library->byHash == NULL || library->byPath == NULL)
+        return Log_Err("Unable to allocate dynamic memory for the ROM library tables");
+    library->slotMask = slots - 1;
+
+    for (uint32_t i=0; i<library->count; i++)
+    {
+        // A ROM that is in the library twice is found by hash as the first copy
+        uint32_t slot = library->entries[i].hash & library->slotMask;
+        while (library->byHash[slot] != 0 && library->entries[library->byHash[slot] - 1].hash != library->entries[i].hash)
+            slot = (slot + 1) & library->slotMask;
+        if (library->byHash[slot] == 0)
+            library->byHash[slot] = i + 1;
+
+        slot = hash_path(library->entries[i].path) & library->slotMask;
+        while (library->byPath[slot] != 0)
+            slot = (slot + 1) & library->slotMask;
+        library->byPath[slot] = i + 1;
+    }
+    return 0;
+}
+
+// Index every ROM under library->dir + relative, recursively
+static int scan_directory(rom_library_t *library, const char *relative)
+{
+    char dirPath[ROMLIB_MAX_PATH];
+    snprintf(dirPath, sizeof(dirPath), "%s%s", library->dir, relative);
+    DIR *dir = opendir(dirPath);
+    if (dir == NULL)
+        return Log_Err("Unable to open ROM directory '%s': %s", dirPath, strerror(errno));
+
+    static uint8_t rom[RAM_SIZE_XOCHIP];
+    int status = 0;
+    struct dirent *item;
+    while (status == 0 && (item = readdir(dir)) != NULL)
+    {
+        // Hidden files, . and .., and the index itself
+        if (item->d_name[0] == '.')
+            continue;
+
+        char path[ROMLIB_MAX_PATH];
+        char fullPath[ROMLIB_MAX_PATH];
+        if (snprintf(path, sizeof(path), "%s%s", relative, item->d_name) >= (int)sizeof(path) ||
+            snprintf(fullPath, sizeof(fullPath), "%s%s", library->dir, path) >= (int)sizeof(fullPath))
+        {
+            Log_Warn("Path of '%s' is too long, not indexed", item->d_name);
+            continue;
+        }
+
+        struct stat info;
+        if (stat(fullPath, &info) != 0)
+            continue;
+        if (S_ISDIR(info.st_mode))
+        {
+            if (strlen(path) + 1 >= sizeof(path))
+                continue;
+            strcat(path, "/");
+            status = scan_directory(library, path);
+            continue;
+        }
+        if (!S_ISREG(info.st_mode) || !is_rom_file(item->d_name))
+            continue;
+        if (strchr(path, '"') != NULL)
+        {
+            Log_Warn("'%s' has a \" in its path, not indexed", path);
+            continue;
+        }
+        if (info.st_size == 0 || info.st_size > (off_t)sizeof(rom))
+        {
+            Log_Warn("'%s' is empty or too big for any Chip-8, not indexed", path);
+            continue;
+        }
+
+        FILE *fp = fopen(fullPath, "rb");
+        if (fp == NULL)
+            continue;
+        rom_entry_t entry = {
+            .size = (uint32_t)fread(rom, 1, sizeof(rom), fp),
+            .mtime = info.st_mtime,
+            .path = strdup(path),
+            .tags = read_tags(fullPath)
+        };
+        fclose(fp);
+        if (entry.path == NULL)
+        {
+            free(entry.tags);
+            status = Log_Err("Unable to allocate dynamic memory for the ROM library");
+            break;
+        }
+
+        entry.hash = hash_bytes(rom, entry.size);
+        detect_platform(&entry, rom);
+        status = add_entry(library, &entry);
+    }
+
+    closedir(dir);
+    return status;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(((const rom_entry_t*)a)->path, ((const rom_entry_t*)b)->path);
+}
+
+static int write_rom_index(const rom_library_t *library)
+{
+    char indexPath[ROMLIB_MAX_PATH];
+    char tmpPath[ROMLIB_MAX_PATH + 4];
+    snprintf(indexPath, sizeof(indexPath), "%s%s", library->dir, ROMLIB_INDEX_NAME);
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", indexPath);
+
+    FILE *fp = fopen(tmpPath, "w");
+    if (fp == NULL)
+        return Log_Err("Unable to write the ROM index: '%s'", tmpPath);
+
+    fprintf(fp, "# Chip-8 ROM library index of %u ROMs, rebuilt with --rom-index\n", library->count);
+    fprintf(fp, "# HASH SIZE MTIME MODE QUIRKS \"PATH\" TAGS\n");
+    for (uint32_t i=0; i<library->count; i++)
+    {
+        const rom_entry_t *entry = &library->entries[i];
+        fprintf(fp, "0x%016llX %u %lld %s %s \"%s\" %s\n", (unsigned long long)entry->hash, entry->size,
+            (long long)entry->mtime, mode_name(entry->mode), quirks_name(entry->quirks), entry->path,
+            entry->tags != NULL ? entry->tags : "-");
+    }
+
+    if (fclose(fp) != 0 || rename(tmpPath, indexPath) != 0)
+    {
+        remove(tmpPath);
+        return Log_Err("Unable to write the ROM index: '%s'", indexPath);
+    }
+    return 0;
+}
+
+// Returns
+//      0           -> success
+//      *           -> anything else when there is no index or it is invalid
+static int read_rom_index(rom_library_t *library)
+{
+    char indexPath[ROMLIB_MAX_PATH];
+    snprintf(indexPath, sizeof(indexPath), "%s%s", library->dir, ROMLIB_INDEX_NAME);
+    FILE *fp = fopen(indexPath, "r");
+    if (fp == NULL)
+        return 1;
+
+    static char line[ROMLIB_MAX_LINE];
+    int status = 0;
+    uint32_t lineNumber = 0;
+    while (status == 0 && fgets(line, sizeof(line), fp) != NULL)
+    {
+        lineNumber++;
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        line[strcspn(line, "\n")] = '\0';
+
+        unsigned long long hash;
+        unsigned size;
+        long long mtime;
+        char mode[16], quirks[16];
+        int pathStart = 0;
+        if (sscanf(line, "%llx %u %lld %15s %15s \"%n", &hash, &size, &mtime, mode, quirks, &pathStart) != 5 || pathStart == 0)
+        {
+            status = Log_Err("ROM index '%s' line %u is invalid", indexPath, lineNumber);
+            break;
+        }
+
+        char *path = &line[pathStart];
+        char *pathEnd = strchr(path, '"');
+        if (pathEnd == NULL || pathEnd[1] != ' ')
+        {
+            status = Log_Err("ROM index '%s' line %u is invalid", indexPath, lineNumber);
+            break;
+        }
+        *pathEnd = '\0';
+        const char *tags = &pathEnd[2];
+
+        rom_entry_t entry = {
+            .hash = hash,
+            .size = size,
+            .mtime = (time_t)mtime,
+            .mode = MODE_COUNT,
+            .quirks = QUIRKS_COUNT,
+            .path = strdup(path),
+            .tags = strcmp(tags, "-") != 0 ? strdup(tags) : NULL
+        };
+        for (int m=0; m<MODE_COUNT; m++)
+            if (strcmp(mode, mode_name((machine_mode_t)m)) == 0)
+                entry.mode = (machine_mode_t)m;
+        for (int q=0; q<QUIRKS_COUNT; q++)
+            if (strcmp(quirks, quirks_name((quirk_profile_t)q)) == 0)
+                entry.quirks = (quirk_profile_t)q;
+
+        if (entry.path == NULL || entry.mode == MODE_COUNT || entry.quirks == QUIRKS_COUNT)
+        {
+            free(entry.path);
+            free(entry.tags);
+            status = Log_Err("ROM index '%s' line %u is invalid", indexPath, lineNumber);
+            break;
+        }
+        status = add_entry(library, &entry);
+    }
+
+    fclose(fp);
+    return status;
+}
+
+static void free_entries(rom_library_t *library)
+{
+    for (uint32_t i=0; i<library->count; i++)
+    {
+        rom_entry_t *entry = &library->entries[i];
+        if (entry->data != NULL)
+            munmap((void*)entry->data, entry->size);
+        free(entry->path);
+        free(entry->tags);
+    }
+    library->count = 0;
+}
+
+int open_rom_library(rom_library_t *library, const char *dir, bool rescan)
+{
+    memset(library, 0, sizeof(rom_library_t));
+
+    const size_t dirLen = strlen(dir);
+    library->dir = (char*) calloc(dirLen + 2, sizeof(char));
+    if (library->dir == NULL)
+        return Log_Err("Unable to allocate dynamic memory for the ROM library");
+    strcpy(library->dir, dir);
+    if (dirLen == 0 || dir[dirLen - 1] != '/')
+        strcat(library->dir, "/");
+
+    if (rescan || read_rom_index(library) != 0)
+    {
+        free_entries(library);
+        if (scan_directory(library, "") != 0)
+        {
+            close_rom_library(library);
+            return 1;
+        }
+
+        // Sorted by path, so the index of a directory is the same on every host
+        if (library->count != 0)
+            qsort(library->entries, library->count, sizeof(rom_entry_t), compare_paths);
+        if (write_rom_index(library) != 0)
+        {
+            close_rom_library(library);
+            return 1;
+        }
+        Log_Info("Indexed %u ROMs of '%s' into '%s%s'", library->count, library->dir, library->dir, ROMLIB_INDEX_NAME);
+    }
+
+    if (build_tables(library) != 0)
+    {
+        close_rom_library(library);
+        return 1;
+    }
+    return 0;
+}
+
+void close_rom_library(rom_library_t *library)
+{
+    free_entries(library);
+    free(library->entries);
+    free(library->byHash);
+    free(library->byPath);
+    free(library->dir);
+    memset(library, 0, sizeof(rom_library_t));
+}
+
+rom_entry_t *find_rom(const rom_library_t *library, const char *name)
+{
+    if (library->count == 0)
+        return NULL;
+
+    if (name[0] == '@')
+    {
+        char *end = NULL;
+        errno = 0;
+        const uint64_t hash = strtoull(&name[1], &end, 16);
+        if (errno != 0 || end == &name[1] || *end != '\0')
+            return NULL;
+
+        for (uint32_t slot=hash & library->slotMask; library->byHash[slot] != 0; slot=(slot + 1) & library->slotMask)
+            if (library->entries[library->byHash[slot] - 1].hash == hash)
+                return &library->entries[library->byHash[slot] - 1];
+        return NULL;
+    }
+
+    for (uint32_t slot=hash_path(name) & library->slotMask; library->byPath[slot] != 0; slot=(slot + 1) & library->slotMask)
+        if (strcmp(library->entries[library->byPath[slot] - 1].path, name) == 0)
+            return &library->entries[library->byPath[slot] - 1];
+    return NULL;
+}
+
+const uint8_t *map_rom(const rom_library_t *library, rom_entry_t *entry)
+{
+    if (entry->data != NULL)
+        return entry->data;
+
+    char fullPath[ROMLIB_MAX_PATH];
+    snprintf(fullPath, sizeof(fullPath), "%s%s", library->dir, entry->path);
+    const int fd = open(fullPath, O_RDONLY);
+    if (fd < 0)
+    {
+        Log_Err("Unable to open ROM from: %s", fullPath);
+        return NULL;
+    }
+
+    // A ROM edited after indexing would no longer have the indexed hash
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size != (off_t)entry->size || info.st_mtime != entry->mtime)
+    {
+        Log_Warn("'%s' changed since it was indexed, rebuild the index with --rom-index", entry->path);
+        close(fd);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, entry->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        Log_Err("Unable to map ROM '%s': %s", fullPath, strerror(errno));
+        return NULL;
+    }
+
+    entry->data = (const uint8_t*)data;
+    return entry->data;
+}
+
+void print_rom_library(const rom_library_t *library)
+{
+    Log_Info("ROM library of '%s', %u ROMs", library->dir, library->count);
+    printf("%-18s %6s %-7s %-7s %4s %s\n", "hash", "bytes", "mode", "quirks", "tags", "path");
+    for (uint32_t i=0; i<library->count; i++)
+    {
+        const rom_entry_t *entry = &library->entries[i];
+        printf("0x%016llX %6u %-7s %-7s %4s %s\n", (unsigned long long)entry->hash, entry->size,
+            mode_name(entry->mode), quirks_name(entry->quirks), entry->tags != NULL ? "yes" : "-", entry->path);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef ROMLIB_H_IRISH
+#define ROMLIB_H_IRISH
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "chip8.h"
+
+// ROM library, an index of every ROM under a directory (./roms/ by default)
+//
+// The directory is scanned once and the index written to ROMLIB_INDEX_NAME in
+// it, later runs only read the index. Per ROM it keeps the content hash, size
+// and modification time, the instruction set and quirk profile detected from
+// its opcodes and extension, and the contents of its .tags file. ROMs are found
+// by hash or by path in O(1) and mapped read only with mmap(), once per
+// library, so any number of machines start from the same pages without
+// opening or reading the file again.
+//
+// ROMs can be named by content hash anywhere a ROM path is taken, @HASH, e.g.
+//      ./app.out --headless @0x8E0B7DCA1A1F0E9D
+//
+// Index file, one ROM per line, lines starting with # are skipped
+//      HASH SIZE MTIME MODE QUIRKS "PATH" TAGS
+// TAGS is the .tags file on one line, - when there is none. The index is
+// rebuilt with --rom-index, ROMs that changed since are read from their file.
+
+#define ROMLIB_INDEX_NAME ".romlib.idx"
+
+typedef struct
+{
+    uint64_t hash;                  // FNV-1a of the contents, like hash_ram()
+    uint32_t size;
+    time_t mtime;                   // modification time when indexed
+    machine_mode_t mode;            // detected instruction set
+    quirk_profile_t quirks;         // detected quirk profile
+    char *path;                     // relative to the library directory
+    char *tags;                     // contents of the .tags file, NULL -> none
+    const uint8_t *data;            // mapped contents, NULL -> not mapped yet
+} rom_entry_t;
+
+typedef struct
+{
+    char *dir;                      // library directory, ends with /
+    rom_entry_t *entries;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *byHash;               // open addressing tables of entry index + 1, 0 -> empty
+    uint32_t *byPath;
+    uint32_t slotMask;              // slots - 1, slots is a power of 2 at least twice count
+} rom_library_t;
+
+// Read the index of dir, or scan dir and write a new index when there is none
+// or rescan is true
+//
+// Returns
+//      0           -> success
+//      *           -> anything else on failure
+int open_rom_library(rom_library_t *library, const char *dir, bool rescan);
+void close_rom_library(rom_library_t *library);
+
+// Find a ROM by path relative to the library directory, or by hash as @HASH
+//
+// Returns
+//      entry       -> the ROM's entry
+//      NULL        -> when the library has no such ROM
+rom_entry_t *find_rom(const rom_library_t *library, const char *name);
+
+// Map a ROM read only, the mapping lasts until close_rom_library(). Not thread
+// safe, map the ROMs before handing them to other threads.
+//
+// Returns
+//      data        -> the ROM's size bytes
+//      NULL        -> on failure, or when the file changed since it was indexed
+const uint8_t *map_rom(const rom_library_t *library, rom_entry_t *entry);
+
+void print_rom_library(const rom_library_t *library);
+
+#endif
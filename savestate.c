@@ -0,0 +1,438 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#include "savestate.h"
+#include "chip8.h"
+#include "helpers/logging.h"
+
+// Save state file layout, host byte order
+//      char[4]     magic, "C8SS"
+//      uint32_t    version
+//      uint16_t    low resolution display width
+//      uint16_t    low resolution display height
+//      uint32_t    machine_mode_t
+//      uint32_t    bytes of the snapshot that follows
+//      machine_state_t + RAM above 4 KiB + display buffer
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint16_t displayX;
+    uint16_t displayY;
+    uint32_t mode;
+    uint32_t stateSize;
+} savestate_header_t;
+
+uint32_t state_size(const chip8_t *chip8)
+{
+    return sizeof(machine_state_t) + (chip8->ramSize - RAM_SIZE) + chip8->displayCapacity;
+}
+
+void capture_state(const chip8_t *chip8, uint8_t *snapshot)
+{
+    machine_state_t *state = (machine_state_t*)snapshot;
+
+    memcpy(state->Vx, chip8->reg.Vx, sizeof(state->Vx));
+    state->I = chip8->reg.I;
+    state->PC = chip8->reg.PC;
+    state->SP = chip8->reg.SP;
+    state->DT = chip8->reg.DT;
+    state->ST = chip8->reg.ST;
+    state->mode = (uint8_t)chip8->mode;
+    state->rngState = chip8->rngState;
+    memcpy(state->stack, chip8->stack, sizeof(state->stack));
+    for (int i=0; i<16; i++)
+        state->keypad[i] = chip8->keypad[i];
+    state->hires = chip8->hires;
+    state->planeMask = chip8->planeMask;
+    state->pitch = chip8->pitch;
+    state->reserved = 0;
+    memcpy(state->flags, chip8->flags, sizeof(state->flags));
+    memcpy(state->audioPattern, chip8->audioPattern, sizeof(state->audioPattern));
+
+    // XO-CHIP's RAM runs on past the end of the struct, so all of it is written
+    // through a byte pointer rather than state->ram
+    memcpy(snapshot + offsetof(machine_state_t, ram), chip8->ram, chip8->ramSize);
+
+    // The whole buffer, so every snapshot of a machine has the same size whatever the resolution
+    memcpy(snapshot + sizeof(machine_state_t) + (chip8->ramSize - RAM_SIZE), chip8->display, chip8->displayCapacity);
+}
+
+void restore_state(chip8_t *chip8, const uint8_t *snapshot)
+{
+    const machine_state_t *state = (const machine_state_t*)snapshot;
+
+    memcpy(chip8->reg.Vx, state->Vx, sizeof(state->Vx));
+    chip8->reg.I = state->I;
+    chip8->reg.PC = state->PC;
+    chip8->reg.SP = state->SP;
+    chip8->reg.DT = state->DT;
+    chip8->reg.ST = state->ST;
+    chip8->rngState = state->rngState;
+    memcpy(chip8->stack, state->stack, sizeof(state->stack));
+    for (int i=0; i<16; i++)
+        chip8->keypad[i] = state->keypad[i] != 0;
+    chip8->planeMask = state->planeMask;
+    chip8->pitch = state->pitch;
+    memcpy(chip8->flags, state->flags, sizeof(state->flags));
+    memcpy(chip8->audioPattern, state->audioPattern, sizeof(state->audioPattern));
+
+    // Only the RAM that differs goes stale in the decode cache and JIT, most
+    // frames don't write code so rewinding doesn't throw away decoded work.
+    // The rest of XO-CHIP's RAM follows the state, so RAM is read through a
+    // byte pointer into the snapshot rather than state->ram.
+    const uint8_t *ram = snapshot + offsetof(machine_state_t, ram);
+    for (uint32_t i=0; i<chip8->ramSize; )
+    {
+        if (chip8->ram[i] == ram[i])
+        {
+            i++;
+            continue;
+        }
+
+        uint32_t start = i;
+        while (i < chip8->ramSize && chip8->ram[i] != ram[i])
+            i++;
+        memcpy(&chip8->ram[start], &ram[start], i - start);
+        invalidate_decoded(chip8, start, i - start);
+    }
+
+    // Switching resolution clears the buffer, so the display is restored after it
+    if (chip8->hires != (state->hires != 0))
+        set_resolution(chip8, state->hires != 0);
+    memcpy(chip8->display, snapshot + sizeof(machine_state_t) + (chip8->ramSize - RAM_SIZE), chip8->displayCapacity);
+    chip8->displayDirty = true;
+}
+
+int save_state(const chip8_t *chip8, const char *path)
+{
+    const uint32_t size = state_size(chip8);
+    uint8_t *snapshot = (uint8_t*) malloc(size);
+    if (snapshot == NULL)
+        return Log_Err("Unable to allocate dynamic memory for a save state");
+    capture_state(chip8, snapshot);
+
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        free(snapshot);
+        Log_Err("Unable to open save state file: %s", path);
+        Log_Err_Detail("Error: %i -> %s", errno, strerror(errno));
+        return 1;
+    }
+
+    savestate_header_t header = {
+        .version = SAVESTATE_VERSION,
+        .displayX = chip8->loresX,
+        .displayY = chip8->loresY,
+        .mode = chip8->mode,
+        .stateSize = size
+    };
+    memcpy(header.magic, SAVESTATE_MAGIC, sizeof(header.magic));
+
+    int status = fwrite(&header, sizeof(header), 1, fp) != 1;
+    status |= fwrite(snapshot, size, 1, fp) != 1;
+    status |= fclose(fp) != 0;
+    free(snapshot);
+
+    if (status != 0)
+        return Log_Err("Error writing save state file: %s", path);
+
+    Log_Info("Saved state to: '%s'", path);
+    return 0;
+}
+
+int load_state(chip8_t *chip8, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        Log_Err("Unable to open save state file: %s", path);
+        Log_Err_Detail("Error: %i -> %s", errno, strerror(errno));
+        return 1;
+    }
+
+    savestate_header_t header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, SAVESTATE_MAGIC, sizeof(header.magic)) != 0)
+    {
+        fclose(fp);
+        return Log_Err("'%s' is not a save state file", path);
+    }
+    if (header.version != SAVESTATE_VERSION)
+    {
+        fclose(fp);
+        return Log_Err("Unsupported save state version %u", header.version);
+    }
+    if (header.mode != chip8->mode)
+    {
+        fclose(fp);
+        return Log_Err("Save state is for the %s instruction set, this machine is %s", mode_name(header.mode), mode_name(chip8->mode));
+    }
+    if (header.displayX != chip8->loresX || header.displayY != chip8->loresY || header.stateSize != state_size(chip8))
+    {
+        fclose(fp);
+        return Log_Err("Save state is for a %ix%i display, this machine is %ix%i", header.displayX, header.displayY, chip8->loresX, chip8->loresY);
+    }
+
+    uint8_t *snapshot = (uint8_t*) malloc(header.stateSize);
+    if (snapshot == NULL)
+    {
+        fclose(fp);
+        return Log_Err("Unable to allocate dynamic memory for a save state");
+    }
+
+    int status = fread(snapshot, header.stateSize, 1, fp) != 1;
+    fclose(fp);
+    if (status != 0)
+    {
+        free(snapshot);
+        return Log_Err("Save state file '%s' is truncated", path);
+    }
+
+    // The registers index the stack and the display planes, a corrupted file
+    // must not take them out of range
+    const machine_state_t *state = (const machine_state_t*)snapshot;
+    const uint8_t allPlanes = (uint8_t)((1 << chip8->displayPlanes) - 1);
+    if (state->SP >= sizeof(chip8->stack) / sizeof(chip8->stack[0]) || (state->planeMask & ~allPlanes) != 0)
+    {
+        Log_Err("Save state file '%s' is corrupted", path);
+        Log_Err_Detail("SP: %u, plane mask: 0x%02X", state->SP, state->planeMask);
+        free(snapshot);
+        return 1;
+    }
+
+    restore_state(chip8, snapshot);
+    free(snapshot);
+
+    Log_Info("Loaded state from: '%s'", path);
+    return 0;
+}
+
+
+// Rewind delta encoding
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+// The XOR of two snapshots is a sequence of
+//      varint      bytes that are equal, skipped
+//      varint      bytes that differ
+//      uint8_t[]   XOR of the bytes that differ
+// until the end of the snapshot. Frames mostly touch a few registers, a few
+// bytes of RAM and some of the display, so nearly all of it is skipped.
+
+static inline uint8_t *put_varint(uint8_t *out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+static inline const uint8_t *get_varint(const uint8_t *in, uint32_t *value)
+{
+    uint32_t result = 0;
+    int shift = 0;
+    do {
+        result |= (uint32_t)(*in & 0x7F) << shift;
+        shift += 7;
+    } while (*in++ & 0x80);
+    *value = result;
+    return in;
+}
+
+// Length of the run of equal bytes at the start of a and b, 8 bytes at a time
+static inline uint32_t equal_run(const uint8_t *a, const uint8_t *b, uint32_t size)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t x, y;
+        memcpy(&x, a + i, sizeof(x));
+        memcpy(&y, b + i, sizeof(y));
+        if (x != y)
+            break;
+    }
+    while (i < size && a[i] == b[i])
+        i++;
+    return i;
+}
+
+// Encode the XOR of two snapshots, out needs room for size + size/2 + 16 bytes
+static uint32_t encode_delta(const uint8_t *from, const uint8_t *to, uint32_t size, uint8_t *out)
+{
+    uint8_t *start = out;
+    uint32_t i = 0;
+
+    while (i < size)
+    {
+        uint32_t skip = equal_run(from + i, to + i, size - i);
+        i += skip;
+
+        // A literal run ends at the first two equal bytes, a single equal byte
+        // is cheaper kept in the run than as a new skip/length pair
+        uint32_t literal = 0;
+        while (i + literal < size)
+        {
+            if (from[i + literal] == to[i + literal]
+                && (i + literal + 1 == size || from[i + literal + 1] == to[i + literal + 1]))
+                break;
+            literal++;
+        }
+
+        out = put_varint(out, skip);
+        out = put_varint(out, literal);
+        for (uint32_t j=0; j<literal; j++)
+            *out++ = from[i + j] ^ to[i + j];
+        i += literal;
+    }
+    return (uint32_t)(out - start);
+}
+
+// XOR an encoded delta into a snapshot, works in either direction
+static void apply_delta(uint8_t *snapshot, const uint8_t *delta, uint32_t deltaSize)
+{
+    const uint8_t *end = delta + deltaSize;
+    uint32_t i = 0;
+
+    while (delta < end)
+    {
+        uint32_t skip, literal;
+        delta = get_varint(delta, &skip);
+        delta = get_varint(delta, &literal);
+
+        i += skip;
+        for (uint32_t j=0; j<literal; j++)
+            snapshot[i++] ^= *delta++;
+    }
+}
+
+
+// Rewind buffer
+// =+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+
+int init_rewind(rewind_t *rewind, const chip8_t *chip8, uint32_t budget)
+{
+    *rewind = (rewind_t) {0};
+    rewind->capacity = budget;
+    rewind->stateSize = state_size(chip8);
+
+    const uint32_t scratchSize = rewind->stateSize + (rewind->stateSize / 2) + 16;
+    rewind->data = (uint8_t*) malloc(budget);
+    rewind->entries = (rewind_entry_t*) calloc(REWIND_MAX_FRAMES, sizeof(rewind_entry_t));
+    rewind->current = (uint8_t*) malloc(rewind->stateSize);
+    rewind->next = (uint8_t*) malloc(rewind->stateSize);
+    rewind->scratch = (uint8_t*) malloc(scratchSize);
+    if (rewind->data == NULL || rewind->entries == NULL || rewind->current == NULL || rewind->next == NULL || rewind->scratch == NULL)
+    {
+        destroy_rewind(rewind);
+        return Log_Err("Unable to allocate dynamic memory for the rewind buffer");
+    }
+
+    Log_Info("Allocated %u [bytes] of rewind memory", budget);
+    Log_Detail("For at most %i frames of %u [bytes] snapshots", REWIND_MAX_FRAMES, rewind->stateSize);
+    return 0;
+}
+
+void destroy_rewind(rewind_t *rewind)
+{
+    free(rewind->data);
+    free(rewind->entries);
+    free(rewind->current);
+    free(rewind->next);
+    free(rewind->scratch);
+    *rewind = (rewind_t) {0};
+}
+
+static inline void drop_oldest(rewind_t *rewind)
+{
+    rewind->first = (rewind->first + 1) % REWIND_MAX_FRAMES;
+    rewind->count--;
+}
+
+void rewind_record(rewind_t *rewind, const chip8_t *chip8)
+{
+    capture_state(chip8, rewind->next);
+    if (!rewind->haveCurrent)
+    {
+        uint8_t *swap = rewind->current;
+        rewind->current = rewind->next;
+        rewind->next = swap;
+        rewind->haveCurrent = true;
+        return;
+    }
+
+    const uint32_t size = encode_delta(rewind->current, rewind->next, rewind->stateSize, rewind->scratch);
+    uint8_t *swap = rewind->current;
+    rewind->current = rewind->next;
+    rewind->next = swap;
+
+    rewind->framesRecorded++;
+    rewind->bytesRecorded += size;
+
+    // A delta bigger than the whole budget can't be kept, and without it the
+    // older frames can't be reached anymore either
+    if (size > rewind->capacity)
+    {
+        rewind->count = 0;
+        rewind->end = 0;
+        return;
+    }
+
+    // Deltas are placed one after the other, wrapping to the start when the
+    // end of data is reached, and overwrite the oldest deltas in their way
+    uint32_t offset = rewind->end;
+    if (offset + size > rewind->capacity)
+    {
+        // Deltas past end are the oldest ones, left from the previous lap
+        // around data, and the tail they sit in is skipped
+        while (rewind->count > 0 && rewind->entries[rewind->first].offset >= rewind->end)
+            drop_oldest(rewind);
+        offset = 0;
+    }
+    if (rewind->count == REWIND_MAX_FRAMES)
+        drop_oldest(rewind);
+    while (rewind->count > 0)
+    {
+        const rewind_entry_t *oldest = &rewind->entries[rewind->first];
+        if (oldest->offset >= offset + size || offset >= oldest->offset + oldest->size)
+            break;
+        drop_oldest(rewind);
+    }
+
+    memcpy(rewind->data + offset, rewind->scratch, size);
+    rewind_entry_t *entry = &rewind->entries[(rewind->first + rewind->count) % REWIND_MAX_FRAMES];
+    entry->offset = offset;
+    entry->size = size;
+    rewind->count++;
+    rewind->end = offset + size;
+}
+
+int rewind_step(rewind_t *rewind, chip8_t *chip8)
+{
+    if (rewind->count == 0)
+        return 1;
+
+    const rewind_entry_t *newest = &rewind->entries[(rewind->first + rewind->count - 1) % REWIND_MAX_FRAMES];
+    apply_delta(rewind->current, rewind->data + newest->offset, newest->size);
+    rewind->end = newest->offset;
+    rewind->count--;
+
+    restore_state(chip8, rewind->current);
+    return 0;
+}
+
+void print_rewind_stats(const rewind_t *rewind)
+{
+    Log_Info("Rewind statistics");
+    Log_Detail("Frames held:      %u (%.1f [s])", rewind->count, rewind->count / 60.0);
+    Log_Detail("Frames recorded:  %llu", (unsigned long long)rewind->framesRecorded);
+    if (rewind->framesRecorded > 0)
+        Log_Detail("Bytes per frame:  %.1f average, %u per snapshot",
+            (double)rewind->bytesRecorded / rewind->framesRecorded, rewind->stateSize);
+}
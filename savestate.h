@@ -0,0 +1,98 @@
+#ifndef SAVESTATE_H_IRISH
+#define SAVESTATE_H_IRISH
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8.h"
+
+#define SAVESTATE_MAGIC "C8SS"
+#define SAVESTATE_VERSION 2
+
+// Everything of a machine that a program can observe, XO-CHIP's RAM above the
+// first 4 KiB and then the whole display buffer follow it. Fixed layout so it
+// can be written to disk and XORed against another state.
+typedef struct __attribute__((__packed__))
+{
+    uint8_t Vx[16];
+    uint16_t I;
+    uint16_t PC;
+    uint8_t SP;
+    uint8_t DT;
+    uint8_t ST;
+    uint8_t mode;               // machine_mode_t, states only load into a machine of the same mode
+    uint32_t rngState;
+    uint16_t stack[16];
+    uint8_t keypad[16];
+    uint8_t hires;
+    uint8_t planeMask;
+    uint8_t pitch;
+    uint8_t reserved;
+    uint8_t flags[16];
+    uint8_t audioPattern[16];
+    uint8_t ram[RAM_SIZE];
+} machine_state_t;
+
+// Bytes of a snapshot of chip8, machine_state_t followed by the rest of RAM and the display
+uint32_t state_size(const chip8_t *chip8);
+void capture_state(const chip8_t *chip8, uint8_t *snapshot);
+void restore_state(chip8_t *chip8, const uint8_t *snapshot);
+
+// Versioned save state files
+//
+// Returns
+//      0           -> success
+//      *           -> anything else on failure, the machine is unchanged
+int save_state(const chip8_t *chip8, const char *path);
+int load_state(chip8_t *chip8, const char *path);
+
+
+// Rewind buffer, one snapshot per frame stored as the XOR of it and the snapshot
+// before it, run length encoded. XOR deltas work in both directions, so only the
+// newest snapshot is kept whole and rewinding XORs the deltas back into it.
+// The oldest frames are dropped to stay within the memory budget.
+
+// Frames the rewind buffer can hold regardless of budget, 10 minutes at 60Hz
+#define REWIND_MAX_FRAMES (60 * 60 * 10)
+
+typedef struct
+{
+    uint32_t offset;            // start of the delta in data
+    uint32_t size;              // bytes of the encoded delta
+} rewind_entry_t;
+
+typedef struct
+{
+    uint8_t *data;              // encoded deltas, used as a ring
+    uint32_t capacity;          // bytes of data, the memory budget
+    uint32_t end;               // offset in data after the newest delta
+
+    rewind_entry_t *entries;    // ring of deltas, oldest first
+    uint32_t first;             // index of the oldest delta
+    uint32_t count;             // deltas held, frames that can be rewound
+
+    uint32_t stateSize;         // bytes of one snapshot
+    uint8_t *current;           // newest snapshot, NULL -> nothing recorded yet
+    uint8_t *next;              // snapshot being recorded
+    uint8_t *scratch;           // delta being encoded
+    bool haveCurrent;
+
+    uint64_t framesRecorded;    // every frame ever recorded, including dropped ones
+    uint64_t bytesRecorded;     // bytes of every delta ever recorded
+} rewind_t;
+
+int init_rewind(rewind_t *rewind, const chip8_t *chip8, uint32_t budget);
+void destroy_rewind(rewind_t *rewind);
+void print_rewind_stats(const rewind_t *rewind);
+
+// Record the machine at the end of a frame
+void rewind_record(rewind_t *rewind, const chip8_t *chip8);
+
+// Restore the machine to the frame recorded before the newest one
+//
+// Returns
+//      0           -> success
+//      *           -> anything else when there is nothing left to rewind
+int rewind_step(rewind_t *rewind, chip8_t *chip8);
+
+#endif
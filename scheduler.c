@@ -0,0 +1,61 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "scheduler.h"
+#include "chip8.h"
+#include "cpu.h"
+#include "helpers/logging.h"
+
+void init_scheduler(scheduler_t *sched, uint32_t cpu_hz)
+{
+    *sched = (scheduler_t) {
+        .cpu_hz = cpu_hz,
+        .cycleRemainder = 0,
+        .cycles = 0,
+        .frames = 0
+    };
+}
+
+// Number of instructions in the next frame. The remainder of cpu_hz/FRAME_HZ is
+// carried between frames so that every second runs exactly cpu_hz instructions
+// e.g. 700Hz -> 11, 12, 12, 11, 12, 12, ...
+uint32_t next_frame_cycles(scheduler_t *sched)
+{
+    uint32_t total = sched->cycleRemainder + sched->cpu_hz;
+    sched->cycleRemainder = total % FRAME_HZ;
+    return total / FRAME_HZ;
+}
+
+// Emulate one 60Hz frame: the frame's share of the CPU clock followed by one
+// timer tick.
+//
+// chip8_t *chip8       -> machine to emulate
+// scheduler_t *sched   -> clock of the machine
+// uint64_t maxCycles   -> cap on the instructions run, a capped frame is left
+//                         incomplete and does not tick the timers, 0 -> no cap
+//
+// Returns
+//      0           -> success
+//      *           -> anything else on fatal emulation error
+int run_frame(chip8_t *chip8, scheduler_t *sched, uint64_t maxCycles)
+{
+    uint32_t frameCycles = next_frame_cycles(sched);
+    bool completeFrame = true;
+    if (maxCycles != 0 && frameCycles > maxCycles)
+    {
+        frameCycles = maxCycles;
+        completeFrame = false;
+    }
+
+    if (run_cycles(chip8, frameCycles) != 0)
+        return 1;
+    sched->cycles += frameCycles;
+
+    if (completeFrame)
+    {
+        tick_timers(chip8);
+        sched->frames++;
+    }
+
+    return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef SCHEDULER_H_IRISH
+#define SCHEDULER_H_IRISH
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+// Chip-8 timers and display refresh run at a fixed 60Hz regardless of CPU clock
+#define FRAME_HZ 60
+
+// Splits the CPU clock into whole instructions per 60Hz frame
+typedef struct
+{
+    uint32_t cpu_hz;            // instructions emulated per second
+    uint32_t cycleRemainder;    // leftover of cpu_hz/FRAME_HZ carried into the next frame
+    uint64_t cycles;            // total instructions emulated
+    uint64_t frames;            // total complete frames emulated
+} scheduler_t;
+
+void init_scheduler(scheduler_t *sched, uint32_t cpu_hz);
+uint32_t next_frame_cycles(scheduler_t *sched);
+int run_frame(chip8_t *chip8, scheduler_t *sched, uint64_t maxCycles);
+
+#endif
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "trace.h"
+#include "cpu.h"
+#include "helpers/logging.h"
+
+// Trace file layout, host byte order
+//      char[4]     magic, "C8TR"
+//      uint32_t    version
+//      uint32_t    size of one record
+//      uint64_t    number of records that follow
+//      trace_record_t[]
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t count;
+} trace_header_t;
+
+int init_trace(trace_buffer_t *trace, uint32_t capacity)
+{
+    // round capacity up to a power of 2 so wrapping is a mask
+    uint32_t size = 1;
+    while (size < capacity && size < 0x80000000u)
+        size <<= 1;
+
+    trace->records = (trace_record_t*) calloc(size, sizeof(trace_record_t));
+    if (trace->records == NULL)
+        return Log_Err("Unable to allocate dynamic memory for %u trace records", size);
+
+    trace->mask = size - 1;
+    trace->head = 0;
+    Log_Info("Allocated %zu [bytes] of trace memory for %u instructions", size*sizeof(trace_record_t), size);
+    return 0;
+}
+
+void destroy_trace(trace_buffer_t *trace)
+{
+    free(trace->records);
+    trace->records = NULL;
+}
+
+int write_trace(const trace_buffer_t *trace, const char *path)
+{
+    const uint64_t capacity = (uint64_t)trace->mask + 1;
+    const uint64_t count = trace->head < capacity ? trace->head : capacity;
+    const uint64_t first = trace->head - count;
+
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        Log_Err("Unable to open trace file: %s", path);
+        Log_Err_Detail("Error: %i -> %s", errno, strerror(errno));
+        return 1;
+    }
+
+    trace_header_t header = { .version = TRACE_VERSION, .recordSize = sizeof(trace_record_t), .count = count };
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    int status = fwrite(&header, sizeof(header), 1, fp) != 1;
+
+    // oldest record first, in at most two contiguous pieces of the ring
+    for (uint64_t written=0; written<count && status == 0; )
+    {
+        uint64_t index = (first + written) & trace->mask;
+        uint64_t chunk = capacity - index;
+        if (chunk > count - written)
+            chunk = count - written;
+
+        status = fwrite(&trace->records[index], sizeof(trace_record_t), chunk, fp) != chunk;
+        written += chunk;
+    }
+
+    if (fclose(fp) != 0 || status != 0)
+        return Log_Err("Error writing trace file: %s", path);
+
+    Log_Info("Wrote %llu trace records to: '%s'", (unsigned long long)count, path);
+    return 0;
+}
+
+// Append the registers that differ between two records to buf
+static void format_deltas(const trace_record_t *before, const trace_record_t *after, char *buf, size_t size)
+{
+    size_t len = 0;
+    buf[0] = '\0';
+
+    for (int i=0; i<16 && len<size; i++)
+        if (before->Vx[i] != after->Vx[i])
+            len += snprintf(buf + len, size - len, "V%1X=0x%02X ", i, after->Vx[i]);
+    if (before->I != after->I && len < size)
+        len += snprintf(buf + len, size - len, "I=0x%03X ", after->I);
+    if (before->SP != after->SP && len < size)
+        len += snprintf(buf + len, size - len, "SP=%i ", after->SP);
+    if (before->DT != after->DT && len < size)
+        len += snprintf(buf + len, size - len, "DT=0x%02X ", after->DT);
+    if (before->ST != after->ST && len < size)
+        snprintf(buf + len, size - len, "ST=0x%02X ", after->ST);
+}
+
+int decode_trace(const char *path, FILE *out)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        Log_Err("Unable to open trace file: %s", path);
+        Log_Err_Detail("Error: %i -> %s", errno, strerror(errno));
+        return 1;
+    }
+
+    trace_header_t header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0)
+    {
+        fclose(fp);
+        return Log_Err("'%s' is not a trace file", path);
+    }
+    if (header.version != TRACE_VERSION || header.recordSize != sizeof(trace_record_t))
+    {
+        fclose(fp);
+        return Log_Err("Unsupported trace file version %u, record size %u", header.version, header.recordSize);
+    }
+
+    // Deltas of a record are only known once the next record is read
+    trace_record_t current, next;
+    char text[32];
+    char deltas[160];
+    uint64_t decoded = 0;
+
+    fprintf(out, "%-10s %-6s %-6s %-20s %s\n", "cycle", "PC", "opcode", "instruction", "changes");
+    bool haveCurrent = fread(&current, sizeof(current), 1, fp) == 1;
+    while (haveCurrent)
+    {
+        bool haveNext = fread(&next, sizeof(next), 1, fp) == 1;
+
+        disassemble(current.opcode, text, sizeof(text));
+        if (haveNext)
+            format_deltas(&current, &next, deltas, sizeof(deltas));
+        else
+            snprintf(deltas, sizeof(deltas), "?");
+
+        fprintf(out, "%010u 0x%04X 0x%04X %-20s %s\n", current.cycle, current.PC, current.opcode, text, deltas);
+        decoded++;
+
+        current = next;
+        haveCurrent = haveNext;
+    }
+    fclose(fp);
+
+    if (decoded != header.count)
+        Log_Warn("Trace file '%s' is truncated, %llu of %llu records", path, (unsigned long long)decoded, (unsigned long long)header.count);
+    return 0;
+}
+
+void disassemble(uint16_t opcode, char *buf, size_t size)
+{
+    const unsigned x = (opcode >> 8) & 0x0F;
+    const unsigned y = (opcode >> 4) & 0x0F;
+    const unsigned n = opcode & 0x0F;
+    const unsigned kk = opcode & 0xFF;
+    const unsigned nnn = opcode & 0x0FFF;
+
+    // The XO-CHIP instruction set contains the others
+    switch (decode_opcode(opcode, MODE_XOCHIP))
+    {
+        case OP_CLS:        snprintf(buf, size, "CLS"); break;
+        case OP_RET:        snprintf(buf, size, "RET"); break;
+        case OP_JP:         snprintf(buf, size, "JP 0x%03X", nnn); break;
+        case OP_CALL:       snprintf(buf, size, "CALL 0x%03X", nnn); break;
+        case OP_SE_VX_KK:   snprintf(buf, size, "SE V%1X, 0x%02X", x, kk); break;
+        case OP_SNE_VX_KK:  snprintf(buf, size, "SNE V%1X, 0x%02X", x, kk); break;
+        case OP_SE_VX_VY:   snprintf(buf, size, "SE V%1X, V%1X", x, y); break;
+        case OP_LD_VX_KK:   snprintf(buf, size, "LD V%1X, 0x%02X", x, kk); break;
+        case OP_ADD_VX_KK:  snprintf(buf, size, "ADD V%1X, 0x%02X", x, kk); break;
+        case OP_LD_VX_VY:   snprintf(buf, size, "LD V%1X, V%1X", x, y); break;
+        case OP_OR:         snprintf(buf, size, "OR V%1X, V%1X", x, y); break;
+        case OP_AND:        snprintf(buf, size, "AND V%1X, V%1X", x, y); break;
+        case OP_XOR:        snprintf(buf, size, "XOR V%1X, V%1X", x, y); break;
+        case OP_ADD_VX_VY:  snprintf(buf, size, "ADD V%1X, V%1X", x, y); break;
+        case OP_SUB:        snprintf(buf, size, "SUB V%1X, V%1X", x, y); break;
+        case OP_SHR:        snprintf(buf, size, "SHR V%1X, V%1X", x, y); break;
+        case OP_SUBN:       snprintf(buf, size, "SUBN V%1X, V%1X", x, y); break;
+        case OP_SHL:        snprintf(buf, size, "SHL V%1X, V%1X", x, y); break;
+        case OP_SNE_VX_VY:  snprintf(buf, size, "SNE V%1X, V%1X", x, y); break;
+        case OP_LD_I:       snprintf(buf, size, "LD I, 0x%03X", nnn); break;
+        case OP_JP_V0:      snprintf(buf, size, "JP V0, 0x%03X", nnn); break;
+        case OP_RND:        snprintf(buf, size, "RND V%1X, 0x%02X", x, kk); break;
+        case OP_DRW:        snprintf(buf, size, "DRW V%1X, V%1X, %u", x, y, n); break;
+        case OP_SKP:        snprintf(buf, size, "SKP V%1X", x); break;
+        case OP_SKNP:       snprintf(buf, size, "SKNP V%1X", x); break;
+        case OP_LD_VX_DT:   snprintf(buf, size, "LD V%1X, DT", x); break;
+        case OP_LD_VX_K:    snprintf(buf, size, "LD V%1X, K", x); break;
+        case OP_LD_DT_VX:   snprintf(buf, size, "LD DT, V%1X", x); break;
+        case OP_LD_ST_VX:   snprintf(buf, size, "LD ST, V%1X", x); break;
+        case OP_ADD_I_VX:   snprintf(buf, size, "ADD I, V%1X", x); break;
+        case OP_LD_F_VX:    snprintf(buf, size, "LD F, V%1X", x); break;
+        case OP_LD_B_VX:    snprintf(buf, size, "LD B, V%1X", x); break;
+        case OP_LD_I_VX:    snprintf(buf, size, "LD [I], V%1X", x); break;
+        case OP_LD_VX_I:    snprintf(buf, size, "LD V%1X, [I]", x); break;
+        case OP_SCD:        snprintf(buf, size, "SCD %u", n); break;
+        case OP_SCR:        snprintf(buf, size, "SCR"); break;
+        case OP_SCL:        snprintf(buf, size, "SCL"); break;
+        case OP_EXIT:       snprintf(buf, size, "EXIT"); break;
+        case OP_LOW:        snprintf(buf, size, "LOW"); break;
+        case OP_HIGH:       snprintf(buf, size, "HIGH"); break;
+        case OP_LD_HF_VX:   snprintf(buf, size, "LD HF, V%1X", x); break;
+        case OP_LD_R_VX:    snprintf(buf, size, "LD R, V%1X", x); break;
+        case OP_LD_VX_R:    snprintf(buf, size, "LD V%1X, R", x); break;
+        case OP_SCU:        snprintf(buf, size, "SCU %u", n); break;
+        case OP_SAVE_VX_VY: snprintf(buf, size, "LD [I], V%1X-V%1X", x, y); break;
+        case OP_LOAD_VX_VY: snprintf(buf, size, "LD V%1X-V%1X, [I]", x, y); break;
+        case OP_LD_I_LONG:  snprintf(buf, size, "LD I, long"); break;
+        case OP_PLANE:      snprintf(buf, size, "PLANE %u", x); break;
+        case OP_AUDIO:      snprintf(buf, size, "AUDIO"); break;
+        case OP_PITCH:      snprintf(buf, size, "PITCH V%1X", x); break;
+        default:            snprintf(buf, size, "??? 0x%04X", opcode); break;
+    }
+}
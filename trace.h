@@ -0,0 +1,68 @@
+#ifndef TRACE_H_IRISH
+#define TRACE_H_IRISH
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+// Instruction tracing, build with -DCHIP8_TRACE=0 to compile it out completely.
+// When compiled in but not enabled (chip8->trace == NULL) every instruction pays
+// one well predicted branch.
+#ifndef CHIP8_TRACE
+#   define CHIP8_TRACE 1
+#endif
+
+#define TRACE_MAGIC "C8TR"
+#define TRACE_VERSION 1
+
+// Machine state right before an instruction executed. Register deltas are not
+// stored, the decoder gets them by comparing a record with the one after it.
+typedef struct
+{
+    uint32_t cycle;         // instruction number since tracing started, wraps
+    uint16_t PC;            // address of the instruction
+    uint16_t opcode;        // the instruction
+    uint16_t I;
+    uint8_t SP;
+    uint8_t DT;
+    uint8_t ST;
+    uint8_t reserved[3];
+    uint8_t Vx[16];
+} trace_record_t;           // 32 bytes, 2 records per cache line
+
+// Fixed size ring buffer of trace records, the oldest records are overwritten
+typedef struct trace_buffer
+{
+    trace_record_t *records;
+    uint32_t mask;          // capacity - 1, capacity is a power of 2
+    uint64_t head;          // total records written
+} trace_buffer_t;
+
+int init_trace(trace_buffer_t *trace, uint32_t capacity);
+void destroy_trace(trace_buffer_t *trace);
+
+// Called by the dispatch engines for every instruction while tracing is enabled
+static inline void trace_instruction(trace_buffer_t *trace, const chip8_t *chip8, uint16_t opcode)
+{
+    trace_record_t *record = &trace->records[trace->head & trace->mask];
+    record->cycle = (uint32_t)trace->head;
+    record->PC = chip8->reg.PC;
+    record->opcode = opcode;
+    record->I = chip8->reg.I;
+    record->SP = chip8->reg.SP;
+    record->DT = chip8->reg.DT;
+    record->ST = chip8->reg.ST;
+    for (int i=0; i<16; i++)
+        record->Vx[i] = chip8->reg.Vx[i];
+    trace->head++;
+}
+
+// Binary trace files, the records still in the ring buffer oldest first
+int write_trace(const trace_buffer_t *trace, const char *path);
+int decode_trace(const char *path, FILE *out);
+
+// Write a human readable form of the opcode to buf
+void disassemble(uint16_t opcode, char *buf, size_t size);
+
+#endif
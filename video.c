@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+#include "main.h"
+#include "chip8.h"
+#include "helpers/logging.h"
+
+// SDL window, renderer and display texture of the windowed front end
+
+// Upload a frame to the streaming texture and present it scaled to the window
+void present_frame(sdl_t sdl, const config_t config, const frame_t *frame)
+{
+        void *pixels;
+        int pitch;
+        if (SDL_LockTexture(sdl.texture, NULL, &pixels, &pitch) != 0)
+        {
+            Log_Warn("Could not lock display texture: %s", SDL_GetError());
+            return;
+        }
+
+        // Expand every packed display row into one row of texels, the
+        // resolution only changes between frames so it is checked once here
+        const uint32_t words = frame->displayWords;
+        if (frame->displayPlanes == 1)
+        {
+            for(uint32_t i=0; i<frame->displayY; i++)
+            {
+                uint32_t *texel = (uint32_t*)((uint8_t*)pixels + (i * pitch));
+                const uint64_t *row = &frame->display[i * words];
+
+                for(uint32_t w=0; w<words; w++)
+                {
+                    uint64_t bits = row[w];
+                    for(int j=0; j<64; j++, bits <<= 1)
+                        *texel++ = (bits >> 63) ? config.fg_color.value : config.bg_color.value;
+                }
+            }
+        }
+        else
+        {
+            // XO-CHIP, the color of a pixel is its bit in plane 0 + its bit in plane 1 * 2
+            const uint32_t colors[4] = {
+                config.bg_color.value, config.fg_color.value, config.plane_colors[0], config.plane_colors[1]
+            };
+            for(uint32_t i=0; i<frame->displayY; i++)
+            {
+                uint32_t *texel = (uint32_t*)((uint8_t*)pixels + (i * pitch));
+                const uint64_t *row0 = &frame->display[i * words];
+                const uint64_t *row1 = row0 + frame->planeWords;
+
+                for(uint32_t w=0; w<words; w++)
+                {
+                    uint64_t bits0 = row0[w];
+                    uint64_t bits1 = row1[w];
+                    for(int j=0; j<64; j++, bits0 <<= 1, bits1 <<= 1)
+                        *texel++ = colors[(bits0 >> 63) | ((bits1 >> 63) << 1)];
+                }
+            }
+        }
+        SDL_UnlockTexture(sdl.texture);
+
+        // One scaled copy of the part of the texture in use, then display renderer to window
+        const SDL_Rect source = { 0, 0, (int)frame->displayX, (int)frame->displayY };
+        SDL_RenderCopy(sdl.renderer, sdl.texture, &source, NULL);
+        SDL_RenderPresent(sdl.renderer);
+}
+
+// Present the machine's display. Frames nothing was drawn to since the last
+// call are not presented.
+void update_screen(sdl_t sdl, const config_t config, chip8_t *chip8)
+{
+        if (!chip8->displayDirty)
+            return;
+
+        const frame_t frame = {
+            .display = chip8->display,
+            .planeWords = chip8->planeWords,
+            .displayWords = chip8->displayWords,
+            .displayX = chip8->displayX,
+            .displayY = chip8->displayY,
+            .displayPlanes = chip8->displayPlanes,
+        };
+        present_frame(sdl, config, &frame);
+        chip8->displayDirty = false;
+}
+
+// Count the latency of a keypad change, called once the first frame emulated
+// with it is on screen
+void record_latency(latency_t *latency, uint32_t keyTicks)
+{
+    const uint32_t ms = SDL_GetTicks() - keyTicks;
+    latency->count++;
+    latency->totalMs += ms;
+    if (ms > latency->maxMs)
+        latency->maxMs = ms;
+    latency->histogram[ms < LATENCY_BUCKETS ? ms : LATENCY_BUCKETS - 1]++;
+}
+
+// Latency in ms below which a fraction of the keypad changes were
+static uint32_t latency_percentile(const latency_t *latency, double fraction)
+{
+    uint64_t seen = 0;
+    for (uint32_t ms=0; ms<LATENCY_BUCKETS; ms++)
+    {
+        seen += latency->histogram[ms];
+        if (seen >= fraction * latency->count)
+            return ms;
+    }
+    return latency->maxMs;
+}
+
+void print_latency(const latency_t *latency)
+{
+    if (latency->count == 0)
+        return;
+
+    Log_Info("Input to photon latency of %llu keypad changes", (unsigned long long)latency->count);
+    Log_Detail("Mean:             %.1f [ms]", (double)latency->totalMs / latency->count);
+    Log_Detail("p50:              %u [ms]", latency_percentile(latency, 0.50));
+    Log_Detail("p99:              %u [ms]", latency_percentile(latency, 0.99));
+    Log_Detail("Max:              %u [ms]", latency->maxMs);
+}
+
+int initialize_sdl(sdl_t *sdl, const config_t config)
+{
+    // Initialize sub-systems
+    if (SDL_InitSubSystem(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) != 0)
+    {
+        Log_Err("Could not initialize video subsystem: %s", SDL_GetError());
+        return 1;
+    }
+    Log_Info("Initialized: VIDEO, EVENT, AUDIO, and TIMER modules");
+
+    // Create window
+    sdl->window = SDL_CreateWindow(
+        "Chip-8 Interpreter",
+        SDL_WINDOWPOS_CENTERED,
+        SDL_WINDOWPOS_CENTERED,
+        config.window_width * config.window_scale,
+        config.window_height * config.window_scale,
+        SDL_WINDOW_SHOWN
+    );
+    if (sdl->window == NULL)
+    {
+        Log_Err("Could not create window: %s", SDL_GetError());
+        return 1;
+    }
+    Log_Info("Created window");
+
+    // Create renderer
+    sdl->renderer = SDL_CreateRenderer(
+        sdl->window,
+        -1,
+        SDL_RENDERER_ACCELERATED
+    );
+    if(sdl->renderer == NULL)
+    {
+        Log_Err("Could not create renderer: %s", SDL_GetError());
+    }
+    Log_Info("Created renderer");
+
+    // Create display texture, colors are stored as 0xRRGGBBAA like config_t's.
+    // SUPER-CHIP and XO-CHIP need room for the high resolution display, low
+    // resolution frames only use the top left quarter.
+    uint32_t textureScale = (config.mode == MODE_CHIP8) ? 1 : 2;
+    sdl->texture = SDL_CreateTexture(
+        sdl->renderer,
+        SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_STREAMING,
+        config.window_width * textureScale,
+        config.window_height * textureScale
+    );
+    if(sdl->texture == NULL)
+    {
+        Log_Err("Could not create display texture: %s", SDL_GetError());
+        return 1;
+    }
+    Log_Info("Created %ix%i display texture", config.window_width * textureScale, config.window_height * textureScale);
+
+    return 0;
+}
+
+void cleanup_sdl(sdl_t *sdl)
+{
+    printf("\n");
+    Log_Warn("Shutting down SDL...");
+    SDL_DestroyTexture(sdl->texture);
+    Log_Info("Destroyed Texture");
+    SDL_DestroyRenderer(sdl->renderer);
+    Log_Info("Destroyed Renderer");
+    SDL_DestroyWindow(sdl->window);
+    Log_Info("Destroyed Window");
+    SDL_Quit();
+    Log_Info("Shutdown sub-modules and SDL");
+}